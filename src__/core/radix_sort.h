@@ -0,0 +1,49 @@
+#ifndef ENGINE3D_SRC_RADIX_SORT_H_
+#define ENGINE3D_SRC_RADIX_SORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Stable LSD radix sort on 64 bit keys, one counting pass per byte. Bytes that are equal in every key are skipped,
+// so keys that only use a few bits (or share their high bits, like pointers) cost only the passes they need.
+// scratch is resized to items.size() and can be kept around to avoid allocations.
+template<typename T, typename KeyOf>
+void radix_sort(std::vector<T>& items, std::vector<T>& scratch, KeyOf&& key_of) {
+    if (items.size() < 2) {
+        return;
+    }
+    std::uint64_t any_set = 0;
+    std::uint64_t all_set = ~std::uint64_t{0};
+    for (const auto& item : items) {
+        std::uint64_t key = key_of(item);
+        any_set |= key;
+        all_set &= key;
+    }
+    const std::uint64_t varying = any_set ^ all_set;
+
+    scratch.resize(items.size());
+    for (unsigned shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xFFu) == 0) {
+            continue;
+        }
+        std::size_t offsets[256] = {};
+        for (const auto& item : items) {
+            ++offsets[(key_of(item) >> shift) & 0xFFu];
+        }
+        std::size_t sum = 0;
+        for (auto& offset : offsets) {
+            std::size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (auto& item : items) {
+            std::size_t digit = (key_of(item) >> shift) & 0xFFu;
+            scratch[offsets[digit]++] = std::move(item);
+        }
+        items.swap(scratch);
+    }
+}
+
+#endif // ENGINE3D_SRC_RADIX_SORT_H_
@@ -0,0 +1,75 @@
+#include "range_allocator.h"
+
+#include <algorithm>
+#include <iterator>
+
+RangeAllocator::RangeAllocator(std::size_t capacity) { grow(capacity); }
+
+std::optional<std::size_t> RangeAllocator::allocate(std::size_t count) {
+    if (count == 0) {
+        return std::nullopt;
+    }
+    for (auto it = free_ranges_.begin(); it != free_ranges_.end(); ++it) {
+        if (it->second < count) {
+            continue;
+        }
+        std::size_t offset = it->first;
+        std::size_t remaining = it->second - count;
+        free_ranges_.erase(it);
+        if (remaining > 0) {
+            free_ranges_.emplace(offset + count, remaining);
+        }
+        used_ += count;
+        return offset;
+    }
+    return std::nullopt;
+}
+
+void RangeAllocator::release(std::size_t offset, std::size_t count) {
+    if (count == 0) {
+        return;
+    }
+    used_ -= std::min(used_, count);
+    auto next = free_ranges_.lower_bound(offset);
+    if (next != free_ranges_.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            count += previous->second;
+            free_ranges_.erase(previous);
+        }
+    }
+    if (next != free_ranges_.end() && offset + count == next->first) {
+        count += next->second;
+        free_ranges_.erase(next);
+    }
+    free_ranges_.emplace(offset, count);
+}
+
+void RangeAllocator::grow(std::size_t new_capacity) {
+    if (new_capacity <= capacity_) {
+        return;
+    }
+    std::size_t added = new_capacity - capacity_;
+    std::size_t offset = capacity_;
+    capacity_ = new_capacity;
+    // counted as used until released, so release can merge it with a free tail
+    used_ += added;
+    release(offset, added);
+}
+
+void RangeAllocator::clear() {
+    free_ranges_.clear();
+    used_ = 0;
+    if (capacity_ > 0) {
+        free_ranges_.emplace(0, capacity_);
+    }
+}
+
+std::size_t RangeAllocator::largest_free() const {
+    std::size_t largest = 0;
+    for (const auto& range : free_ranges_) {
+        largest = std::max(largest, range.second);
+    }
+    return largest;
+}
@@ -0,0 +1,33 @@
+#ifndef ENGINE3D_SRC_RANGE_ALLOCATOR_H_
+#define ENGINE3D_SRC_RANGE_ALLOCATOR_H_
+
+#include <cstddef>
+#include <map>
+#include <optional>
+
+// First fit sub-allocator over [0, capacity) in abstract units (bytes, elements, ...). Free ranges are kept sorted
+// by offset and merged with their neighbours when released, so freeing and reallocating a range of the same size
+// lands at the same place again.
+class RangeAllocator {
+  public:
+    explicit RangeAllocator(std::size_t capacity = 0);
+
+    // lowest free offset that fits count units, nullopt when no free range is large enough
+    std::optional<std::size_t> allocate(std::size_t count);
+    void release(std::size_t offset, std::size_t count);
+    // appends [capacity, new_capacity) as free space, never shrinks
+    void grow(std::size_t new_capacity);
+    void clear();
+
+    std::size_t capacity() const { return capacity_; }
+    std::size_t used() const { return used_; }
+    std::size_t largest_free() const;
+
+  private:
+    // offset -> count
+    std::map<std::size_t, std::size_t> free_ranges_;
+    std::size_t capacity_{0};
+    std::size_t used_{0};
+};
+
+#endif // ENGINE3D_SRC_RANGE_ALLOCATOR_H_
@@ -0,0 +1,56 @@
+#ifndef ENGINE3D_SRC_SPSC_QUEUE_H_
+#define ENGINE3D_SRC_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock free ring buffer for exactly one producer and one consumer thread. Neither side blocks or allocates,
+// each one only writes its own index and publishes it with release semantics.
+template<typename T>
+class SpscQueue {
+  public:
+    explicit SpscQueue(std::size_t capacity) : slots_(capacity + 1) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    std::size_t capacity() const { return slots_.size() - 1; }
+
+    // producer side, false when full
+    bool try_push(T value) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t next = advance(tail);
+        if (next == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots_[tail] = std::move(value);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false when empty
+    bool try_pop(T& value) {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots_[head]);
+        head_.store(advance(head), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+  private:
+    std::size_t advance(std::size_t index) const { return index + 1 == slots_.size() ? 0 : index + 1; }
+
+    std::vector<T> slots_;
+    // next slot to pop, written by the consumer
+    alignas(64) std::atomic<std::size_t> head_{0};
+    // next slot to push, written by the producer
+    alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+#endif // ENGINE3D_SRC_SPSC_QUEUE_H_
@@ -0,0 +1,111 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+WorkerPool::WorkerPool(std::size_t thread_count) {
+    if (thread_count == 0) {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        thread_count = hardware > 1 ? hardware - 1 : 1;
+    }
+    workers_.reserve(thread_count);
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back(&WorkerPool::worker_loop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        stop_ = true;
+    }
+    queue_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void WorkerPool::submit(Task task) {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        tasks_.push(std::move(task));
+    }
+    queue_cv_.notify_one();
+}
+
+void WorkerPool::parallel_for(std::size_t count, std::size_t grain, const RangeTask& task) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<std::size_t>(grain, 1);
+    std::size_t chunk_count = std::min((count + grain - 1) / grain, (workers_.size() + 1) * 4);
+    if (chunk_count <= 1) {
+        task(0, count);
+        return;
+    }
+    std::size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+
+    struct Counter {
+        std::atomic<std::size_t> remaining{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    auto counter = std::make_shared<Counter>();
+    counter->remaining = chunk_count;
+
+    for (std::size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        std::size_t begin = chunk * chunk_size;
+        std::size_t end = std::min(begin + chunk_size, count);
+        submit([counter, &task, begin, end]() {
+            if (begin < end) {
+                task(begin, end);
+            }
+            if (counter->remaining.fetch_sub(1) == 1) {
+                std::unique_lock<std::mutex> lock(counter->mutex);
+                counter->cv.notify_all();
+            }
+        });
+    }
+
+    task(0, std::min(chunk_size, count));
+    counter->remaining.fetch_sub(1);
+
+    // help out with queued work instead of idling until the other chunks finished
+    while (counter->remaining.load() > 0) {
+        if (!run_pending_task()) {
+            std::unique_lock<std::mutex> lock(counter->mutex);
+            counter->cv.wait(lock, [&counter]() { return counter->remaining.load() == 0; });
+        }
+    }
+}
+
+void WorkerPool::worker_loop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this] { return !tasks_.empty() || stop_; });
+            if (stop_ && tasks_.empty()) {
+                break;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+bool WorkerPool::run_pending_task() {
+    Task task;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (tasks_.empty()) {
+            return false;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop();
+    }
+    task();
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef ENGINE3D_SRC_WORKER_POOL_H_
+#define ENGINE3D_SRC_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Small fixed size thread pool used by the CPU side render stages (culling, batching, rasterization).
+// The calling thread takes part in parallel_for, so nested use from within a task cannot deadlock.
+class WorkerPool {
+  public:
+    using Task = std::function<void()>;
+    using RangeTask = std::function<void(std::size_t begin, std::size_t end)>;
+
+    // thread_count 0 picks hardware_concurrency - 1 workers
+    explicit WorkerPool(std::size_t thread_count = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    std::size_t thread_count() const { return workers_.size(); }
+
+    void submit(Task task);
+
+    // splits [0, count) into chunks of at least grain elements and blocks until all of them ran
+    void parallel_for(std::size_t count, std::size_t grain, const RangeTask& task);
+
+  private:
+    void worker_loop();
+    bool run_pending_task();
+
+    std::vector<std::thread> workers_;
+    std::queue<Task> tasks_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    bool stop_{false};
+};
+
+#endif // ENGINE3D_SRC_WORKER_POOL_H_
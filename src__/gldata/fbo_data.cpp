@@ -53,11 +53,10 @@ void FBOData::attach_texture(GLenum attachment, const TextureData::SPtr& texture
     bind();
     if (texture->get_type() == TextureType::TEX_2D) {
         glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture->operator GLuint(), 0);
-    } else if (texture->get_type() == TextureType::TEX_CUBE_MAP) {
-        for (unsigned int i = 0; i < 6; ++i) {
-            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                                   texture->operator GLuint(), 0);
-        }
+    } else if (texture->get_type() == TextureType::TEX_CUBE_MAP || texture->get_type() == TextureType::TEX_2D_ARRAY) {
+        // layered attachment: geometry shaders pick the face or layer through gl_Layer, single layers can still be
+        // selected with glFramebufferTextureLayer before drawing
+        glFramebufferTexture(GL_FRAMEBUFFER, attachment, texture->operator GLuint(), 0);
     }
     GL_ERROR_CHECK();
     check_status();
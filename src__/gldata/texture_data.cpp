@@ -49,6 +49,9 @@ void TextureData::set_data(int w, int h, const TextureSpecification& specificati
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, spec.internal_format, width, height, 0,
                          spec.data_format, spec.data_type, data ? data[i] : nullptr);
         }
+    } else if (spec.type == TextureType::TEX_2D_ARRAY) {
+        glTexImage3D(target, 0, spec.internal_format, width, height, spec.layers, 0, spec.data_format, spec.data_type,
+                     data ? data[0] : nullptr);
     }
 
     glTexParameteri(target, GL_TEXTURE_MIN_FILTER, spec.min_filter);
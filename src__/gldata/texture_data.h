@@ -10,7 +10,7 @@
 #include <cstdint>
 #include <memory>
 
-enum class TextureType { TEX_2D = GL_TEXTURE_2D, TEX_CUBE_MAP = GL_TEXTURE_CUBE_MAP };
+enum class TextureType { TEX_2D = GL_TEXTURE_2D, TEX_CUBE_MAP = GL_TEXTURE_CUBE_MAP, TEX_2D_ARRAY = GL_TEXTURE_2D_ARRAY };
 
 struct TextureSpecification {
     TextureType type = TextureType::TEX_2D;
@@ -23,6 +23,8 @@ struct TextureSpecification {
     GLint wrap_t = GL_REPEAT;
     GLint wrap_r = GL_REPEAT;
     bool generate_mipmaps = true;
+    // layer count of TEX_2D_ARRAY textures
+    int layers = 1;
 };
 
 class TextureData : public GLData {
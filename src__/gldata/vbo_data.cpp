@@ -44,6 +44,27 @@ void VBOData::store_data(int attributeNumber, int dimensions, std::vector<int>&
     unbind();
 }
 
+void VBOData::store_normalized(int attributeNumber, int dimensions, int stride, const std::vector<int16_t>& data) {
+    bind();
+    glBufferData(GL_ARRAY_BUFFER, sizeof(int16_t) * data.size(), data.data(), GL_STATIC_DRAW);
+    GL_ERROR_CHECK();
+    glVertexAttribPointer(attributeNumber, dimensions, GL_SHORT, GL_TRUE, stride * sizeof(int16_t), nullptr);
+    GL_ERROR_CHECK();
+    unbind();
+}
+
+void VBOData::attach(int attributeNumber, int dimensions) {
+    bind();
+    glVertexAttribPointer(attributeNumber, dimensions, GL_FLOAT, GL_FALSE, dimensions * sizeof(float), nullptr);
+    GL_ERROR_CHECK();
+    unbind();
+}
+
+void VBOData::attach_indices() {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, data_id);
+    GL_ERROR_CHECK();
+}
+
 void VBOData::store_indices(const std::vector<uint32_t>& indices) {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, data_id);
     GL_ERROR_CHECK();
@@ -7,6 +7,7 @@
 
 #include "gl_data.h"
 
+#include <cstdint>
 #include <vector>
 #include <memory>
 
@@ -22,8 +23,15 @@ class VBOData : public GLData {
 
     void store_data(int attributeNumber, int dimensions, std::vector<float>& data);
     void store_data(int attributeNumber, int dimensions, std::vector<int>& data);
+    // signed normalized shorts read as floats in [-1, 1], stride is the component count per vertex
+    void store_normalized(int attributeNumber, int dimensions, int stride, const std::vector<int16_t>& data);
     void store_indices(const std::vector<uint32_t>& indices);
 
+    // points the attribute of the bound VAO at float data stored earlier, to share it between VAOs
+    void attach(int attributeNumber, int dimensions);
+    // binds this index buffer to the bound VAO
+    void attach_indices();
+
     using SPtr = std::shared_ptr<VBOData>;
     using UPtr = std::unique_ptr<VBOData>;
 };
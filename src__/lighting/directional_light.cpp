@@ -2,13 +2,47 @@
 
 #include <algorithm>
 #include <cmath>
-
-#include <glad/glad.h>
+#include <limits>
 
 DirectionalLight::DirectionalLight()
     : color{1.0f, 1.0f, 1.0f}, intensity(1.0f), enabled(true), casts_shadows(true), shadow_distance(50.0f),
-      shadow_extent(25.0f), shadow_resolution(1024), light_view(Mat4f::eye()), light_projection(Mat4f::eye()),
-      light_view_projection(Mat4f::eye()), current_shadow_resolution(0) {}
+      shadow_extent(25.0f), cascade_caster_extent(25.0f), shadow_resolution(1024), cascade_count(4),
+      cascade_split_lambda(0.75f), light_view(Mat4f::eye()), light_projection(Mat4f::eye()),
+      light_view_projection(Mat4f::eye()), current_shadow_resolution(0) {
+    cascade_view_projection.fill(Mat4f::eye());
+    cascade_splits.fill(std::numeric_limits<float>::max());
+}
+
+namespace {
+Vec3f light_up(const Vec3f& dir) {
+    Vec3f up{0.0f, 1.0f, 0.0f};
+    if (std::abs(dir.dot(up)) > 0.99f) {
+        up = {0.0f, 0.0f, 1.0f};
+    }
+    return up;
+}
+
+// clip distances of a GL style perspective or orthographic projection
+bool projection_depth_range(const Mat4f& projection, float& near_plane, float& far_plane) {
+    float a = projection(2, 2);
+    float b = projection(2, 3);
+    if (projection(3, 3) == 0.0f) {
+        // a = -(f + n) / (f - n), b = -2fn / (f - n)
+        near_plane = b / (a - 1.0f);
+        far_plane = b / (a + 1.0f);
+    } else {
+        // a = -2 / (f - n), b = -(f + n) / (f - n)
+        near_plane = (b + 1.0f) / a;
+        far_plane = (b - 1.0f) / a;
+    }
+    return std::isfinite(near_plane) && std::isfinite(far_plane) && far_plane > near_plane;
+}
+
+Vec3f transform_point(const Mat4f& matrix, const Vec3f& point) {
+    Vec4f result = matrix.matmul(Vec4f{point[0], point[1], point[2], 1.0f});
+    return Vec3f{result[0], result[1], result[2]} / result[3];
+}
+} // namespace
 
 Vec3f DirectionalLight::direction(const Transformation* transform) const {
     if (transform) {
@@ -29,10 +63,7 @@ void DirectionalLight::update_matrices(const Transformation* transform) {
     Vec3f pos = position(transform);
 
     Vec3f target = pos + dir;
-    Vec3f up{0.0f, 1.0f, 0.0f};
-    if (std::abs(dir.dot(up)) > 0.99f) {
-        up = {0.0f, 0.0f, 1.0f};
-    }
+    Vec3f up = light_up(dir);
 
     light_view = Mat4f::eye().view_look_at(pos, target, up);
     light_projection = Mat4f::eye().view_orthogonal(-shadow_extent, shadow_extent, -shadow_extent, shadow_extent, 0.1f,
@@ -40,27 +71,83 @@ void DirectionalLight::update_matrices(const Transformation* transform) {
     light_view_projection = light_projection.matmul(light_view);
 }
 
-void DirectionalLight::ensure_shadow_resources() {
-    if (!casts_shadows) {
-        shadow_map.reset();
+int DirectionalLight::active_cascades() const { return std::clamp(cascade_count, 1, MAX_SHADOW_CASCADES); }
+
+void DirectionalLight::update_cascades(const Transformation* transform, const Mat4f& camera_view,
+                                       const Mat4f& camera_projection) {
+    int count = active_cascades();
+    float near_plane = 0.0f;
+    float far_plane = 0.0f;
+    if (!projection_depth_range(camera_projection, near_plane, far_plane)) {
+        cascade_view_projection.fill(light_view_projection);
+        cascade_splits.fill(std::numeric_limits<float>::max());
         return;
     }
+    float shadow_far = std::clamp(shadow_distance, near_plane + 1e-3f, far_plane);
+
+    // corners of the full camera frustum, slices are interpolated along its edges
+    Mat4f inverse_view_projection = camera_projection.matmul(camera_view).inverse();
+    std::array<Vec3f, 4> near_corners;
+    std::array<Vec3f, 4> far_corners;
+    for (int i = 0; i < 4; ++i) {
+        float x = (i & 1) ? 1.0f : -1.0f;
+        float y = (i & 2) ? 1.0f : -1.0f;
+        near_corners[i] = transform_point(inverse_view_projection, Vec3f{x, y, -1.0f});
+        far_corners[i] = transform_point(inverse_view_projection, Vec3f{x, y, 1.0f});
+    }
+
+    Vec3f dir = direction(transform);
+    Vec3f up = light_up(dir);
+    Mat4f light_rotation = Mat4f::eye().view_look_at(Vec3f{0.0f, 0.0f, 0.0f}, dir, up);
+    Mat4f inverse_light_rotation = light_rotation.inverse();
+    float lambda = std::clamp(cascade_split_lambda, 0.0f, 1.0f);
+
+    float split_near = near_plane;
+    for (int cascade = 0; cascade < count; ++cascade) {
+        float p = static_cast<float>(cascade + 1) / static_cast<float>(count);
+        float uniform_split = near_plane + (shadow_far - near_plane) * p;
+        float split_far = uniform_split;
+        if (near_plane > 0.0f) {
+            float log_split = near_plane * std::pow(shadow_far / near_plane, p);
+            split_far = lambda * log_split + (1.0f - lambda) * uniform_split;
+        }
+
+        float t0 = (split_near - near_plane) / (far_plane - near_plane);
+        float t1 = (split_far - near_plane) / (far_plane - near_plane);
+        std::array<Vec3f, 8> corners;
+        Vec3f center{0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 4; ++i) {
+            Vec3f edge = far_corners[i] - near_corners[i];
+            corners[i] = near_corners[i] + edge * t0;
+            corners[i + 4] = near_corners[i] + edge * t1;
+            center += corners[i] + corners[i + 4];
+        }
+        center /= 8.0f;
+
+        // a bounding sphere keeps the cascade size constant while the camera rotates
+        float radius = 0.0f;
+        for (const auto& corner : corners) {
+            radius = std::max(radius, (corner - center).length());
+        }
+        radius = std::max(std::ceil(radius * 16.0f) / 16.0f, 1.0f / 16.0f);
+
+        // move the cascade in whole shadow texels only, otherwise edges shimmer as the camera moves
+        float texel_size = 2.0f * radius / static_cast<float>(std::max(current_shadow_resolution, 1));
+        Vec3f light_space_center = transform_point(light_rotation, center);
+        light_space_center[0] = std::floor(light_space_center[0] / texel_size) * texel_size;
+        light_space_center[1] = std::floor(light_space_center[1] / texel_size) * texel_size;
+        Vec3f snapped_center = transform_point(inverse_light_rotation, light_space_center);
 
-    if (!shadow_map) {
-        shadow_map = std::make_unique<FBOData>(TextureType::TEX_2D);
-        current_shadow_resolution = 0;
+        Vec3f eye = snapped_center - dir * (radius + cascade_caster_extent);
+        Mat4f view = Mat4f::eye().view_look_at(eye, snapped_center, up);
+        Mat4f projection =
+            Mat4f::eye().view_orthogonal(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + cascade_caster_extent);
+        cascade_view_projection[cascade] = projection.matmul(view);
+        cascade_splits[cascade] = split_far;
+        split_near = split_far;
     }
-    if (current_shadow_resolution != shadow_resolution) {
-        TextureSpecification depth_spec;
-        depth_spec.type = TextureType::TEX_2D;
-        depth_spec.internal_format = GL_DEPTH_COMPONENT32F;
-        depth_spec.data_format = GL_DEPTH_COMPONENT;
-        depth_spec.data_type = GL_FLOAT;
-        depth_spec.min_filter = GL_LINEAR;
-        depth_spec.mag_filter = GL_LINEAR;
-        depth_spec.wrap_s = depth_spec.wrap_t = depth_spec.wrap_r = GL_CLAMP_TO_EDGE;
-        depth_spec.generate_mipmaps = false;
-        shadow_map->create_depth_attachment(shadow_resolution, shadow_resolution, depth_spec);
-        current_shadow_resolution = shadow_resolution;
+    for (int cascade = count; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+        cascade_view_projection[cascade] = cascade_view_projection[count - 1];
+        cascade_splits[cascade] = cascade_splits[count - 1];
     }
 }
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <array>
+
 #include <ecs.h>
 
+#include "../core/config.h"
 #include "../math/mat.h"
 #include "../math/transformation.h"
-#include "../gldata/fbo_data.h"
+#include "shadow_atlas.h"
 
 class DirectionalLight : public ecs::ComponentOf<DirectionalLight> {
   public:
@@ -15,20 +18,37 @@ class DirectionalLight : public ecs::ComponentOf<DirectionalLight> {
     bool enabled;
 
     bool casts_shadows;
+    // view distance from the camera covered by the cascades
     float shadow_distance;
+    // half size of the single orthographic light_projection used when cascades are not rendered
     float shadow_extent;
+    // how far casters in front of a cascade (towards the light) are still captured
+    float cascade_caster_extent;
     int shadow_resolution;
 
+    // cascaded shadow maps: the camera frustum up to shadow_distance is split into cascade_count slices, each
+    // rendered into its own atlas tile. cascade_split_lambda blends logarithmic (1) and uniform (0) splits.
+    int cascade_count;
+    float cascade_split_lambda;
+
     Mat4f light_view;
     Mat4f light_projection;
     Mat4f light_view_projection;
 
-    std::unique_ptr<FBOData> shadow_map;
+    std::array<Mat4f, MAX_SHADOW_CASCADES> cascade_view_projection;
+    // far view distance of each cascade
+    std::array<float, MAX_SHADOW_CASCADES> cascade_splits;
+
+    // atlas tiles of the cascades, valid while current_shadow_resolution (their size) is non zero
+    std::array<ShadowAtlasRect, MAX_SHADOW_CASCADES> shadow_rects;
     int current_shadow_resolution;
 
     Vec3f direction(const Transformation* transform) const;
     Vec3f position(const Transformation* transform) const;
+    int active_cascades() const;
 
     void update_matrices(const Transformation* transform);
-    void ensure_shadow_resources();
+    // fits every cascade to its slice of the camera frustum, falls back to light_view_projection when the
+    // projection has no usable depth range. Texel snapping uses the atlas tile size, so call after allocation.
+    void update_cascades(const Transformation* transform, const Mat4f& camera_view, const Mat4f& camera_projection);
 };
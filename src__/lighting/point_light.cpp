@@ -1,8 +1,5 @@
 #include "point_light.h"
 
-#include "../core/config.h"
-#include <glad/glad.h>
-
 PointLight::PointLight()
     : color{1.0f, 1.0f, 1.0f}
     , intensity(1.0f)
@@ -13,6 +10,7 @@ PointLight::PointLight()
     , shadow_near(0.1f)
     , shadow_far(25.0f)
     , shadow_resolution(1024)
+    , range_view_projection(Mat4f::eye())
     , current_shadow_resolution(0) {}
 
 Vec3f PointLight::position(const Transformation* transform) const {
@@ -52,30 +50,8 @@ void PointLight::update_shadow_matrices(const Transformation* transform) {
         Mat4f view = Mat4f::eye().view_look_at(pos, pos + directions[i], up_vectors[i]);
         shadow_matrices[i] = projection.matmul(view);
     }
-}
-
-void PointLight::ensure_shadow_resources() {
-    if (!casts_shadows) {
-        shadow_map.reset();
-        current_shadow_resolution = 0;
-        return;
-    }
 
-    if (!shadow_map) {
-        shadow_map = std::make_unique<FBOData>(TextureType::TEX_CUBE_MAP);
-        current_shadow_resolution = 0;
-    }
-    if (current_shadow_resolution != shadow_resolution) {
-        TextureSpecification depth_spec;
-        depth_spec.type = TextureType::TEX_CUBE_MAP;
-        depth_spec.internal_format = GL_DEPTH_COMPONENT32F;
-        depth_spec.data_format = GL_DEPTH_COMPONENT;
-        depth_spec.data_type = GL_FLOAT;
-        depth_spec.min_filter = GL_LINEAR;
-        depth_spec.mag_filter = GL_LINEAR;
-        depth_spec.wrap_s = depth_spec.wrap_t = depth_spec.wrap_r = GL_CLAMP_TO_EDGE;
-        depth_spec.generate_mipmaps = false;
-        shadow_map->create_depth_attachment(shadow_resolution, shadow_resolution, depth_spec);
-        current_shadow_resolution = shadow_resolution;
-    }
+    Mat4f range_view = Mat4f::eye().view_look_at(pos + Vec3f{0.0f, 0.0f, far_plane}, pos, Vec3f{0.0f, 1.0f, 0.0f});
+    Mat4f range_projection = Mat4f::eye().view_orthogonal(-far_plane, far_plane, -far_plane, far_plane, 0.0f, 2.0f * far_plane);
+    range_view_projection = range_projection.matmul(range_view);
 }
@@ -2,9 +2,9 @@
 
 #include <ecs.h>
 
-#include "../gldata/fbo_data.h"
 #include "../math/mat.h"
 #include "../math/transformation.h"
+#include "shadow_atlas.h"
 
 class PointLight : public ecs::ComponentOf<PointLight> {
   public:
@@ -21,10 +21,12 @@ class PointLight : public ecs::ComponentOf<PointLight> {
     int shadow_resolution;
 
     Mat4f shadow_matrices[6];
-    std::unique_ptr<FBOData> shadow_map;
+    // orthographic view projection enclosing the shadow range, used to cull casters for all faces at once
+    Mat4f range_view_projection;
+    // atlas tiles of the six faces, valid while current_shadow_resolution (their size) is non zero
+    ShadowAtlasRect shadow_rects[6];
     int current_shadow_resolution;
 
     Vec3f position(const Transformation* transform) const;
     void update_shadow_matrices(const Transformation* transform);
-    void ensure_shadow_resources();
 };
@@ -0,0 +1,198 @@
+#include "shadow_atlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+
+#include "directional_light.h"
+#include "point_light.h"
+#include "spot_light.h"
+
+namespace {
+int floor_power_of_two(int value) {
+    int result = 1;
+    while (result * 2 <= value) {
+        result *= 2;
+    }
+    return result;
+}
+
+int ceil_power_of_two(int value) {
+    int result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+// inverse of the Z-order interleaving, returns the even bits of code packed together
+int compact_bits(unsigned code) {
+    code &= 0x55555555u;
+    code = (code | (code >> 1)) & 0x33333333u;
+    code = (code | (code >> 2)) & 0x0F0F0F0Fu;
+    code = (code | (code >> 4)) & 0x00FF00FFu;
+    code = (code | (code >> 8)) & 0x0000FFFFu;
+    return static_cast<int>(code);
+}
+
+// directional lights cover the whole view and always come before local lights
+constexpr float kDirectionalImportance = 2.0f;
+
+void invalidate(ShadowAtlasRect* rects, int count) {
+    for (int i = 0; i < count; ++i) {
+        rects[i].size = 0;
+        rects[i].static_valid = false;
+        rects[i].rendered = false;
+    }
+}
+} // namespace
+
+ShadowAtlas::ShadowAtlas(int size, int min_tile_size)
+    : size_(floor_power_of_two(std::max(size, 1))),
+      min_tile_size_(std::min(floor_power_of_two(std::max(min_tile_size, 1)), floor_power_of_two(std::max(size, 1)))) {}
+
+ShadowAtlas::~ShadowAtlas() = default;
+
+void ShadowAtlas::ensure_resources() {
+    if (fbo_) {
+        return;
+    }
+    TextureSpecification depth_spec;
+    depth_spec.type = TextureType::TEX_2D;
+    depth_spec.internal_format = GL_DEPTH_COMPONENT32F;
+    depth_spec.data_format = GL_DEPTH_COMPONENT;
+    depth_spec.data_type = GL_FLOAT;
+    depth_spec.min_filter = GL_LINEAR;
+    depth_spec.mag_filter = GL_LINEAR;
+    depth_spec.wrap_s = depth_spec.wrap_t = depth_spec.wrap_r = GL_CLAMP_TO_EDGE;
+    depth_spec.generate_mipmaps = false;
+    fbo_ = std::make_unique<FBOData>(TextureType::TEX_2D);
+    fbo_->create_depth_attachment(size_, size_, depth_spec);
+    static_fbo_ = std::make_unique<FBOData>(TextureType::TEX_2D);
+    static_fbo_->create_depth_attachment(size_, size_, depth_spec);
+}
+
+float ShadowAtlas::screen_importance(const Vec3f& center, float radius, const Vec3f& camera_position,
+                                     float projection_scale) {
+    float distance = (center - camera_position).length();
+    if (distance <= radius) {
+        return 1.0f;
+    }
+    return std::clamp(radius * projection_scale / distance, 0.0f, 1.0f);
+}
+
+int ShadowAtlas::tile_size(int requested, float importance) const {
+    int max_size = std::clamp(floor_power_of_two(std::max(requested, 1)), min_tile_size_, size_);
+    float scaled = static_cast<float>(max_size) * std::min(importance, 1.0f);
+    return std::clamp(ceil_power_of_two(static_cast<int>(std::ceil(scaled))), min_tile_size_, max_size);
+}
+
+void ShadowAtlas::allocate(const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+                           const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                           const std::vector<std::pair<PointLight*, Transformation*>>& point_lights,
+                           const Vec3f& camera_position, const Mat4f& projection) {
+    ensure_resources();
+    requests_.clear();
+    float projection_scale = std::abs(projection(1, 1));
+
+    for (const auto& [light, transform] : directional_lights) {
+        if (!light) {
+            continue;
+        }
+        light->current_shadow_resolution = 0;
+        if (!light->casts_shadows) {
+            invalidate(light->shadow_rects.data(), MAX_SHADOW_CASCADES);
+        } else {
+            requests_.push_back({kDirectionalImportance, tile_size(light->shadow_resolution, 1.0f),
+                                 light->active_cascades(), light->shadow_rects.data(),
+                                 &light->current_shadow_resolution});
+        }
+    }
+    for (const auto& [light, transform] : spot_lights) {
+        if (!light) {
+            continue;
+        }
+        light->current_shadow_resolution = 0;
+        if (!light->casts_shadows) {
+            invalidate(&light->shadow_rect, 1);
+        } else {
+            float importance = screen_importance(light->position(transform), light->range, camera_position, projection_scale);
+            requests_.push_back({importance, tile_size(light->shadow_resolution, importance), 1, &light->shadow_rect,
+                                 &light->current_shadow_resolution});
+        }
+    }
+    for (const auto& [light, transform] : point_lights) {
+        if (!light) {
+            continue;
+        }
+        light->current_shadow_resolution = 0;
+        if (!light->casts_shadows) {
+            invalidate(light->shadow_rects, 6);
+        } else {
+            float far_plane = light->shadow_far > light->shadow_near ? light->shadow_far : light->radius;
+            float importance = screen_importance(light->position(transform), far_plane, camera_position, projection_scale);
+            requests_.push_back({importance, tile_size(light->shadow_resolution, importance), 6, light->shadow_rects,
+                                 &light->current_shadow_resolution});
+        }
+    }
+
+    std::stable_sort(requests_.begin(), requests_.end(),
+                     [](const Request& a, const Request& b) { return a.importance > b.importance; });
+
+    auto area = [&](std::size_t count) {
+        long long total = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            total += static_cast<long long>(requests_[i].tiles) * requests_[i].size * requests_[i].size;
+        }
+        return total;
+    };
+
+    // shrink the least important requests first, drop them once they are at the minimum tile size
+    const long long capacity = static_cast<long long>(size_) * size_;
+    std::size_t accepted = requests_.size();
+    while (accepted > 0 && area(accepted) > capacity) {
+        bool shrunk = false;
+        for (std::size_t i = accepted; i-- > 0;) {
+            if (requests_[i].size > min_tile_size_) {
+                requests_[i].size /= 2;
+                shrunk = true;
+                break;
+            }
+        }
+        if (!shrunk) {
+            --accepted;
+        }
+    }
+    for (std::size_t i = accepted; i < requests_.size(); ++i) {
+        invalidate(requests_[i].rects, requests_[i].tiles);
+    }
+    requests_.resize(accepted);
+    used_area_ = area(accepted);
+
+    // largest first keeps the Z-order cursor aligned to every tile size
+    std::stable_sort(requests_.begin(), requests_.end(), [](const Request& a, const Request& b) { return a.size > b.size; });
+    unsigned cursor = 0;
+    for (auto& request : requests_) {
+        int cells_per_side = request.size / min_tile_size_;
+        unsigned cells = static_cast<unsigned>(cells_per_side * cells_per_side);
+        for (int tile = 0; tile < request.tiles; ++tile) {
+            auto& rect = request.rects[tile];
+            int x = compact_bits(cursor) * min_tile_size_;
+            int y = compact_bits(cursor >> 1) * min_tile_size_;
+            // another light may have used the old place in between, cached depth only survives in place
+            if (rect.x != x || rect.y != y || rect.size != request.size) {
+                rect.static_valid = false;
+                rect.rendered = false;
+            }
+            rect.x = x;
+            rect.y = y;
+            rect.size = request.size;
+            rect.importance = request.importance;
+            float inv_size = 1.0f / static_cast<float>(size_);
+            rect.uv = Vec4f{rect.x * inv_size, rect.y * inv_size, rect.size * inv_size, rect.size * inv_size};
+            cursor += cells;
+        }
+        *request.resolution = request.size;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "../core/config.h"
+#include "../gldata/fbo_data.h"
+#include "../math/mat.h"
+
+class DirectionalLight;
+class PointLight;
+class SpotLight;
+class Transformation;
+
+// filtering of atlas lookups, every tap is a hardware depth compare with bilinear PCF over 2x2 texels
+enum class ShadowFilter { Hard = 0, Pcf4 = 1, Pcf9 = 2, Poisson = 3 };
+
+// region of the shadow atlas owned by one shadow view (a cascade, a spot map or a cube face)
+struct ShadowAtlasRect {
+    int x{0};
+    int y{0};
+    int size{0};
+    // offset (xy) and scale (zw) from the [0, 1] uv of the view to atlas uv
+    Vec4f uv{0.0f, 0.0f, 0.0f, 0.0f};
+    // screen space importance of the owning light, directional lights rank above every local light
+    float importance{0.0f};
+    // tiles that are not scheduled keep the depth rendered with view_projection in an earlier frame
+    bool scheduled{true};
+    bool rendered{false};
+    std::uint64_t rendered_frame{0};
+    Mat4f view_projection;
+    // the same rect of the static atlas holds the depth of static casters rendered with static_view_projection
+    bool static_valid{false};
+    Mat4f static_view_projection;
+
+    [[nodiscard]] bool valid() const { return size > 0; }
+};
+
+// One depth texture shared by every shadow casting light. Each frame a light requests square tiles (one per
+// cascade, one for a spot light, six cube faces for a point light) sized by its screen space importance and capped
+// by its shadow_resolution. Requests are shrunk, least important first, until they fit; the survivors are placed
+// largest first along a Z-order curve, which packs power of two squares without gaps. Lights that do not fit are
+// left with a zero current_shadow_resolution and render unshadowed for that frame.
+// A second texture of the same layout caches the depth of static casters per tile, a tile keeps its cache as long as
+// it stays at the same place in the atlas.
+class ShadowAtlas {
+  public:
+    explicit ShadowAtlas(int size = SHADOW_RESOLUTION, int min_tile_size = 128);
+    ~ShadowAtlas();
+
+    void allocate(const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+                  const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                  const std::vector<std::pair<PointLight*, Transformation*>>& point_lights,
+                  const Vec3f& camera_position, const Mat4f& projection);
+
+    [[nodiscard]] FBOData* fbo() const { return fbo_.get(); }
+    [[nodiscard]] TextureData* texture() const { return fbo_ ? fbo_->depth_texture() : nullptr; }
+    [[nodiscard]] FBOData* static_fbo() const { return static_fbo_.get(); }
+    [[nodiscard]] TextureData* static_texture() const { return static_fbo_ ? static_fbo_->depth_texture() : nullptr; }
+    [[nodiscard]] int size() const { return size_; }
+    void set_filter(ShadowFilter filter) { filter_ = filter; }
+    [[nodiscard]] ShadowFilter filter() const { return filter_; }
+    // texels handed out by the last allocate, at most size * size
+    [[nodiscard]] long long used_area() const { return used_area_; }
+
+  private:
+    struct Request {
+        float importance{0.0f};
+        int size{0};
+        int tiles{1};
+        ShadowAtlasRect* rects{nullptr};
+        int* resolution{nullptr};
+    };
+
+    void ensure_resources();
+    int tile_size(int requested, float importance) const;
+    // screen height fraction covered by a sphere, 1 when the camera is inside it
+    static float screen_importance(const Vec3f& center, float radius, const Vec3f& camera_position, float projection_scale);
+
+    int size_;
+    int min_tile_size_;
+    ShadowFilter filter_{ShadowFilter::Pcf4};
+    std::unique_ptr<FBOData> fbo_;
+    std::unique_ptr<FBOData> static_fbo_;
+    std::vector<Request> requests_;
+    long long used_area_{0};
+};
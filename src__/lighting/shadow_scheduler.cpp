@@ -0,0 +1,179 @@
+#include "shadow_scheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "directional_light.h"
+#include "point_light.h"
+#include "spot_light.h"
+
+namespace {
+// weight of a new GPU timer result in the running averages
+constexpr float kTimingSmoothing = 0.1f;
+
+int cascade_interval(int cascade) { return 1 << std::min(cascade, 2); }
+
+int local_interval(float importance) {
+    if (importance >= 0.5f) {
+        return 1;
+    }
+    if (importance >= 0.25f) {
+        return 2;
+    }
+    if (importance >= 0.1f) {
+        return 4;
+    }
+    return 8;
+}
+} // namespace
+
+ShadowScheduler::ShadowScheduler(float budget_ms) : budget_ms_(budget_ms) {}
+
+ShadowScheduler::~ShadowScheduler() {
+    for (auto& entry : queries_) {
+        if (entry.query != 0) {
+            glDeleteQueries(1, &entry.query);
+        }
+    }
+}
+
+void ShadowScheduler::add_view(ShadowAtlasRect* rects, int count, int interval, bool moved) {
+    View view;
+    view.rects = rects;
+    view.count = count;
+    view.forced = false;
+    for (int i = 0; i < count; ++i) {
+        view.forced |= !rects[i].rendered;
+        view.texels += static_cast<double>(rects[i].size) * rects[i].size;
+    }
+    if (!view.forced) {
+        view.priority = static_cast<float>(frame_ - rects[0].rendered_frame) / static_cast<float>(interval);
+        // a moved light shows lagging shadows until it is updated, so it is due right away
+        if (moved) {
+            view.priority = std::max(view.priority, 1.0f);
+        }
+    }
+    views_.push_back(view);
+}
+
+void ShadowScheduler::schedule(const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+                               const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                               const std::vector<std::pair<PointLight*, Transformation*>>& point_lights) {
+    ++frame_;
+    read_back_queries();
+    views_.clear();
+
+    for (const auto& entry : directional_lights) {
+        auto* light = entry.first;
+        if (!light || !light->casts_shadows || light->current_shadow_resolution <= 0) {
+            continue;
+        }
+        // cascades follow the camera, older cascades are sampled with the projection they were rendered with
+        for (int cascade = 0; cascade < light->active_cascades(); ++cascade) {
+            add_view(&light->shadow_rects[cascade], 1, cascade_interval(cascade), false);
+        }
+    }
+    for (const auto& entry : spot_lights) {
+        auto* light = entry.first;
+        if (!light || !light->casts_shadows || light->current_shadow_resolution <= 0) {
+            continue;
+        }
+        auto& rect = light->shadow_rect;
+        add_view(&rect, 1, local_interval(rect.importance), rect.view_projection != light->light_view_projection);
+    }
+    for (const auto& entry : point_lights) {
+        auto* light = entry.first;
+        if (!light || !light->casts_shadows || light->current_shadow_resolution <= 0) {
+            continue;
+        }
+        // the six faces are drawn in one pass and therefore scheduled together
+        bool moved = false;
+        for (int face = 0; face < 6; ++face) {
+            moved |= light->shadow_rects[face].view_projection != light->shadow_matrices[face];
+        }
+        add_view(light->shadow_rects, 6, local_interval(light->shadow_rects[0].importance), moved);
+    }
+
+    double budget_texels = std::numeric_limits<double>::max();
+    if (budget_ms_ > 0.0f && ms_per_texel_ > 0.0) {
+        budget_texels = budget_ms_ / ms_per_texel_;
+    }
+
+    std::stable_sort(views_.begin(), views_.end(), [](const View& a, const View& b) {
+        if (a.forced != b.forced) {
+            return a.forced;
+        }
+        return a.priority > b.priority;
+    });
+
+    double spent = 0.0;
+    scheduled_views_ = 0;
+    deferred_views_ = 0;
+    for (const auto& view : views_) {
+        bool due = view.forced || view.priority >= 1.0f || budget_ms_ <= 0.0f;
+        // the most overdue view always runs so a small budget cannot starve every light
+        bool run = due && (view.forced || spent == 0.0 || spent + view.texels <= budget_texels);
+        for (int i = 0; i < view.count; ++i) {
+            view.rects[i].scheduled = run;
+            if (run) {
+                view.rects[i].rendered_frame = frame_;
+            }
+        }
+        if (run) {
+            spent += view.texels;
+            ++scheduled_views_;
+        } else if (due) {
+            ++deferred_views_;
+        }
+    }
+    frame_texels_ = spent;
+}
+
+void ShadowScheduler::begin_gpu_timing() {
+    auto& entry = queries_[query_index_];
+    if (entry.query == 0) {
+        glGenQueries(1, &entry.query);
+    }
+    // every query is still in flight, this frame is not measured
+    if (entry.pending) {
+        timing_ = false;
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, entry.query);
+    timing_ = true;
+}
+
+void ShadowScheduler::end_gpu_timing() {
+    if (!timing_) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    auto& entry = queries_[query_index_];
+    entry.pending = true;
+    entry.texels = frame_texels_;
+    query_index_ = (query_index_ + 1) % kQueryCount;
+    timing_ = false;
+}
+
+void ShadowScheduler::read_back_queries() {
+    for (auto& entry : queries_) {
+        if (!entry.pending) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 elapsed_ns = 0;
+        glGetQueryObjectui64v(entry.query, GL_QUERY_RESULT, &elapsed_ns);
+        entry.pending = false;
+
+        float elapsed_ms = static_cast<float>(elapsed_ns) * 1e-6f;
+        gpu_ms_ = gpu_ms_ == 0.0f ? elapsed_ms : gpu_ms_ + (elapsed_ms - gpu_ms_) * kTimingSmoothing;
+        if (entry.texels > 0.0) {
+            double sample = elapsed_ms / entry.texels;
+            ms_per_texel_ = ms_per_texel_ == 0.0 ? sample : ms_per_texel_ + (sample - ms_per_texel_) * kTimingSmoothing;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../math/mat.h"
+#include "shadow_atlas.h"
+
+class DirectionalLight;
+class PointLight;
+class SpotLight;
+class Transformation;
+
+// Decides which atlas tiles are re-rendered each frame. Every shadow view (a cascade, a spot map, or all six faces
+// of a point light) has an update interval: cascades double theirs per level up to every 4th frame, local lights
+// get longer intervals the smaller they are on screen. Views that are due are rendered most overdue first until the
+// estimated cost reaches the frame budget; the cost per texel comes from GPU timer queries around the shadow pass.
+// Views that were never rendered at their tile are always rendered, the rest keep last frame's depth and are
+// sampled with the view projection they were rendered with.
+class ShadowScheduler {
+  public:
+    explicit ShadowScheduler(float budget_ms = 2.0f);
+    ~ShadowScheduler();
+
+    // a budget of zero or less renders every view every frame
+    void set_budget_ms(float budget_ms) { budget_ms_ = budget_ms; }
+    [[nodiscard]] float budget_ms() const { return budget_ms_; }
+
+    // must run after the atlas allocation and the light matrix updates of the frame
+    void schedule(const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+                  const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                  const std::vector<std::pair<PointLight*, Transformation*>>& point_lights);
+
+    // bracket the shadow pass, results are read back a few frames later without stalling
+    void begin_gpu_timing();
+    void end_gpu_timing();
+
+    // smoothed GPU time of the shadow pass, zero until the first query returned
+    [[nodiscard]] float gpu_ms() const { return gpu_ms_; }
+    [[nodiscard]] int scheduled_views() const { return scheduled_views_; }
+    [[nodiscard]] int deferred_views() const { return deferred_views_; }
+
+  private:
+    struct View {
+        ShadowAtlasRect* rects{nullptr};
+        int count{1};
+        // frames since the last update divided by the interval, due from 1 on
+        float priority{0.0f};
+        bool forced{false};
+        double texels{0.0};
+    };
+
+    struct TimerQuery {
+        GLuint query{0};
+        bool pending{false};
+        double texels{0.0};
+    };
+
+    void add_view(ShadowAtlasRect* rects, int count, int interval, bool moved);
+    void read_back_queries();
+
+    float budget_ms_;
+    std::uint64_t frame_{0};
+    std::vector<View> views_;
+
+    static constexpr int kQueryCount = 4;
+    std::array<TimerQuery, kQueryCount> queries_{};
+    int query_index_{0};
+    bool timing_{false};
+    double frame_texels_{0.0};
+    // exponential averages of the measured pass time and its cost per rendered texel
+    float gpu_ms_{0.0f};
+    double ms_per_texel_{0.0};
+
+    int scheduled_views_{0};
+    int deferred_views_{0};
+};
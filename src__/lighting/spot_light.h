@@ -2,9 +2,9 @@
 
 #include <ecs.h>
 
-#include "../gldata/fbo_data.h"
 #include "../math/mat.h"
 #include "../math/transformation.h"
+#include "shadow_atlas.h"
 
 class SpotLight : public ecs::ComponentOf<SpotLight> {
   public:
@@ -23,12 +23,12 @@ class SpotLight : public ecs::ComponentOf<SpotLight> {
     Mat4f light_view;
     Mat4f light_projection;
     Mat4f light_view_projection;
-    std::unique_ptr<FBOData> shadow_map;
+    // atlas tile of the shadow map, valid while current_shadow_resolution (its size) is non zero
+    ShadowAtlasRect shadow_rect;
     int current_shadow_resolution;
 
     Vec3f direction(const Transformation* transform) const;
     Vec3f position(const Transformation* transform) const;
 
     void update_matrices(const Transformation* transform);
-    void ensure_shadow_resources();
 };
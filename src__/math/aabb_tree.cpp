@@ -0,0 +1,226 @@
+#include "aabb_tree.h"
+
+#include <algorithm>
+#include <cassert>
+
+AABBTree::AABBTree(float margin) : margin_(margin) {}
+
+int AABBTree::insert(const AABB& box, std::size_t user_data) {
+    int proxy = allocate_node();
+    Node& node = nodes_[proxy];
+    node.box = box;
+    node.box.min -= Vec3f{margin_, margin_, margin_};
+    node.box.max += Vec3f{margin_, margin_, margin_};
+    node.user_data = user_data;
+    node.height = 0;
+    insert_leaf(proxy);
+    ++proxy_count_;
+    return proxy;
+}
+
+void AABBTree::remove(int proxy) {
+    assert(proxy >= 0 && proxy < static_cast<int>(nodes_.size()) && nodes_[proxy].leaf());
+    remove_leaf(proxy);
+    free_node(proxy);
+    --proxy_count_;
+}
+
+bool AABBTree::update(int proxy, const AABB& box) {
+    Node& node = nodes_[proxy];
+    if (node.box.contains(box)) {
+        // still inside the fat box, but shrink it again once it became much larger than needed
+        AABB large = box;
+        Vec3f big_margin{4.0f * margin_, 4.0f * margin_, 4.0f * margin_};
+        large.min -= big_margin;
+        large.max += big_margin;
+        if (large.contains(node.box)) {
+            return false;
+        }
+    }
+    remove_leaf(proxy);
+    Node& moved = nodes_[proxy];
+    moved.box = box;
+    moved.box.min -= Vec3f{margin_, margin_, margin_};
+    moved.box.max += Vec3f{margin_, margin_, margin_};
+    insert_leaf(proxy);
+    return true;
+}
+
+void AABBTree::clear() {
+    nodes_.clear();
+    root_ = kNullNode;
+    free_list_ = kNullNode;
+    proxy_count_ = 0;
+}
+
+int AABBTree::allocate_node() {
+    if (free_list_ == kNullNode) {
+        nodes_.emplace_back();
+        free_list_ = static_cast<int>(nodes_.size()) - 1;
+        nodes_[free_list_].parent = kNullNode;
+    }
+    int index = free_list_;
+    free_list_ = nodes_[index].parent;
+    nodes_[index] = Node{};
+    return index;
+}
+
+void AABBTree::free_node(int index) {
+    nodes_[index].parent = free_list_;
+    nodes_[index].height = -1;
+    free_list_ = index;
+}
+
+void AABBTree::insert_leaf(int leaf) {
+    if (root_ == kNullNode) {
+        root_ = leaf;
+        nodes_[root_].parent = kNullNode;
+        return;
+    }
+
+    // descend towards the cheapest sibling using the surface area heuristic
+    const AABB leaf_box = nodes_[leaf].box;
+    int index = root_;
+    while (!nodes_[index].leaf()) {
+        const Node& node = nodes_[index];
+        float area = node.box.surface_area();
+        float combined_area = AABB::merge(node.box, leaf_box).surface_area();
+
+        // cost of making a new parent for this node and the leaf, and the cost pushed down to the children
+        float cost = 2.0f * combined_area;
+        float inheritance_cost = 2.0f * (combined_area - area);
+
+        auto child_cost = [&](int child) {
+            const AABB& child_box = nodes_[child].box;
+            float merged = AABB::merge(child_box, leaf_box).surface_area();
+            if (nodes_[child].leaf()) {
+                return merged + inheritance_cost;
+            }
+            return merged - child_box.surface_area() + inheritance_cost;
+        };
+        float cost_left = child_cost(node.left);
+        float cost_right = child_cost(node.right);
+
+        if (cost < cost_left && cost < cost_right) {
+            break;
+        }
+        index = cost_left < cost_right ? node.left : node.right;
+    }
+
+    int sibling = index;
+    int old_parent = nodes_[sibling].parent;
+    int new_parent = allocate_node();
+    nodes_[new_parent].parent = old_parent;
+    nodes_[new_parent].box = AABB::merge(leaf_box, nodes_[sibling].box);
+    nodes_[new_parent].height = nodes_[sibling].height + 1;
+
+    if (old_parent != kNullNode) {
+        if (nodes_[old_parent].left == sibling) {
+            nodes_[old_parent].left = new_parent;
+        } else {
+            nodes_[old_parent].right = new_parent;
+        }
+    } else {
+        root_ = new_parent;
+    }
+    nodes_[new_parent].left = sibling;
+    nodes_[new_parent].right = leaf;
+    nodes_[sibling].parent = new_parent;
+    nodes_[leaf].parent = new_parent;
+
+    refit_ancestors(nodes_[leaf].parent);
+}
+
+void AABBTree::remove_leaf(int leaf) {
+    if (leaf == root_) {
+        root_ = kNullNode;
+        return;
+    }
+
+    int parent = nodes_[leaf].parent;
+    int grand_parent = nodes_[parent].parent;
+    int sibling = nodes_[parent].left == leaf ? nodes_[parent].right : nodes_[parent].left;
+
+    if (grand_parent != kNullNode) {
+        if (nodes_[grand_parent].left == parent) {
+            nodes_[grand_parent].left = sibling;
+        } else {
+            nodes_[grand_parent].right = sibling;
+        }
+        nodes_[sibling].parent = grand_parent;
+        free_node(parent);
+        refit_ancestors(grand_parent);
+    } else {
+        root_ = sibling;
+        nodes_[sibling].parent = kNullNode;
+        free_node(parent);
+    }
+}
+
+void AABBTree::refit_ancestors(int index) {
+    while (index != kNullNode) {
+        index = balance(index);
+        Node& node = nodes_[index];
+        node.height = 1 + std::max(nodes_[node.left].height, nodes_[node.right].height);
+        node.box = AABB::merge(nodes_[node.left].box, nodes_[node.right].box);
+        index = node.parent;
+    }
+}
+
+// rotates the taller child up if the subtree at index is out of balance, returns the new subtree root
+int AABBTree::balance(int a) {
+    Node& node_a = nodes_[a];
+    if (node_a.leaf() || node_a.height < 2) {
+        return a;
+    }
+
+    int b = node_a.left;
+    int c = node_a.right;
+    int difference = nodes_[c].height - nodes_[b].height;
+
+    auto rotate_up = [this, a](int up, int other) {
+        // `up` replaces a, a adopts other and the shorter child of up
+        Node& node_a = nodes_[a];
+        Node& node_up = nodes_[up];
+        int f = node_up.left;
+        int g = node_up.right;
+
+        node_up.left = a;
+        node_up.parent = node_a.parent;
+        node_a.parent = up;
+
+        if (node_up.parent != kNullNode) {
+            if (nodes_[node_up.parent].left == a) {
+                nodes_[node_up.parent].left = up;
+            } else {
+                nodes_[node_up.parent].right = up;
+            }
+        } else {
+            root_ = up;
+        }
+
+        int keep = nodes_[f].height > nodes_[g].height ? f : g;
+        int give = keep == f ? g : f;
+        node_up.right = keep;
+        if (node_a.left == up) {
+            node_a.left = give;
+        } else {
+            node_a.right = give;
+        }
+        nodes_[give].parent = a;
+
+        node_a.box = AABB::merge(nodes_[other].box, nodes_[give].box);
+        node_a.height = 1 + std::max(nodes_[other].height, nodes_[give].height);
+        node_up.box = AABB::merge(node_a.box, nodes_[keep].box);
+        node_up.height = 1 + std::max(node_a.height, nodes_[keep].height);
+        return up;
+    };
+
+    if (difference > 1) {
+        return rotate_up(c, b);
+    }
+    if (difference < -1) {
+        return rotate_up(b, c);
+    }
+    return a;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "bounds.h"
+
+// Dynamic bounding volume hierarchy. Leaves store enlarged ("fat") boxes so small movements do not touch the tree,
+// insertion picks siblings by surface area cost and the tree is kept balanced with AVL style rotations.
+// Proxies are node indices and stay valid until removed; user_data is an arbitrary key (e.g. an entity id).
+class AABBTree {
+  public:
+    static constexpr int kNullNode = -1;
+
+    explicit AABBTree(float margin = 0.1f);
+
+    int insert(const AABB& box, std::size_t user_data);
+    void remove(int proxy);
+    // refits the proxy, returns true when the leaf had to be reinserted
+    bool update(int proxy, const AABB& box);
+    void clear();
+
+    [[nodiscard]] std::size_t user_data(int proxy) const { return nodes_[proxy].user_data; }
+    [[nodiscard]] const AABB& fat_bounds(int proxy) const { return nodes_[proxy].box; }
+    [[nodiscard]] std::size_t size() const { return proxy_count_; }
+    [[nodiscard]] int height() const { return root_ == kNullNode ? 0 : nodes_[root_].height; }
+
+    template<typename Callback>
+    void query(const AABB& box, Callback&& callback) const {
+        traverse([&box](const AABB& node_box) { return node_box.overlaps(box); }, callback);
+    }
+
+    template<typename Callback>
+    void query(const BoundingSphere& sphere, Callback&& callback) const {
+        traverse([&sphere](const AABB& node_box) { return node_box.overlaps(sphere.center, sphere.radius); }, callback);
+    }
+
+    // callback(user_data, fully_inside); subtrees fully inside the frustum are reported without further plane tests
+    template<typename Callback>
+    void query(const Frustum& frustum, Callback&& callback) const {
+        if (root_ == kNullNode) {
+            return;
+        }
+        std::vector<std::pair<int, bool>> stack;
+        stack.reserve(64);
+        stack.emplace_back(root_, false);
+        while (!stack.empty()) {
+            auto [index, inside] = stack.back();
+            stack.pop_back();
+            const Node& node = nodes_[index];
+            if (!inside) {
+                FrustumTest test = frustum.classify(node.box);
+                if (test == FrustumTest::Outside) {
+                    continue;
+                }
+                inside = test == FrustumTest::Inside;
+            }
+            if (node.leaf()) {
+                callback(node.user_data, inside);
+            } else {
+                stack.emplace_back(node.left, inside);
+                stack.emplace_back(node.right, inside);
+            }
+        }
+    }
+
+    // callback(user_data, entry_distance) for every leaf box the ray passes through within max_distance
+    template<typename Callback>
+    void ray_cast(const Vec3f& origin, const Vec3f& direction, float max_distance, Callback&& callback) const {
+        Vec3f inv_direction;
+        for (int i = 0; i < 3; ++i) {
+            inv_direction[i] = direction[i] != 0.0f ? 1.0f / direction[i] : std::numeric_limits<float>::infinity();
+        }
+        float t_entry = 0.0f;
+        traverse(
+            [&](const AABB& node_box) { return node_box.intersects_ray(origin, inv_direction, max_distance, t_entry); },
+            [&](std::size_t user_data) { callback(user_data, t_entry); });
+    }
+
+  private:
+    struct Node {
+        AABB box;
+        int parent{kNullNode};
+        int left{kNullNode};
+        int right{kNullNode};
+        // -1 marks a node on the free list
+        int height{-1};
+        std::size_t user_data{0};
+
+        [[nodiscard]] bool leaf() const { return left == kNullNode; }
+    };
+
+    template<typename Test, typename Callback>
+    void traverse(Test&& test, Callback&& callback) const {
+        if (root_ == kNullNode) {
+            return;
+        }
+        std::vector<int> stack;
+        stack.reserve(64);
+        stack.push_back(root_);
+        while (!stack.empty()) {
+            int index = stack.back();
+            stack.pop_back();
+            const Node& node = nodes_[index];
+            if (!test(node.box)) {
+                continue;
+            }
+            if (node.leaf()) {
+                callback(node.user_data);
+            } else {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    int allocate_node();
+    void free_node(int index);
+    void insert_leaf(int leaf);
+    void remove_leaf(int leaf);
+    int balance(int index);
+    void refit_ancestors(int index);
+
+    std::vector<Node> nodes_;
+    int root_{kNullNode};
+    int free_list_{kNullNode};
+    std::size_t proxy_count_{0};
+    float margin_;
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include "mat.h"
+
+struct AABB {
+    Vec3f min{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    Vec3f max{std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+
+    [[nodiscard]] bool valid() const { return min[0] <= max[0] && min[1] <= max[1] && min[2] <= max[2]; }
+    [[nodiscard]] Vec3f center() const { return (min + max) * 0.5f; }
+    [[nodiscard]] Vec3f extents() const { return (max - min) * 0.5f; }
+
+    void expand(const Vec3f& point) {
+        for (int i = 0; i < 3; ++i) {
+            min[i] = std::min(min[i], point[i]);
+            max[i] = std::max(max[i], point[i]);
+        }
+    }
+
+    void expand(const AABB& other) {
+        if (!other.valid()) {
+            return;
+        }
+        expand(other.min);
+        expand(other.max);
+    }
+
+    [[nodiscard]] float surface_area() const {
+        Vec3f d = max - min;
+        return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+
+    [[nodiscard]] bool contains(const AABB& other) const {
+        return min[0] <= other.min[0] && min[1] <= other.min[1] && min[2] <= other.min[2] && other.max[0] <= max[0] &&
+               other.max[1] <= max[1] && other.max[2] <= max[2];
+    }
+
+    [[nodiscard]] bool overlaps(const AABB& other) const {
+        return min[0] <= other.max[0] && other.min[0] <= max[0] && min[1] <= other.max[1] && other.min[1] <= max[1] &&
+               min[2] <= other.max[2] && other.min[2] <= max[2];
+    }
+
+    [[nodiscard]] bool overlaps(const Vec3f& sphere_center, float radius) const {
+        float dist_sq = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            float v = std::clamp(sphere_center[i], min[i], max[i]) - sphere_center[i];
+            dist_sq += v * v;
+        }
+        return dist_sq <= radius * radius;
+    }
+
+    // slab test, inv_direction is 1 / direction per axis; returns the entry distance in t_entry
+    [[nodiscard]] bool intersects_ray(const Vec3f& origin, const Vec3f& inv_direction, float max_t, float& t_entry) const {
+        float t_min = 0.0f;
+        float t_max = max_t;
+        for (int i = 0; i < 3; ++i) {
+            float t0 = (min[i] - origin[i]) * inv_direction[i];
+            float t1 = (max[i] - origin[i]) * inv_direction[i];
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+            t_min = std::max(t_min, t0);
+            t_max = std::min(t_max, t1);
+            if (t_min > t_max) {
+                return false;
+            }
+        }
+        t_entry = t_min;
+        return true;
+    }
+
+    [[nodiscard]] static AABB merge(const AABB& a, const AABB& b) {
+        AABB result = a;
+        result.expand(b);
+        return result;
+    }
+
+    // world space box of this box after an affine transform (Arvo's method)
+    [[nodiscard]] AABB transformed(const Mat4f& matrix) const {
+        AABB result;
+        if (!valid()) {
+            return result;
+        }
+        for (int row = 0; row < 3; ++row) {
+            float lo = matrix(row, 3);
+            float hi = matrix(row, 3);
+            for (int col = 0; col < 3; ++col) {
+                float a = matrix(row, col) * min[col];
+                float b = matrix(row, col) * max[col];
+                lo += std::min(a, b);
+                hi += std::max(a, b);
+            }
+            result.min[row] = lo;
+            result.max[row] = hi;
+        }
+        return result;
+    }
+};
+
+struct BoundingSphere {
+    Vec3f center{0.0f, 0.0f, 0.0f};
+    float radius{0.0f};
+
+    // world space sphere after an affine transform, radius scaled by the largest axis scale
+    [[nodiscard]] BoundingSphere transformed(const Mat4f& matrix) const {
+        BoundingSphere result;
+        for (int row = 0; row < 3; ++row) {
+            result.center[row] =
+                matrix(row, 0) * center[0] + matrix(row, 1) * center[1] + matrix(row, 2) * center[2] + matrix(row, 3);
+        }
+        float max_scale_sq = 0.0f;
+        for (int col = 0; col < 3; ++col) {
+            float len_sq = matrix(0, col) * matrix(0, col) + matrix(1, col) * matrix(1, col) + matrix(2, col) * matrix(2, col);
+            max_scale_sq = std::max(max_scale_sq, len_sq);
+        }
+        result.radius = radius * std::sqrt(max_scale_sq);
+        return result;
+    }
+};
+
+enum class FrustumTest { Outside, Intersecting, Inside };
+
+// Six normalised planes (xyz = normal pointing inside, w = distance) extracted from a view projection matrix.
+// Order: left, right, bottom, top, near, far.
+struct Frustum {
+    std::array<Vec4f, 6> planes{};
+
+    Frustum() = default;
+    explicit Frustum(const Mat4f& view_projection) { set(view_projection); }
+
+    void set(const Mat4f& m) {
+        for (int i = 0; i < 3; ++i) {
+            for (int side = 0; side < 2; ++side) {
+                float sign = side == 0 ? 1.0f : -1.0f;
+                Vec4f plane;
+                for (int col = 0; col < 4; ++col) {
+                    plane[col] = m(3, col) + sign * m(i, col);
+                }
+                float len = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+                if (len > 0.0f) {
+                    plane /= len;
+                }
+                planes[i * 2 + side] = plane;
+            }
+        }
+    }
+
+    [[nodiscard]] bool intersects(const BoundingSphere& sphere) const {
+        for (const auto& plane : planes) {
+            float distance = plane[0] * sphere.center[0] + plane[1] * sphere.center[1] + plane[2] * sphere.center[2] + plane[3];
+            if (distance < -sphere.radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool intersects(const AABB& box) const {
+        if (!box.valid()) {
+            return false;
+        }
+        for (const auto& plane : planes) {
+            // test the box corner furthest along the plane normal
+            float px = plane[0] >= 0.0f ? box.max[0] : box.min[0];
+            float py = plane[1] >= 0.0f ? box.max[1] : box.min[1];
+            float pz = plane[2] >= 0.0f ? box.max[2] : box.min[2];
+            if (plane[0] * px + plane[1] * py + plane[2] * pz + plane[3] < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // like intersects(AABB) but also reports boxes fully inside, so hierarchies can skip testing their children
+    [[nodiscard]] FrustumTest classify(const AABB& box) const {
+        if (!box.valid()) {
+            return FrustumTest::Outside;
+        }
+        FrustumTest result = FrustumTest::Inside;
+        for (const auto& plane : planes) {
+            float px = plane[0] >= 0.0f ? box.max[0] : box.min[0];
+            float py = plane[1] >= 0.0f ? box.max[1] : box.min[1];
+            float pz = plane[2] >= 0.0f ? box.max[2] : box.min[2];
+            if (plane[0] * px + plane[1] * py + plane[2] * pz + plane[3] < 0.0f) {
+                return FrustumTest::Outside;
+            }
+            float nx = plane[0] >= 0.0f ? box.min[0] : box.max[0];
+            float ny = plane[1] >= 0.0f ? box.min[1] : box.max[1];
+            float nz = plane[2] >= 0.0f ? box.min[2] : box.max[2];
+            if (plane[0] * nx + plane[1] * ny + plane[2] * nz + plane[3] < 0.0f) {
+                result = FrustumTest::Intersecting;
+            }
+        }
+        return result;
+    }
+};
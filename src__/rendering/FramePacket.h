@@ -0,0 +1,22 @@
+#pragma once
+
+#include "InstanceBuffer.h"
+#include "RenderSnapshot.h"
+#include "culling/FrustumCuller.h"
+#include "culling/VisibleInstances.h"
+
+// A snapshot together with what its CPU preparation (occlusion, culling, instance packing) hands to the submission
+// on the GL thread. A packet is written only while it is prepared and read only while it is submitted, so the next
+// frame can be prepared while this one is drawn.
+struct FramePacket {
+    // taken over from the snapshot the packet was prepared from
+    RenderSnapshot snapshot;
+    bool has_transparent_instances{false};
+
+    // indexed like the renderables, only meaningful when cpu_culled
+    bool cpu_culled{false};
+    VisibleInstanceLists visible_instances;
+    CullingStats culling_stats;
+
+    InstanceUpload instances;
+};
@@ -7,57 +7,120 @@
 #include "../logging/logging.h"
 
 namespace {
-constexpr std::size_t kMat4SizeBytes = sizeof(Mat4f);
+constexpr std::size_t kWordBytes = sizeof(std::uint32_t);
+// the buffer never starts smaller than this many instances
+constexpr std::size_t kInitialCapacity = 1024;
+// room a chunk reserves beyond its count, at least kMinSpare and half the count
+constexpr std::size_t kMinSpare = 8;
+// dirty ranges closer than this many instances are merged into one write, uploading the gap from the mirror
+constexpr std::size_t kMergeGap = 64;
+
+std::size_t reservation(std::size_t count) { return count + std::max(count / 2, kMinSpare); }
 }
 
 InstanceBuffer::InstanceBuffer() = default;
 
 void InstanceBuffer::sync(const RenderableList& renderables) {
-    logging::log(0,
-                 logging::DEBUG,
-                 "InstanceBuffer::sync begin for " + std::to_string(renderables.size()) + " renderables");
+    pack(renderables, sync_upload_);
+    upload(sync_upload_);
+}
+
+void InstanceBuffer::pack(const RenderableList& renderables, InstanceUpload& upload) {
+    upload.clear();
+    dirty_.clear();
+    changed_.clear();
+    full_ = false;
+    ++packs_;
+
+    InstanceFormat format = requested_format_;
+    bool encode_all = format != format_;
+    format_ = format;
+    words_per_instance_ = instance_words(format);
 
-    std::vector<Instances*> components;
-    components.reserve(renderables.size());
     for (const auto& renderable : renderables) {
-        auto* instances = renderable.instances;
-        if (!instances || instances->count() == 0) {
+        if (!renderable.transforms || renderable.instance_count == 0) {
             continue;
         }
-        components.push_back(instances);
+        auto& chunk = chunks_[renderable.entity];
+        if (chunk.pack == packs_) {
+            continue;
+        }
+        chunk.pack = packs_;
+        std::size_t count = std::min(renderable.instance_count, renderable.transforms->size());
+        bool moved = place(renderable.entity, chunk, count, upload);
+        // transforms are immutable, a component change always comes as a new array
+        if (moved || chunk.transforms != renderable.transforms) {
+            chunk.transforms = renderable.transforms;
+            changed_.push_back(&chunk);
+        }
     }
 
-    std::sort(components.begin(), components.end());
-    components.erase(std::unique(components.begin(), components.end()), components.end());
+    for (auto it = chunks_.begin(); it != chunks_.end();) {
+        if (it->second.pack == packs_) {
+            ++it;
+            continue;
+        }
+        allocator_.release(it->second.offset, it->second.reserved);
+        upload.released.push_back(it->first);
+        it = chunks_.erase(it);
+    }
 
-    bool needs_rebuild = layout_dirty_ || components.size() != chunks_.size();
-    if (!needs_rebuild) {
-        for (std::size_t i = 0; i < components.size(); ++i) {
-            if (chunks_[i].component != components[i]) {
-                needs_rebuild = true;
-                break;
-            }
-            if (components[i]->structure_dirty() || chunks_[i].count != components[i]->count()) {
-                needs_rebuild = true;
-                break;
-            }
+    if (format_ == InstanceFormat::Quantized && (encode_all || outside_grid())) {
+        fit_grid();
+        encode_all = true;
+    }
+    if (encode_all) {
+        mirror_.assign(allocator_.capacity() * words_per_instance_, 0u);
+        for (const auto& entry : chunks_) {
+            write(entry.second);
+        }
+        full_ = true;
+    } else {
+        for (const Chunk* chunk : changed_) {
+            write(*chunk);
         }
     }
 
-    if (needs_rebuild) {
+    coalesce(upload);
+    upload.capacity = allocator_.capacity();
+    upload.header = instance_header(format_, grid_);
+    upload.full = full_;
+    if (!upload.placed.empty() || !upload.released.empty() || !upload.ranges.empty()) {
         logging::log(0,
                      logging::DEBUG,
-                     "InstanceBuffer::sync rebuilding layout with " + std::to_string(components.size())
-                         + " components");
-        rebuild(components);
-    } else {
-        update_dirty_chunks();
-        if (layout_dirty_) {
-            logging::log(0,
-                         logging::DEBUG,
-                         "InstanceBuffer::sync detected structure change during dirty update; rebuilding");
-            rebuild(components);
-        }
+                     "InstanceBuffer::pack placed " + std::to_string(upload.placed.size()) + " released "
+                         + std::to_string(upload.released.size()) + " chunks, " + std::to_string(upload.ranges.size())
+                         + " ranges with " + std::to_string(upload.words.size() * kWordBytes) + " bytes");
+    }
+}
+
+void InstanceBuffer::upload(const InstanceUpload& upload) {
+    const std::size_t stride_bytes = upload.header.stride * 4 * kWordBytes;
+    const std::size_t byte_size = sizeof(InstanceHeader) + upload.capacity * stride_bytes;
+    bool reallocate = byte_size != allocated_bytes_;
+    if (reallocate) {
+        allocated_bytes_ = byte_size;
+        logging::log(0,
+                     logging::DEBUG,
+                     "InstanceBuffer::upload reallocating for " + std::to_string(upload.capacity) + " instances ("
+                         + std::to_string(byte_size) + " bytes)");
+        buffer_.update_data(static_cast<GLsizeiptr>(byte_size), nullptr, static_cast<GLenum>(GL_DYNAMIC_DRAW));
+    }
+    if (reallocate || upload.full) {
+        buffer_.update_data(static_cast<GLsizeiptr>(sizeof(InstanceHeader)), &upload.header, 0, GL_DYNAMIC_DRAW);
+    }
+    total_instances_ = upload.capacity;
+    for (ecs::ID entity : upload.released) {
+        chunk_lookup_.erase(entity);
+    }
+    for (const auto& placed : upload.placed) {
+        chunk_lookup_[placed.first] = placed.second;
+    }
+
+    for (const auto& range : upload.ranges) {
+        const auto byte_offset = static_cast<GLintptr>(sizeof(InstanceHeader) + range.offset * stride_bytes);
+        const auto range_bytes = static_cast<GLsizeiptr>(range.count * stride_bytes);
+        buffer_.update_data(range_bytes, upload.words.data() + range.source, byte_offset, GL_DYNAMIC_DRAW);
     }
 }
 
@@ -65,104 +128,127 @@ void InstanceBuffer::bind(GLuint binding_point) {
     buffer_.bind(binding_point);
 }
 
-std::optional<std::size_t> InstanceBuffer::base_instance(const Instances* component) const {
-    if (!component) {
-        return std::nullopt;
-    }
-    auto it = chunk_lookup_.find(component);
+std::optional<std::size_t> InstanceBuffer::base_instance(ecs::ID entity) const {
+    auto it = chunk_lookup_.find(entity);
     if (it == chunk_lookup_.end()) {
         logging::log(0,
                      logging::DEBUG,
-                     "InstanceBuffer::base_instance missing chunk for component "
-                         + std::to_string(reinterpret_cast<std::uintptr_t>(component)));
+                     "InstanceBuffer::base_instance missing chunk for entity " + std::to_string(entity));
         return std::nullopt;
     }
-    const auto& chunk = chunks_[it->second];
-    return chunk.offset;
+    return it->second;
 }
 
-void InstanceBuffer::rebuild(const std::vector<Instances*>& components) {
-    chunks_.clear();
-    chunk_lookup_.clear();
-    staging_.clear();
-    total_instances_ = 0;
-
-    chunks_.reserve(components.size());
-    for (auto* component : components) {
-        if (!component) {
-            continue;
-        }
-        std::size_t count = component->count();
-        if (count == 0) {
-            continue;
-        }
-        Chunk chunk;
-        chunk.component = component;
-        chunk.offset = total_instances_;
+bool InstanceBuffer::place(ecs::ID entity, Chunk& chunk, std::size_t count, InstanceUpload& upload) {
+    // shrinking far below the reservation gives the room back, everything else stays in place
+    bool fits = count <= chunk.reserved && (count * 4 >= chunk.reserved || chunk.reserved <= reservation(0));
+    if (fits) {
         chunk.count = count;
-        logging::log(0,
-                     logging::DEBUG,
-                     "InstanceBuffer::rebuild chunk component="
-                         + std::to_string(reinterpret_cast<std::uintptr_t>(component)) + " offset="
-                         + std::to_string(chunk.offset) + " count=" + std::to_string(chunk.count));
-        chunks_.push_back(chunk);
-        chunk_lookup_[component] = chunks_.size() - 1;
-        total_instances_ += count;
+        return false;
     }
-
-    staging_.resize(total_instances_);
-    for (auto& chunk : chunks_) {
-        if (chunk.count == 0 || !chunk.component) {
-            continue;
-        }
-        std::memcpy(staging_.data() + chunk.offset,
-                    chunk.component->data(),
-                    chunk.count * kMat4SizeBytes);
-        chunk.component->clear_dirty_flags();
+    if (chunk.reserved > 0) {
+        allocator_.release(chunk.offset, chunk.reserved);
+    }
+    std::size_t reserved = reservation(count);
+    auto offset = allocator_.allocate(reserved);
+    if (!offset) {
+        grow(reserved);
+        offset = allocator_.allocate(reserved);
     }
+    chunk.offset = *offset;
+    chunk.count = count;
+    chunk.reserved = reserved;
+    upload.placed.emplace_back(entity, chunk.offset);
+    return true;
+}
 
-    GLsizeiptr byte_size = static_cast<GLsizeiptr>(staging_.size() * kMat4SizeBytes);
+void InstanceBuffer::grow(std::size_t required) {
+    std::size_t capacity = allocator_.capacity();
+    std::size_t new_capacity = std::max({capacity * 2, capacity + required, kInitialCapacity});
     logging::log(0,
                  logging::DEBUG,
-                 "InstanceBuffer::rebuild uploading " + std::to_string(staging_.size())
-                     + " matrices (" + std::to_string(byte_size) + " bytes)");
-    if (byte_size > 0) {
-        buffer_.update_data(byte_size, staging_.data(), static_cast<GLenum>(GL_DYNAMIC_DRAW));
-    } else {
-        buffer_.update_data(static_cast<GLsizeiptr>(sizeof(Mat4f)), nullptr, static_cast<GLenum>(GL_DYNAMIC_DRAW));
-    }
+                 "InstanceBuffer::grow from " + std::to_string(capacity) + " to " + std::to_string(new_capacity)
+                     + " instances");
+    allocator_.grow(new_capacity);
+    mirror_.resize(new_capacity * words_per_instance_);
+    full_ = true;
+}
 
-    layout_dirty_ = false;
+void InstanceBuffer::write(const Chunk& chunk) {
+    encode_instances(format_, grid_, chunk.transforms->data(), chunk.count,
+                     mirror_.data() + chunk.offset * words_per_instance_);
+    dirty_.emplace_back(chunk.offset, chunk.count);
 }
 
-void InstanceBuffer::update_dirty_chunks() {
-    for (auto& chunk : chunks_) {
-        auto* component = chunk.component;
-        if (!component || !component->dirty()) {
-            continue;
-        }
-        if (component->structure_dirty() || component->count() != chunk.count) {
-            layout_dirty_ = true;
-            break;
-        }
-        if (chunk.count == 0) {
-            component->clear_dirty_flags();
-            continue;
+bool InstanceBuffer::outside_grid() const {
+    for (const Chunk* chunk : changed_) {
+        for (std::size_t i = 0; i < chunk->count; ++i) {
+            const Mat4f& matrix = (*chunk->transforms)[i];
+            if (!grid_.contains(Vec3f{matrix(0, 3), matrix(1, 3), matrix(2, 3)})) {
+                return true;
+            }
         }
+    }
+    return false;
+}
 
-        logging::log(0,
-                     logging::DEBUG,
-                     "InstanceBuffer::update_dirty chunk offset=" + std::to_string(chunk.offset)
-                         + " count=" + std::to_string(chunk.count));
-        std::memcpy(staging_.data() + chunk.offset,
-                    component->data(),
-                    chunk.count * kMat4SizeBytes);
+void InstanceBuffer::fit_grid() {
+    Vec3f min{0.0f, 0.0f, 0.0f};
+    Vec3f max{0.0f, 0.0f, 0.0f};
+    bool empty = true;
+    for (const auto& entry : chunks_) {
+        const Chunk& chunk = entry.second;
+        for (std::size_t i = 0; i < chunk.count; ++i) {
+            const Mat4f& matrix = (*chunk.transforms)[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                float value = matrix(axis, 3);
+                min[axis] = empty ? value : std::min(min[axis], value);
+                max[axis] = empty ? value : std::max(max[axis], value);
+            }
+            empty = false;
+        }
+    }
+    grid_ = InstanceQuantization::around(min, max);
+    logging::log(0,
+                 logging::DEBUG,
+                 "InstanceBuffer::fit_grid step " + std::to_string(grid_.step[0]) + " " + std::to_string(grid_.step[1])
+                     + " " + std::to_string(grid_.step[2]));
+}
 
-        const auto byte_offset = static_cast<GLintptr>(chunk.offset * kMat4SizeBytes);
-        const auto byte_size = static_cast<GLsizeiptr>(chunk.count * kMat4SizeBytes);
-        buffer_.update_data(byte_size, component->data(), byte_offset, GL_DYNAMIC_DRAW);
-        component->clear_dirty_flags();
+void InstanceBuffer::coalesce(InstanceUpload& upload) {
+    auto emit = [&](std::size_t offset, std::size_t count) {
+        InstanceUpload::Range range;
+        range.offset = offset;
+        range.count = count;
+        range.source = upload.words.size();
+        upload.ranges.push_back(range);
+        upload.words.insert(upload.words.end(),
+                            mirror_.begin() + static_cast<std::ptrdiff_t>(offset * words_per_instance_),
+                            mirror_.begin() + static_cast<std::ptrdiff_t>((offset + count) * words_per_instance_));
+    };
+
+    // a reallocated buffer starts empty, so all of it comes from the mirror
+    if (full_) {
+        if (allocator_.capacity() > 0) {
+            emit(0, allocator_.capacity());
+        }
+        return;
+    }
+    if (dirty_.empty()) {
+        return;
     }
 
-    // Keep staging copy coherent for CPU introspection when no rebuild occurs.
+    std::sort(dirty_.begin(), dirty_.end());
+    std::size_t begin = dirty_.front().first;
+    std::size_t end = begin + dirty_.front().second;
+    for (std::size_t i = 1; i < dirty_.size(); ++i) {
+        if (dirty_[i].first <= end + kMergeGap) {
+            end = std::max(end, dirty_[i].first + dirty_[i].second);
+            continue;
+        }
+        emit(begin, end - begin);
+        begin = dirty_[i].first;
+        end = begin + dirty_[i].second;
+    }
+    emit(begin, end - begin);
 }
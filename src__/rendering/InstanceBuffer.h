@@ -1,37 +1,115 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <ecs.h>
+
+#include "InstanceFormat.h"
 #include "RenderScene.h"
+#include "../core/range_allocator.h"
 #include "../gldata/ssbo_data.h"
 
+// CPU side of one sync: layout changes and the coalesced ranges of instances that changed since the previous pack.
+// Packed while a frame is prepared and uploaded on the GL thread, so the next frame can be packed while this one is
+// drawn. Uploads have to be applied in the order they were packed.
+struct InstanceUpload {
+    struct Range {
+        std::size_t offset{0};
+        std::size_t count{0};
+        // first word of the range in words
+        std::size_t source{0};
+    };
+
+    // instances the buffer holds after this upload, a change reallocates it
+    std::size_t capacity{0};
+    InstanceHeader header;
+    // every instance was encoded again or the buffer grew, the single range covers all of it
+    bool full{false};
+    // chunks placed or moved since the previous pack, and entities whose chunk was released
+    std::vector<std::pair<ecs::ID, std::size_t>> placed;
+    std::vector<ecs::ID> released;
+    std::vector<Range> ranges;
+    // encoded instances, header.stride * 4 words each
+    std::vector<std::uint32_t> words;
+
+    void clear() {
+        full = false;
+        placed.clear();
+        released.clear();
+        ranges.clear();
+        words.clear();
+    }
+};
+
+// Instance transforms of all renderables in one SSBO, encoded in the selected InstanceFormat behind an
+// InstanceHeader. Every entity owns a chunk reserved with spare room by a range allocator, so instances added to or
+// removed from one entity only touch its chunk; a chunk only moves when it outgrows its reservation and the buffer
+// only grows (doubling) when no free range fits.
 class InstanceBuffer {
   public:
     InstanceBuffer();
 
+    // pack and upload in one step
     void sync(const RenderableList& renderables);
+    // only touches the packing state, may run on another thread than upload and bind. Chunks whose transforms were
+    // replaced since the previous pack are uploaded again.
+    void pack(const RenderableList& renderables, InstanceUpload& upload);
+    void upload(const InstanceUpload& upload);
     void bind(GLuint binding_point);
 
-    std::optional<std::size_t> base_instance(const Instances* component) const;
+    // picked up by the next pack, which encodes every instance again
+    void set_format(InstanceFormat format) { requested_format_ = format; }
+    InstanceFormat format() const { return requested_format_; }
+
+    // layout of the last upload
+    std::optional<std::size_t> base_instance(ecs::ID entity) const;
+    // capacity of the buffer, chunks are spread over it with gaps in between
     std::size_t total_instances() const { return total_instances_; }
 
   private:
     struct Chunk {
-        Instances* component{nullptr};
+        InstanceTransforms transforms;
         std::size_t offset{0};
         std::size_t count{0};
+        std::size_t reserved{0};
+        std::uint64_t pack{0};
     };
 
-    void rebuild(const std::vector<Instances*>& components);
-    void update_dirty_chunks();
+    // reserves the chunk for count instances, growing the buffer if needed; false when it kept its place
+    bool place(ecs::ID entity, Chunk& chunk, std::size_t count, InstanceUpload& upload);
+    void grow(std::size_t required);
+    void write(const Chunk& chunk);
+    // true when a changed chunk left the quantization grid
+    bool outside_grid() const;
+    void fit_grid();
+    void coalesce(InstanceUpload& upload);
+
+    // packing state
+    std::unordered_map<ecs::ID, Chunk> chunks_;
+    RangeAllocator allocator_;
+    std::atomic<InstanceFormat> requested_format_{InstanceFormat::Matrix};
+    InstanceFormat format_{InstanceFormat::Matrix};
+    std::size_t words_per_instance_{instance_words(InstanceFormat::Matrix)};
+    InstanceQuantization grid_;
+    // encoded copy of the whole buffer, the source of every upload so that merged ranges can span the gaps
+    std::vector<std::uint32_t> mirror_;
+    // chunks whose transforms changed or that moved in the current pack
+    std::vector<const Chunk*> changed_;
+    // written ranges of the current pack as (offset, count)
+    std::vector<std::pair<std::size_t, std::size_t>> dirty_;
+    bool full_{false};
+    std::uint64_t packs_{0};
+    InstanceUpload sync_upload_;
 
+    // uploaded state
     SSBOData buffer_;
-    std::vector<Mat4f> staging_;
-    std::vector<Chunk> chunks_;
-    std::unordered_map<const Instances*, std::size_t> chunk_lookup_;
+    std::unordered_map<ecs::ID, std::size_t> chunk_lookup_;
     std::size_t total_instances_{0};
-    bool layout_dirty_{true};
+    std::size_t allocated_bytes_{0};
 };
@@ -0,0 +1,202 @@
+#include "InstanceFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+constexpr float kRotationRange = 0.70710678f;
+
+std::uint32_t float_bits(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// round to nearest, tiny values flush to zero and huge ones clamp to the largest finite half
+std::uint32_t half_bits(float value) {
+    std::uint32_t bits = float_bits(value);
+    std::uint32_t sign = (bits >> 16u) & 0x8000u;
+    int exponent = static_cast<int>((bits >> 23u) & 0xFFu) - 127 + 15;
+    std::uint32_t mantissa = bits & 0x7FFFFFu;
+    if (exponent <= 0) {
+        return sign;
+    }
+    if (exponent >= 31) {
+        return sign | 0x7BFFu;
+    }
+    std::uint32_t half = sign | (static_cast<std::uint32_t>(exponent) << 10u) | (mantissa >> 13u);
+    if (mantissa & 0x1000u) {
+        ++half;
+    }
+    return std::min(half & 0x7FFFu, 0x7BFFu) | sign;
+}
+
+struct Decomposed {
+    Vec3f position{0.0f, 0.0f, 0.0f};
+    float scale{1.0f};
+    // x, y, z, w
+    float rotation[4]{0.0f, 0.0f, 0.0f, 1.0f};
+};
+
+Decomposed decompose(const Mat4f& m) {
+    Decomposed result;
+    result.position = Vec3f{m(0, 3), m(1, 3), m(2, 3)};
+    float lengths[3];
+    for (int col = 0; col < 3; ++col) {
+        lengths[col] = std::sqrt(m(0, col) * m(0, col) + m(1, col) * m(1, col) + m(2, col) * m(2, col));
+    }
+    result.scale = (lengths[0] + lengths[1] + lengths[2]) / 3.0f;
+    if (lengths[0] <= 0.0f || lengths[1] <= 0.0f || lengths[2] <= 0.0f) {
+        return result;
+    }
+
+    auto r = [&](int row, int col) { return m(row, col) / lengths[col]; };
+    float* q = result.rotation;
+    float trace = r(0, 0) + r(1, 1) + r(2, 2);
+    if (trace > 0.0f) {
+        float s = std::sqrt(trace + 1.0f) * 2.0f;
+        q[3] = 0.25f * s;
+        q[0] = (r(2, 1) - r(1, 2)) / s;
+        q[1] = (r(0, 2) - r(2, 0)) / s;
+        q[2] = (r(1, 0) - r(0, 1)) / s;
+    } else if (r(0, 0) > r(1, 1) && r(0, 0) > r(2, 2)) {
+        float s = std::sqrt(1.0f + r(0, 0) - r(1, 1) - r(2, 2)) * 2.0f;
+        q[3] = (r(2, 1) - r(1, 2)) / s;
+        q[0] = 0.25f * s;
+        q[1] = (r(0, 1) + r(1, 0)) / s;
+        q[2] = (r(0, 2) + r(2, 0)) / s;
+    } else if (r(1, 1) > r(2, 2)) {
+        float s = std::sqrt(1.0f + r(1, 1) - r(0, 0) - r(2, 2)) * 2.0f;
+        q[3] = (r(0, 2) - r(2, 0)) / s;
+        q[0] = (r(0, 1) + r(1, 0)) / s;
+        q[1] = 0.25f * s;
+        q[2] = (r(1, 2) + r(2, 1)) / s;
+    } else {
+        float s = std::sqrt(1.0f + r(2, 2) - r(0, 0) - r(1, 1)) * 2.0f;
+        q[3] = (r(1, 0) - r(0, 1)) / s;
+        q[0] = (r(0, 2) + r(2, 0)) / s;
+        q[1] = (r(1, 2) + r(2, 1)) / s;
+        q[2] = 0.25f * s;
+    }
+    float norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int i = 0; i < 4; ++i) {
+        q[i] /= norm;
+    }
+    return result;
+}
+
+// smallest three: q and -q are the same rotation, so the largest component is made positive and rebuilt
+std::uint32_t pack_rotation(const float* q) {
+    std::uint32_t largest = 0;
+    for (std::uint32_t i = 1; i < 4; ++i) {
+        if (std::fabs(q[i]) > std::fabs(q[largest])) {
+            largest = i;
+        }
+    }
+    float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+    std::uint32_t packed = largest << 30u;
+    std::uint32_t shift = 20;
+    for (std::uint32_t i = 0; i < 4; ++i) {
+        if (i == largest) {
+            continue;
+        }
+        float unorm = (sign * q[i] / kRotationRange) * 0.5f + 0.5f;
+        auto value = static_cast<std::uint32_t>(std::lround(std::clamp(unorm, 0.0f, 1.0f) * 1023.0f));
+        packed |= value << shift;
+        shift -= 10;
+    }
+    return packed;
+}
+
+std::uint32_t quantize(float value, float origin, float step) {
+    float cell = std::round((value - origin) / step);
+    return static_cast<std::uint32_t>(std::clamp(cell, 0.0f, static_cast<float>(InstanceQuantization::kCells)));
+}
+}
+
+InstanceQuantization InstanceQuantization::around(const Vec3f& min, const Vec3f& max) {
+    InstanceQuantization quantization;
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = max[axis] - min[axis];
+        float padding = std::max(extent * 0.5f, 1.0f);
+        quantization.origin[axis] = min[axis] - padding;
+        quantization.step[axis] = (extent + 2.0f * padding) / static_cast<float>(kCells);
+    }
+    return quantization;
+}
+
+bool InstanceQuantization::contains(const Vec3f& position) const {
+    for (int axis = 0; axis < 3; ++axis) {
+        float end = origin[axis] + step[axis] * static_cast<float>(kCells);
+        if (!(position[axis] >= origin[axis] && position[axis] <= end)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t instance_words(InstanceFormat format) {
+    switch (format) {
+    case InstanceFormat::Affine:
+        return 12;
+    case InstanceFormat::PositionRotationScale:
+        return 8;
+    case InstanceFormat::Quantized:
+        return 4;
+    case InstanceFormat::Matrix:
+    default:
+        return 16;
+    }
+}
+
+InstanceHeader instance_header(InstanceFormat format, const InstanceQuantization& quantization) {
+    InstanceHeader header;
+    header.format = static_cast<std::uint32_t>(format);
+    header.stride = static_cast<std::uint32_t>(instance_words(format) / 4);
+    for (int axis = 0; axis < 3; ++axis) {
+        header.origin[axis] = quantization.origin[axis];
+        header.step[axis] = quantization.step[axis];
+    }
+    return header;
+}
+
+void encode_instances(InstanceFormat format, const InstanceQuantization& quantization, const Mat4f* matrices,
+                      std::size_t count, std::uint32_t* out) {
+    switch (format) {
+    case InstanceFormat::Matrix:
+        std::memcpy(out, matrices, count * sizeof(Mat4f));
+        return;
+    case InstanceFormat::Affine:
+        for (std::size_t i = 0; i < count; ++i) {
+            std::memcpy(out + i * 12, matrices[i].value_ptr(), 12 * sizeof(float));
+        }
+        return;
+    case InstanceFormat::PositionRotationScale:
+        for (std::size_t i = 0; i < count; ++i) {
+            Decomposed instance = decompose(matrices[i]);
+            std::uint32_t* words = out + i * 8;
+            for (int axis = 0; axis < 3; ++axis) {
+                words[axis] = float_bits(instance.position[axis]);
+            }
+            words[3] = float_bits(instance.scale);
+            for (int component = 0; component < 4; ++component) {
+                words[4 + component] = float_bits(instance.rotation[component]);
+            }
+        }
+        return;
+    case InstanceFormat::Quantized:
+        for (std::size_t i = 0; i < count; ++i) {
+            Decomposed instance = decompose(matrices[i]);
+            std::uint32_t x = quantize(instance.position[0], quantization.origin[0], quantization.step[0]);
+            std::uint32_t y = quantize(instance.position[1], quantization.origin[1], quantization.step[1]);
+            std::uint32_t z = quantize(instance.position[2], quantization.origin[2], quantization.step[2]);
+            std::uint32_t* words = out + i * 4;
+            words[0] = x | (y << 21u);
+            words[1] = (y >> 11u) | (z << 10u);
+            words[2] = pack_rotation(instance.rotation);
+            words[3] = half_bits(instance.scale);
+        }
+        return;
+    }
+}
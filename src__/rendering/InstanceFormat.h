@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../math/mat.h"
+
+// Layout of one instance in the instance SSBO, decoded by instance_model in shader/instance.glsl. The compact
+// formats drop the constant bottom row; the last two only keep rotation and a uniform scale (the mean of the axis
+// lengths), so shear, non-uniform scale and mirroring are lost.
+enum class InstanceFormat : std::uint32_t {
+    // 64 bytes, the full matrix
+    Matrix = 0,
+    // 48 bytes, the top three rows
+    Affine = 1,
+    // 32 bytes, float position and scale, float quaternion
+    PositionRotationScale = 2,
+    // 16 bytes, 21 bit position on a grid over the scene, 32 bit quaternion, half float scale
+    Quantized = 3,
+};
+
+// grid of the quantized positions, position = origin + step * cell
+struct InstanceQuantization {
+    Vec3f origin{0.0f, 0.0f, 0.0f};
+    Vec3f step{1.0f, 1.0f, 1.0f};
+
+    static constexpr std::uint32_t kCells = (1u << 21u) - 1u;
+
+    // grid covering the box with room to grow
+    static InstanceQuantization around(const Vec3f& min, const Vec3f& max);
+    [[nodiscard]] bool contains(const Vec3f& position) const;
+};
+
+// std430 header in front of the instances, mirrors the InstanceBuffer block in shader/instance.glsl
+struct InstanceHeader {
+    std::uint32_t format{0};
+    // 16 byte words per instance
+    std::uint32_t stride{0};
+    std::uint32_t padding[2]{0, 0};
+    float origin[4]{0.0f, 0.0f, 0.0f, 0.0f};
+    float step[4]{1.0f, 1.0f, 1.0f, 0.0f};
+};
+static_assert(sizeof(InstanceHeader) == 48, "InstanceHeader must match the std430 layout of the shader block");
+
+// 32 bit words per instance
+std::size_t instance_words(InstanceFormat format);
+InstanceHeader instance_header(InstanceFormat format, const InstanceQuantization& quantization);
+// writes count instances of instance_words(format) words each
+void encode_instances(InstanceFormat format, const InstanceQuantization& quantization, const Mat4f* matrices,
+                      std::size_t count, std::uint32_t* out);
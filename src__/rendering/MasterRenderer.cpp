@@ -1,7 +1,12 @@
 #include "MasterRenderer.h"
 
 #include <chrono>
+#include <exception>
 #include <filesystem>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
 #include <glad/glad.h>
 #define GLFW_INCLUDE_NONE
@@ -12,7 +17,53 @@
 #include "../camera/perspective_camera.h"
 #include "../logging/logging.h"
 
-MasterRenderer::MasterRenderer() = default;
+namespace {
+RenderTextureDesc target_desc(int width, int height, GLint internal_format, GLenum format, GLenum type) {
+    RenderTextureDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.internal_format = internal_format;
+    desc.format = format;
+    desc.type = type;
+    return desc;
+}
+
+template<typename Light>
+void snapshot_lights(ecs::ECS& ecs, std::vector<LightSnapshot<Light>>& snapshots) {
+    snapshots.clear();
+    for (auto& entity : ecs.each<Light>()) {
+        auto* light = entity.template get<Light>();
+        auto* transform = entity.template get<Transformation>();
+        auto* visible = entity.template get<Visible>();
+        if (!light || !transform || (visible && !visible->enabled) || !light->enabled) {
+            continue;
+        }
+        LightSnapshot<Light> snapshot;
+        snapshot.entity = light->component_id.id;
+        snapshot.light = *light;
+        snapshot.transform = Transformation::from_matrix(transform->global_matrix());
+        snapshots.push_back(snapshot);
+    }
+}
+
+// spins briefly, then sleeps between polls, for the hand over between the simulation and the render thread
+template<typename Ready>
+void wait_until(Ready&& ready) {
+    for (int spin = 0; !ready(); ++spin) {
+        if (spin < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+} // namespace
+
+MasterRenderer::MasterRenderer()
+    : worker_pool_(std::make_unique<WorkerPool>()), frustum_culler_(std::make_unique<FrustumCuller>(worker_pool_.get())),
+      occlusion_rasterizer_(std::make_unique<OcclusionRasterizer>(worker_pool_.get())) {
+    frustum_culler_->set_occlusion(occlusion_rasterizer_.get());
+}
 
 MasterRenderer::~MasterRenderer() { shutdown(); }
 
@@ -66,6 +117,14 @@ bool MasterRenderer::initialize(int width, int height, const std::string& title)
     shadow_renderer_ = std::make_unique<ShadowRenderer>();
     transparent_renderer_ = std::make_unique<TransparentRenderer>();
     oit_renderer_ = std::make_unique<OITRenderer>();
+    deferred_renderer_ = std::make_unique<DeferredRenderer>();
+    visibility_renderer_ = std::make_unique<VisibilityRenderer>();
+    gpu_culler_ = std::make_unique<GpuCuller>();
+    hiz_buffer_ = std::make_unique<HiZBuffer>();
+    vertex_pool_ = std::make_unique<VertexPool>();
+    shadow_atlas_ = std::make_unique<ShadowAtlas>();
+    shadow_scheduler_ = std::make_unique<ShadowScheduler>();
+    light_clusters_ = std::make_unique<LightClusters>(worker_pool_.get());
 
     if (!lit_renderer_->init(shader_dir)) {
         logging::log(0, logging::ERROR, "Failed to initialize lit renderer");
@@ -79,10 +138,44 @@ bool MasterRenderer::initialize(int width, int height, const std::string& title)
         logging::log(0, logging::ERROR, "Failed to initialize transparent renderer");
         return false;
     }
-    if (!oit_renderer_->initialize(shader_dir, viewport_width_, viewport_height_)) {
+    if (!oit_renderer_->initialize(shader_dir)) {
         logging::log(0, logging::ERROR, "Failed to initialize OIT renderer");
         return false;
     }
+    if (!deferred_renderer_->init(shader_dir)) {
+        logging::log(0, logging::WARNING, "Failed to initialize deferred renderer, shading stays forward");
+        deferred_renderer_.reset();
+    }
+    if (!visibility_renderer_->init(shader_dir)) {
+        logging::log(0, logging::WARNING, "Failed to initialize visibility renderer, shading stays forward");
+        visibility_renderer_.reset();
+    }
+    if (!gpu_culler_->init(shader_dir)) {
+        logging::log(0, logging::WARNING, "Failed to initialize GPU culling, falling back to unculled draws");
+        gpu_culler_->set_enabled(false);
+    }
+    if (!hiz_buffer_->init(shader_dir)) {
+        logging::log(0, logging::WARNING, "Failed to initialize Hi-Z pyramid, occlusion culling disabled");
+        gpu_culler_->set_occlusion_enabled(false);
+    }
+    lit_renderer_->set_gpu_culler(gpu_culler_.get());
+    shadow_renderer_->set_gpu_culler(gpu_culler_.get());
+    shadow_renderer_->set_shadow_atlas(shadow_atlas_.get());
+    lit_renderer_->set_shadow_atlas(shadow_atlas_.get());
+    transparent_renderer_->set_shadow_atlas(shadow_atlas_.get());
+    lit_renderer_->set_light_clusters(light_clusters_.get());
+    transparent_renderer_->set_light_clusters(light_clusters_.get());
+    if (deferred_renderer_) {
+        deferred_renderer_->set_shadow_atlas(shadow_atlas_.get());
+        deferred_renderer_->set_light_clusters(light_clusters_.get());
+    }
+    if (visibility_renderer_) {
+        visibility_renderer_->set_shadow_atlas(shadow_atlas_.get());
+        visibility_renderer_->set_light_clusters(light_clusters_.get());
+        lit_renderer_->set_visibility_geometry(&visibility_renderer_->geometry());
+    }
+    lit_renderer_->set_frustum_culler(frustum_culler_.get());
+    transparent_renderer_->set_frustum_culler(frustum_culler_.get());
 
     ecs_.create_system<CameraControllerSystem>(window_);
 
@@ -101,97 +194,355 @@ void MasterRenderer::shutdown() {
 
 void MasterRenderer::set_active_camera(ecs::EntityID camera_id) { active_camera_ = camera_id; }
 
+void MasterRenderer::set_gpu_culling(bool enabled) {
+    if (gpu_culler_) {
+        gpu_culler_->set_enabled(enabled);
+    }
+}
+
+void MasterRenderer::set_cpu_culling(bool enabled) { frustum_culler_->set_enabled(enabled); }
+
+void MasterRenderer::set_occlusion_culling(bool enabled) {
+    if (gpu_culler_) {
+        gpu_culler_->set_occlusion_enabled(enabled);
+    }
+}
+
+void MasterRenderer::set_software_occlusion(bool enabled) { occlusion_rasterizer_->set_enabled(enabled); }
+
+void MasterRenderer::set_shadow_filter(ShadowFilter filter) {
+    if (shadow_atlas_) {
+        shadow_atlas_->set_filter(filter);
+    }
+}
+
+void MasterRenderer::set_depth_prepass(DepthPrepassMode mode) {
+    if (lit_renderer_) {
+        lit_renderer_->set_depth_prepass(mode);
+    }
+}
+
+void MasterRenderer::set_vertex_pulling(bool enabled) {
+    if (lit_renderer_) {
+        lit_renderer_->set_vertex_pool(enabled ? vertex_pool_.get() : nullptr);
+    }
+}
+
+void MasterRenderer::set_shadow_budget_ms(float budget_ms) {
+    if (shadow_scheduler_) {
+        shadow_scheduler_->set_budget_ms(budget_ms);
+    }
+}
+
 void MasterRenderer::run() {
+    if (render_thread_) {
+        run_threaded();
+        return;
+    }
+
+    // the snapshot is taken over by the packet before the next one is extracted, so one is enough here
+    snapshots_.clear();
+    snapshots_.push_back(std::make_unique<RenderSnapshot>());
+    packets_.clear();
+    for (int i = 0; i < 2; ++i) {
+        packets_.push_back(std::make_unique<FramePacket>());
+    }
+    auto& snapshot = *snapshots_[0];
     auto last_frame = std::chrono::steady_clock::now();
+    // nothing to overlap the first packet with
+    update_viewport(snapshot);
+    extract_frame(snapshot);
+    begin_preparation(*packets_[0], snapshot);
+    finish_preparation();
 
+    std::size_t packet_index = 0;
     while (window_ && !glfwWindowShouldClose(window_)) {
         auto now = std::chrono::steady_clock::now();
         float delta_seconds = std::chrono::duration<float>(now - last_frame).count();
         last_frame = now;
 
-        int fb_width = viewport_width_;
-        int fb_height = viewport_height_;
-        glfwGetFramebufferSize(window_, &fb_width, &fb_height);
-        if (fb_width != viewport_width_ || fb_height != viewport_height_) {
-            viewport_width_ = fb_width;
-            viewport_height_ = fb_height;
-            oit_renderer_->resize(viewport_width_, viewport_height_);
-        }
+        update_viewport(snapshot);
+        extract_frame(snapshot);
+        begin_preparation(*packets_[1 - packet_index], snapshot);
 
-        glClearColor(0.1f, 0.15f, 0.2f, 1.0f);
-
-        Mat4f view_matrix = Mat4f::eye();
-        Mat4f projection_matrix = Mat4f::eye();
-        Vec3f camera_position{0.0f, 0.0f, 0.0f};
-        bool camera_valid = false;
-        if (active_camera_.id != ecs::INVALID_ID) {
-            auto& entity = ecs_[active_camera_.id];
-            if (auto* transform = entity.get<Transformation>()) {
-                view_matrix = transform->global_matrix().inverse();
-                camera_position = transform->global_position();
-                camera_valid = true;
-            }
+        submit_frame(*packets_[packet_index]);
+        glfwSwapBuffers(window_);
+        glfwPollEvents();
+        // the preparation only reads the snapshot, so the systems run alongside it
+        ecs_.process(delta_seconds);
+        finish_preparation();
+        packet_index = 1 - packet_index;
+    }
+}
+
+void MasterRenderer::run_threaded() {
+    snapshots_.clear();
+    // either queue can hold every snapshot, a snapshot is freed before its frame is submitted and the simulation may
+    // extract all of them meanwhile
+    free_snapshots_ = std::make_unique<SpscQueue<RenderSnapshot*>>(max_frames_in_flight_ + 1);
+    ready_snapshots_ = std::make_unique<SpscQueue<RenderSnapshot*>>(max_frames_in_flight_ + 1);
+    // one snapshot is extracted while the others wait in the queue or are prepared
+    for (int i = 0; i <= max_frames_in_flight_; ++i) {
+        snapshots_.push_back(std::make_unique<RenderSnapshot>());
+        free_snapshots_->try_push(snapshots_.back().get());
+    }
+    packets_.clear();
+    packets_.push_back(std::make_unique<FramePacket>());
 
-            if (auto* perspective = entity.get<PerspectiveCamera>()) {
-                projection_matrix = perspective->projection_matrix();
-            } else if (auto* orthographic = entity.get<OrthographicCamera>()) {
-                projection_matrix = orthographic->projection_matrix();
-            } else {
-                logging::log(0, logging::WARNING,
-                             "MasterRenderer: active camera lacks a projection component (entity " +
-                                 std::to_string(active_camera_.id) + ")");
+    render_thread_done_ = false;
+    render_thread_error_ = nullptr;
+    glfwMakeContextCurrent(nullptr);
+    std::thread render_thread(&MasterRenderer::render_loop, this);
+    logging::log(0, logging::INFO,
+                 "MasterRenderer: rendering on a separate thread, " + std::to_string(max_frames_in_flight_) +
+                     " frames in flight");
+
+    std::exception_ptr simulation_error;
+    try {
+        auto last_frame = std::chrono::steady_clock::now();
+        while (window_ && !glfwWindowShouldClose(window_) && !render_thread_done_.load()) {
+            auto now = std::chrono::steady_clock::now();
+            float delta_seconds = std::chrono::duration<float>(now - last_frame).count();
+            last_frame = now;
+
+            glfwPollEvents();
+            ecs_.process(delta_seconds);
+
+            // no free snapshot blocks the simulation, which bounds the latency to max_frames_in_flight
+            RenderSnapshot* snapshot = nullptr;
+            wait_until([&]() { return free_snapshots_->try_pop(snapshot) || render_thread_done_.load(); });
+            if (!snapshot) {
+                break;
             }
+            update_viewport(*snapshot);
+            extract_frame(*snapshot);
+            // never drop an extracted snapshot, its static_changes are only reported once
+            wait_until([&]() { return ready_snapshots_->try_push(snapshot) || render_thread_done_.load(); });
         }
+    } catch (...) {
+        simulation_error = std::current_exception();
+    }
 
-        if (!camera_valid) {
-            logging::log(0, logging::WARNING,
-                         "MasterRenderer: active camera invalid (entity " + std::to_string(active_camera_.id) + ")");
-        } else {
-            logging::log(0, logging::DEBUG,
-                         "MasterRenderer: using active camera entity " + std::to_string(active_camera_.id));
-        }
+    simulation_done_ = true;
+    render_thread.join();
+    simulation_done_ = false;
+    glfwMakeContextCurrent(window_);
+    if (simulation_error) {
+        std::rethrow_exception(simulation_error);
+    }
+    if (render_thread_error_) {
+        std::rethrow_exception(render_thread_error_);
+    }
+}
 
-        auto directional_lights = gather_directional_lights();
-        auto spot_lights = gather_spot_lights();
-        auto point_lights = gather_point_lights();
-        const auto& renderables = gather_renderables();
-        instance_buffer_.sync(renderables);
-        logging::log(0, logging::DEBUG,
-                     "MasterRenderer: gathered " + std::to_string(directional_lights.size()) + " directional, " +
-                         std::to_string(spot_lights.size()) + " spot and " + std::to_string(point_lights.size()) +
-                         " point lights");
-
-        if (shadow_renderer_) {
-            logging::log(0, logging::DEBUG, "MasterRenderer: invoking shadow renderer");
-            shadow_renderer_->render(renderables, instance_buffer_, directional_lights, spot_lights, point_lights);
-            logging::log(0, logging::DEBUG, "MasterRenderer: finished shadow pass");
+void MasterRenderer::render_loop() {
+    glfwMakeContextCurrent(window_);
+    try {
+        auto& packet = *packets_[0];
+        while (true) {
+            RenderSnapshot* snapshot = nullptr;
+            wait_until([&]() { return ready_snapshots_->try_pop(snapshot) || simulation_done_.load(); });
+            if (!snapshot) {
+                break;
+            }
+            prepare_frame(packet, *snapshot);
+            wait_until([&]() { return free_snapshots_->try_push(snapshot) || simulation_done_.load(); });
+            submit_frame(packet);
+            glfwSwapBuffers(window_);
         }
+    } catch (...) {
+        render_thread_error_ = std::current_exception();
+    }
+    glfwMakeContextCurrent(nullptr);
+    render_thread_done_ = true;
+}
 
-        oit_renderer_->prepare_opaque_target();
+void MasterRenderer::update_viewport(RenderSnapshot& snapshot) {
+    int fb_width = viewport_width_;
+    int fb_height = viewport_height_;
+    glfwGetFramebufferSize(window_, &fb_width, &fb_height);
+    viewport_width_ = fb_width;
+    viewport_height_ = fb_height;
+    snapshot.viewport_width = fb_width;
+    snapshot.viewport_height = fb_height;
+}
 
-        if (lit_renderer_) {
-            lit_renderer_->set_render_target(oit_renderer_->opaque_fbo(), viewport_width_, viewport_height_);
-            logging::log(0, logging::DEBUG, "MasterRenderer: invoking lit renderer");
-            lit_renderer_->render(renderables, instance_buffer_, view_matrix, projection_matrix, camera_position,
-                                  directional_lights, spot_lights, point_lights);
-            logging::log(0, logging::DEBUG, "MasterRenderer: finished lit pass");
+void MasterRenderer::submit_frame(const FramePacket& packet) {
+    glClearColor(0.1f, 0.15f, 0.2f, 1.0f);
+
+    const auto& snapshot = packet.snapshot;
+    const Mat4f& view_matrix = snapshot.view_matrix;
+    const Mat4f& projection_matrix = snapshot.projection_matrix;
+    const Vec3f& camera_position = snapshot.camera_position;
+    const auto& renderables = snapshot.renderables;
+    bool has_transparent_instances = packet.has_transparent_instances;
+    culling_stats_ = packet.culling_stats;
+
+    render_lights_.sync(snapshot);
+    const auto& directional_lights = render_lights_.directional();
+    const auto& spot_lights = render_lights_.spot();
+    const auto& point_lights = render_lights_.point();
+    shadow_atlas_->allocate(directional_lights, spot_lights, point_lights, camera_position, projection_matrix);
+    for (const auto& [light, transform] : directional_lights) {
+        light->update_cascades(transform, view_matrix, projection_matrix);
+    }
+    logging::log(0, logging::DEBUG,
+                 "MasterRenderer: submitting frame " + std::to_string(snapshot.frame) + " with " +
+                     std::to_string(directional_lights.size()) + " directional, " +
+                     std::to_string(spot_lights.size()) + " spot and " + std::to_string(point_lights.size()) +
+                     " point lights");
+
+    instance_buffer_.upload(packet.instances);
+    shadow_renderer_->set_static_changes(&snapshot.static_changes);
+    const VisibleInstanceLists* visible_instances = packet.cpu_culled ? &packet.visible_instances : nullptr;
+    lit_renderer_->set_visible_instances(visible_instances);
+    transparent_renderer_->set_visible_instances(visible_instances);
+
+    int width = snapshot.viewport_width;
+    int height = snapshot.viewport_height;
+    auto color_desc = target_desc(width, height, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+    auto depth_desc = target_desc(width, height, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+    bool deferred = shading_path_ == ShadingPath::Deferred && deferred_renderer_;
+    bool visibility = shading_path_ == ShadingPath::VisibilityBuffer && visibility_renderer_;
+
+    auto render_opaque = [&](const FBOData::SPtr& target, LitOutput output, const TextureData* depth) {
+        if (!lit_renderer_) {
+            return;
         }
-
-        bool has_transparent_instances = false;
-        for (const auto& renderable : renderables) {
-            if (renderable.transparent) {
-                has_transparent_instances = true;
-                break;
+        lit_renderer_->set_render_target(target, width, height);
+        lit_renderer_->set_output(output);
+        lit_renderer_->set_occlusion(hiz_buffer_.get(), depth);
+        logging::log(0, logging::DEBUG, "MasterRenderer: invoking lit renderer");
+        lit_renderer_->render(renderables, instance_buffer_, view_matrix, projection_matrix, camera_position,
+                              directional_lights);
+        logging::log(0, logging::DEBUG, "MasterRenderer: finished lit pass");
+    };
+
+    render_graph_.reset();
+    auto shadow_atlas = render_graph_.import_texture("shadow_atlas", shadow_atlas_->texture());
+
+    render_graph_.add_pass(
+        "shadows", [&](RenderGraph::Builder& builder) { builder.write(shadow_atlas); },
+        [&](RenderGraph::Resources&) {
+            if (shadow_renderer_) {
+                logging::log(0, logging::DEBUG, "MasterRenderer: invoking shadow renderer");
+                shadow_scheduler_->schedule(directional_lights, spot_lights, point_lights);
+                shadow_scheduler_->begin_gpu_timing();
+                shadow_renderer_->render(renderables, instance_buffer_, directional_lights, spot_lights,
+                                         point_lights);
+                shadow_scheduler_->end_gpu_timing();
+                logging::log(0, logging::DEBUG,
+                             "MasterRenderer: finished shadow pass, " +
+                                 std::to_string(shadow_scheduler_->scheduled_views()) + " views updated, " +
+                                 std::to_string(shadow_scheduler_->deferred_views()) + " deferred, " +
+                                 std::to_string(shadow_scheduler_->gpu_ms()) + " ms");
             }
-        }
+            // after the shadow pass, which records the matrices the local light tiles were rendered with
+            light_clusters_->build(spot_lights, point_lights, view_matrix, projection_matrix);
+        });
+
+    // pass callbacks run in execute() after the branches below closed, so every handle they capture lives here
+    RenderGraph::Handle opaque_color = RenderGraph::kInvalidHandle;
+    RenderGraph::Handle depth = RenderGraph::kInvalidHandle;
+    RenderGraph::Handle gbuffer[3] = {RenderGraph::kInvalidHandle, RenderGraph::kInvalidHandle,
+                                      RenderGraph::kInvalidHandle};
+    RenderGraph::Handle ids = RenderGraph::kInvalidHandle;
+    RenderGraph::Handle accum = RenderGraph::kInvalidHandle;
+    RenderGraph::Handle reveal = RenderGraph::kInvalidHandle;
+    if (deferred) {
+        render_graph_.add_pass(
+            "gbuffer",
+            [&](RenderGraph::Builder& builder) {
+                gbuffer[0] = builder.create("gbuffer_base_metallic",
+                                            target_desc(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE));
+                gbuffer[1] = builder.create("gbuffer_normal_roughness", color_desc);
+                gbuffer[2] = builder.create("gbuffer_emission",
+                                            target_desc(width, height, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT));
+                depth = builder.create("depth", depth_desc);
+            },
+            [&](RenderGraph::Resources& resources) {
+                auto& target = resources.framebuffer({gbuffer[0], gbuffer[1], gbuffer[2]}, depth);
+                deferred_renderer_->prepare_gbuffer(target);
+                render_opaque(target, LitOutput::GBuffer, resources.texture(depth));
+            });
+        render_graph_.add_pass(
+            "deferred_lighting",
+            [&](RenderGraph::Builder& builder) {
+                for (auto handle : gbuffer) {
+                    builder.read(handle);
+                }
+                builder.read(depth);
+                builder.read(shadow_atlas);
+                opaque_color = builder.create("opaque_color", color_desc);
+            },
+            [&](RenderGraph::Resources& resources) {
+                auto& target = resources.framebuffer({opaque_color});
+                oit_renderer_->prepare_opaque_target(target, width, height);
+                DeferredRenderer::GBuffer textures;
+                textures.base_metallic = resources.texture(gbuffer[0]);
+                textures.normal_roughness = resources.texture(gbuffer[1]);
+                textures.emission = resources.texture(gbuffer[2]);
+                textures.depth = resources.texture(depth);
+                deferred_renderer_->resolve(target, textures, width, height, view_matrix, projection_matrix,
+                                            camera_position, directional_lights);
+            });
+    } else if (visibility) {
+        render_graph_.add_pass(
+            "visibility",
+            [&](RenderGraph::Builder& builder) {
+                ids = builder.create("visibility",
+                                     target_desc(width, height, GL_RG32UI, GL_RG_INTEGER, GL_UNSIGNED_INT));
+                depth = builder.create("depth", depth_desc);
+            },
+            [&](RenderGraph::Resources& resources) {
+                auto& target = resources.framebuffer({ids}, depth);
+                visibility_renderer_->prepare_visibility(target);
+                render_opaque(target, LitOutput::Visibility, resources.texture(depth));
+            });
+        render_graph_.add_pass(
+            "visibility_resolve",
+            [&](RenderGraph::Builder& builder) {
+                builder.read(ids);
+                builder.read(shadow_atlas);
+                opaque_color = builder.create("opaque_color", color_desc);
+            },
+            [&](RenderGraph::Resources& resources) {
+                auto& target = resources.framebuffer({opaque_color});
+                oit_renderer_->prepare_opaque_target(target, width, height);
+                visibility_renderer_->resolve(target, resources.texture(ids), width, height, instance_buffer_,
+                                              view_matrix, projection_matrix, camera_position,
+                                              directional_lights);
+            });
+    } else {
+        render_graph_.add_pass(
+            "opaque",
+            [&](RenderGraph::Builder& builder) {
+                builder.read(shadow_atlas);
+                opaque_color = builder.create("opaque_color", color_desc);
+                depth = builder.create("depth", depth_desc);
+            },
+            [&](RenderGraph::Resources& resources) {
+                auto& target = resources.framebuffer({opaque_color}, depth);
+                oit_renderer_->prepare_opaque_target(target, width, height);
+                render_opaque(target, LitOutput::Shaded, resources.texture(depth));
+            });
+    }
 
-        oit_renderer_->prepare_transparent_target();
-        if (transparent_renderer_) {
-            transparent_renderer_->set_render_target(oit_renderer_->transparent_fbo(),
-                                                     viewport_width_,
-                                                     viewport_height_);
-        }
-        if (has_transparent_instances && transparent_renderer_) {
+    render_graph_.add_pass(
+        "transparent",
+        [&](RenderGraph::Builder& builder) {
+            builder.read(depth);
+            builder.read(shadow_atlas);
+            accum = builder.create("transparent_accum", color_desc);
+            reveal = builder.create("transparent_reveal", target_desc(width, height, GL_R16F, GL_RED, GL_FLOAT));
+        },
+        [&](RenderGraph::Resources& resources) {
+            auto& target = resources.framebuffer({accum, reveal}, depth);
+            oit_renderer_->prepare_transparent_target(target, width, height);
+            if (!has_transparent_instances || !transparent_renderer_) {
+                return;
+            }
+            transparent_renderer_->set_render_target(target, width, height);
             glDepthMask(GL_FALSE);
             glEnable(GL_BLEND);
             glBlendFunci(0, GL_ONE, GL_ONE);
@@ -204,30 +555,155 @@ void MasterRenderer::run() {
                                           view_matrix,
                                           projection_matrix,
                                           camera_position,
-                                          directional_lights,
-                                          spot_lights,
-                                          point_lights);
+                                          directional_lights);
 
             glDisable(GL_BLEND);
             glDepthMask(GL_TRUE);
+        });
+
+    render_graph_.add_pass(
+        "composite",
+        [&](RenderGraph::Builder& builder) {
+            builder.read(accum);
+            builder.read(reveal);
+            builder.read(opaque_color);
+            builder.side_effect();
+        },
+        [&](RenderGraph::Resources& resources) {
+            oit_renderer_->composite(resources.texture(accum), resources.texture(reveal),
+                                     resources.texture(opaque_color), width, height);
+        });
+
+    render_graph_.compile();
+    render_graph_.execute();
+    const auto& graph_stats = render_graph_.stats();
+    logging::log(0, logging::DEBUG,
+                 "MasterRenderer: frame graph ran " + std::to_string(graph_stats.passes - graph_stats.culled_passes) +
+                     " of " + std::to_string(graph_stats.passes) + " passes, " +
+                     std::to_string(graph_stats.transient_textures) + " transient textures in " +
+                     std::to_string(graph_stats.physical_textures) + " physical, " +
+                     std::to_string(graph_stats.physical_bytes >> 20) + " of " +
+                     std::to_string(graph_stats.transient_bytes >> 20) + " MiB");
+}
+
+void MasterRenderer::begin_preparation(FramePacket& packet, RenderSnapshot& snapshot) {
+    auto done = std::make_shared<std::promise<void>>();
+    preparation_ = done->get_future();
+    if (!pipelined_) {
+        prepare_frame(packet, snapshot);
+        done->set_value();
+        return;
+    }
+    worker_pool_->submit([this, &packet, &snapshot, done]() {
+        try {
+            prepare_frame(packet, snapshot);
+            done->set_value();
+        } catch (...) {
+            done->set_exception(std::current_exception());
         }
+    });
+}
 
-        oit_renderer_->composite(viewport_width_, viewport_height_);
+void MasterRenderer::finish_preparation() {
+    if (preparation_.valid()) {
+        preparation_.get();
+    }
+}
 
-        glfwSwapBuffers(window_);
-        glfwPollEvents();
-        ecs_.process(delta_seconds);
+void MasterRenderer::extract_frame(RenderSnapshot& snapshot) {
+    snapshot.frame = ++prepared_frames_;
+    snapshot.camera_valid = false;
+    snapshot.view_matrix = Mat4f::eye();
+    snapshot.projection_matrix = Mat4f::eye();
+    snapshot.camera_position = Vec3f{0.0f, 0.0f, 0.0f};
+    if (active_camera_.id != ecs::INVALID_ID) {
+        auto& entity = ecs_[active_camera_.id];
+        if (auto* transform = entity.get<Transformation>()) {
+            snapshot.view_matrix = transform->global_matrix().inverse();
+            snapshot.camera_position = transform->global_position();
+            snapshot.camera_valid = true;
+        }
+
+        if (auto* perspective = entity.get<PerspectiveCamera>()) {
+            snapshot.projection_matrix = perspective->projection_matrix();
+        } else if (auto* orthographic = entity.get<OrthographicCamera>()) {
+            snapshot.projection_matrix = orthographic->projection_matrix();
+        } else {
+            logging::log(0, logging::WARNING,
+                         "MasterRenderer: active camera lacks a projection component (entity " +
+                             std::to_string(active_camera_.id) + ")");
+        }
+    }
+
+    if (!snapshot.camera_valid) {
+        logging::log(0, logging::WARNING,
+                     "MasterRenderer: active camera invalid (entity " + std::to_string(active_camera_.id) + ")");
+    } else {
+        logging::log(0, logging::DEBUG,
+                     "MasterRenderer: using active camera entity " + std::to_string(active_camera_.id));
+    }
+
+    snapshot_lights(ecs_, snapshot.directional_lights);
+    snapshot_lights(ecs_, snapshot.spot_lights);
+    snapshot_lights(ecs_, snapshot.point_lights);
+    // before gathering, copying the instance transforms clears the dirty flags the index detects movement by
+    scene_index_.update(ecs_);
+    gather_renderables(snapshot.renderables, snapshot.frame);
+
+    snapshot.static_changes = scene_index_.static_changes();
+    // the tree is only safe to query here, the culler later works from the recorded hits
+    std::unordered_map<ecs::ID, bool> frustum_hits;
+    Mat4f view_projection = snapshot.projection_matrix.matmul(snapshot.view_matrix);
+    scene_index_.tree().query(Frustum(view_projection),
+                              [&frustum_hits](std::size_t id, bool inside) { frustum_hits[id] = inside; });
+    for (auto& renderable : snapshot.renderables) {
+        const AABB* bounds = scene_index_.bounds(renderable.entity);
+        renderable.indexed = bounds != nullptr;
+        renderable.is_static = scene_index_.is_static(renderable.entity);
+        renderable.in_frustum = false;
+        renderable.inside_frustum = false;
+        if (bounds) {
+            renderable.bounds = *bounds;
+            auto hit = frustum_hits.find(renderable.entity);
+            if (hit != frustum_hits.end()) {
+                renderable.in_frustum = true;
+                renderable.inside_frustum = hit->second;
+            }
+        }
     }
 }
 
-const RenderableList& MasterRenderer::gather_renderables() {
-    renderables_.clear();
+void MasterRenderer::prepare_frame(FramePacket& packet, RenderSnapshot& snapshot) {
+    // the packet keeps the extracted state, the snapshot gets the storage of the previous one back for reuse
+    std::swap(packet.snapshot, snapshot);
+    const auto& renderables = packet.snapshot.renderables;
+    packet.has_transparent_instances = false;
+    for (const auto& renderable : renderables) {
+        packet.has_transparent_instances |= renderable.transparent;
+    }
+
+    Mat4f view_projection = packet.snapshot.projection_matrix.matmul(packet.snapshot.view_matrix);
+    occlusion_rasterizer_->rasterize(renderables, view_projection);
+    frustum_culler_->cull(renderables, Frustum(view_projection));
+    frustum_culler_->take_results(packet.visible_instances);
+    packet.culling_stats = frustum_culler_->stats();
+    packet.cpu_culled = frustum_culler_->enabled();
+    instance_buffer_.pack(renderables, packet.instances);
+    logging::log(0, logging::DEBUG,
+                 "MasterRenderer: prepared frame " + std::to_string(packet.snapshot.frame) + " with " +
+                     std::to_string(packet.culling_stats.visible()) + " of " +
+                     std::to_string(packet.culling_stats.tested) + " instances visible");
+}
+
+void MasterRenderer::gather_renderables(RenderableList& renderables, std::uint64_t frame) {
+    renderables.clear();
     for (auto& entity : ecs_.each<ModelComponent>()) {
         auto* model = entity.get<ModelComponent>();
         auto* instances = entity.get<Instances>();
         auto* visibility = entity.get<Visibility>();
         auto* shadow = entity.get<ShadowCaster>();
         auto* transparency_component = entity.get<Transparency>();
+        auto* occluder = entity.get<Occluder>();
         if (!model || !model->valid() || !instances || instances->count() == 0) {
             continue;
         }
@@ -249,64 +725,35 @@ const RenderableList& MasterRenderer::gather_renderables() {
                 break;
             }
         }
-        renderables_.push_back(
-            RenderableInstance{model, instances, visibility, shadow, transparency_component, transparent});
-    }
-    logging::log(0, logging::DEBUG,
-                 "MasterRenderer: gathered " + std::to_string(renderables_.size()) + " renderable entries");
-    return renderables_;
-}
-
-MasterRenderer::DirectionalLightList MasterRenderer::gather_directional_lights() {
-    DirectionalLightList lights;
-    for (auto& entity : ecs_.each<DirectionalLight>()) {
-        auto* light = entity.get<DirectionalLight>();
-        auto* transform = entity.get<Transformation>();
-        auto* visible = entity.get<Visible>();
-        if (!light || !transform || (visible && !visible->enabled) || !light->enabled) {
-            continue;
-        }
-        light->update_matrices(transform);
-        if (light->casts_shadows) {
-            light->ensure_shadow_resources();
+        RenderableInstance renderable;
+        renderable.entity = model->component_id.id;
+        renderable.mesh = model->mesh;
+        if (occluder && occluder->enabled) {
+            renderable.occluder_mesh = occluder->proxy ? occluder->proxy : model->mesh;
         }
-        lights.emplace_back(light, transform);
+        renderable.double_sided = model->double_sided;
+        renderable.allow_instancing = model->allow_instancing;
+        renderable.casts_shadows = model->casts_shadows && shadow && shadow->casts_shadows;
+        renderable.transparent = transparent;
+        renderable.instance_count = instances->count();
+        renderable.transforms = instance_transforms(renderable.entity, *instances, frame);
+        renderables.push_back(std::move(renderable));
     }
-    return lights;
-}
-
-MasterRenderer::PointLightList MasterRenderer::gather_point_lights() {
-    PointLightList lights;
-    for (auto& entity : ecs_.each<PointLight>()) {
-        auto* light = entity.get<PointLight>();
-        auto* transform = entity.get<Transformation>();
-        auto* visible = entity.get<Visible>();
-        if (!light || !transform || (visible && !visible->enabled) || !light->enabled) {
-            continue;
-        }
-        light->update_shadow_matrices(transform);
-        if (light->casts_shadows) {
-            light->ensure_shadow_resources();
-        }
-        lights.emplace_back(light, transform);
+    // drop the copies of entities that stopped being renderable
+    for (auto it = transform_cache_.begin(); it != transform_cache_.end();) {
+        it = it->second.frame == frame ? std::next(it) : transform_cache_.erase(it);
     }
-    return lights;
+    logging::log(0, logging::DEBUG,
+                 "MasterRenderer: gathered " + std::to_string(renderables.size()) + " renderable entries");
 }
 
-MasterRenderer::SpotLightList MasterRenderer::gather_spot_lights() {
-    SpotLightList lights;
-    for (auto& entity : ecs_.each<SpotLight>()) {
-        auto* light = entity.get<SpotLight>();
-        auto* transform = entity.get<Transformation>();
-        auto* visible = entity.get<Visible>();
-        if (!light || !transform || (visible && !visible->enabled) || !light->enabled) {
-            continue;
-        }
-        light->update_matrices(transform);
-        if (light->casts_shadows) {
-            light->ensure_shadow_resources();
-        }
-        lights.emplace_back(light, transform);
+InstanceTransforms MasterRenderer::instance_transforms(ecs::ID entity, Instances& instances, std::uint64_t frame) {
+    auto& cached = transform_cache_[entity];
+    cached.frame = frame;
+    // snapshots still in flight keep their copy, a change only replaces the pointer handed to later ones
+    if (!cached.transforms || instances.dirty() || cached.transforms->size() != instances.count()) {
+        cached.transforms = std::make_shared<const std::vector<Mat4f>>(instances.transforms());
+        instances.clear_dirty_flags();
     }
-    return lights;
+    return cached.transforms;
 }
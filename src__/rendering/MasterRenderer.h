@@ -1,7 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
+#include <future>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include <ecs.h>
@@ -15,15 +20,41 @@ struct GLFWwindow;
 #include "components/Transparency.h"
 #include "../lighting/directional_light.h"
 #include "../lighting/point_light.h"
+#include "../lighting/shadow_atlas.h"
+#include "../lighting/shadow_scheduler.h"
 #include "../lighting/spot_light.h"
 #include "../math/transformation.h"
 #include "../resources/resource_manager.h"
 #include "lit/LitRenderer.h"
+#include "../shader/deferred/DeferredRenderer.h"
 #include "../shader/oit/OITRenderer.h"
+#include "../shader/visibility/VisibilityRenderer.h"
 #include "../shader/shadow/ShadowRenderer.h"
 #include "lit_transparent/TransparentRenderer.h"
+#include "FramePacket.h"
 #include "InstanceBuffer.h"
+#include "RenderLights.h"
 #include "RenderScene.h"
+#include "RenderSnapshot.h"
+#include "SceneIndex.h"
+#include "VertexPool.h"
+#include "culling/FrustumCuller.h"
+#include "culling/GpuCuller.h"
+#include "culling/HiZBuffer.h"
+#include "culling/OcclusionRasterizer.h"
+#include "graph/RenderGraph.h"
+#include "lighting/LightClusters.h"
+#include "../core/spsc_queue.h"
+#include "../core/worker_pool.h"
+
+// how opaque geometry is shaded, transparents always take the forward OIT path
+enum class ShadingPath {
+    Forward,
+    // G-buffer of material attributes, shaded in one fullscreen pass
+    Deferred,
+    // instance and triangle ids only, surfaces are rebuilt and shaded in one fullscreen pass
+    VisibilityBuffer,
+};
 
 class MasterRenderer {
   public:
@@ -37,18 +68,55 @@ class MasterRenderer {
     ResourceManager& resources() { return resource_manager_; }
 
     void set_active_camera(ecs::EntityID camera_id);
+    void set_gpu_culling(bool enabled);
+    void set_cpu_culling(bool enabled);
+    void set_occlusion_culling(bool enabled);
+    void set_software_occlusion(bool enabled);
+    // GPU milliseconds per frame the shadow pass may spend on views that are not forced, zero updates all each frame
+    void set_shadow_budget_ms(float budget_ms);
+    void set_shadow_filter(ShadowFilter filter);
+    void set_shading_path(ShadingPath path) { shading_path_ = path; }
+    // depth only pass in front of the opaque geometry, applies from the next frame; Auto picks by measured GPU time
+    void set_depth_prepass(DepthPrepassMode mode);
+    const DepthPrepassStats& depth_prepass_stats() const { return lit_renderer_->depth_prepass_stats(); }
+    // 16 bit shadow caster positions, applies to meshes uploaded afterwards
+    void set_shadow_position_quantization(bool enabled) { MeshData::set_quantize_shadow_positions(enabled); }
+    // opaque meshes fetch their vertices from one pooled SSBO by gl_VertexID, so all of them draw with one VAO
+    void set_vertex_pulling(bool enabled);
+    // per instance layout in the instance buffer, the compact ones trade precision for upload and SSBO size
+    void set_instance_format(InstanceFormat format) { instance_buffer_.set_format(format); }
+    // prepares the next frame on the worker pool while the current one is submitted, which delays the display by
+    // one frame; disabled, every frame is prepared right before it is submitted
+    void set_frame_pipelining(bool enabled) { pipelined_ = enabled; }
+    // moves preparation and GL submission to a thread owning the context, fed with snapshots through a lock free
+    // queue while the calling thread runs the systems and extracts the next ones; set both before run()
+    void set_render_thread(bool enabled) { render_thread_ = enabled; }
+    // snapshots extracted ahead of the one being drawn before the simulation waits for the render thread
+    void set_max_frames_in_flight(int frames) { max_frames_in_flight_ = frames > 0 ? frames : 1; }
+    // of the frame submitted last, only consistent outside of run() when the render thread is enabled
+    const CullingStats& culling_stats() const { return culling_stats_; }
+    // updated while a frame is extracted, so only consistent outside of run()
+    const SceneIndex& scene_index() const { return scene_index_; }
+    const RenderGraphStats& render_graph_stats() const { return render_graph_.stats(); }
 
     void run();
 
   private:
-    using DirectionalLightList = std::vector<std::pair<DirectionalLight*, Transformation*>>;
-    using PointLightList = std::vector<std::pair<PointLight*, Transformation*>>;
-    using SpotLightList = std::vector<std::pair<SpotLight*, Transformation*>>;
-
-    DirectionalLightList gather_directional_lights();
-    PointLightList gather_point_lights();
-    SpotLightList gather_spot_lights();
-    const RenderableList& gather_renderables();
+    // copies everything the frame needs out of the ECS, the only step of a frame reading components
+    void extract_frame(RenderSnapshot& snapshot);
+    void gather_renderables(RenderableList& renderables, std::uint64_t frame);
+    InstanceTransforms instance_transforms(ecs::ID entity, Instances& instances, std::uint64_t frame);
+
+    // takes over the snapshot and runs on the worker pool while the previous packet is submitted, must not touch
+    // GL, the ECS or state the submission reads
+    void prepare_frame(FramePacket& packet, RenderSnapshot& snapshot);
+    void begin_preparation(FramePacket& packet, RenderSnapshot& snapshot);
+    void finish_preparation();
+    void update_viewport(RenderSnapshot& snapshot);
+    // GL work of one frame, on the thread owning the context
+    void submit_frame(const FramePacket& packet);
+    void run_threaded();
+    void render_loop();
 
     GLFWwindow* window_{nullptr};
     int viewport_width_{0};
@@ -61,9 +129,45 @@ class MasterRenderer {
     std::unique_ptr<ShadowRenderer> shadow_renderer_;
     std::unique_ptr<TransparentRenderer> transparent_renderer_;
     std::unique_ptr<OITRenderer> oit_renderer_;
+    std::unique_ptr<DeferredRenderer> deferred_renderer_;
+    std::unique_ptr<VisibilityRenderer> visibility_renderer_;
+    std::unique_ptr<GpuCuller> gpu_culler_;
+    std::unique_ptr<HiZBuffer> hiz_buffer_;
+    std::unique_ptr<VertexPool> vertex_pool_;
+    std::unique_ptr<ShadowAtlas> shadow_atlas_;
+    std::unique_ptr<ShadowScheduler> shadow_scheduler_;
+    std::unique_ptr<WorkerPool> worker_pool_;
+    std::unique_ptr<FrustumCuller> frustum_culler_;
+    std::unique_ptr<OcclusionRasterizer> occlusion_rasterizer_;
+    std::unique_ptr<LightClusters> light_clusters_;
 
     InstanceBuffer instance_buffer_;
-    RenderableList renderables_;
+    RenderGraph render_graph_;
+    SceneIndex scene_index_;
+    RenderLights render_lights_;
+    CullingStats culling_stats_;
+    // one packet is submitted while the other one is prepared; the render thread prepares and submits its only one
+    std::vector<std::unique_ptr<FramePacket>> packets_;
+    // max_frames_in_flight + 1 with the render thread: one is extracted while the others are queued or prepared
+    std::vector<std::unique_ptr<RenderSnapshot>> snapshots_;
+    struct CachedTransforms {
+        InstanceTransforms transforms;
+        std::uint64_t frame{0};
+    };
+    // last copy of the instance matrices per entity, handed to every snapshot until the component is dirty again
+    std::unordered_map<ecs::ID, CachedTransforms> transform_cache_;
+    std::future<void> preparation_;
+    std::uint64_t prepared_frames_{0};
+    bool pipelined_{true};
+
+    bool render_thread_{false};
+    int max_frames_in_flight_{2};
+    std::unique_ptr<SpscQueue<RenderSnapshot*>> free_snapshots_;
+    std::unique_ptr<SpscQueue<RenderSnapshot*>> ready_snapshots_;
+    std::atomic<bool> simulation_done_{false};
+    std::atomic<bool> render_thread_done_{false};
+    std::exception_ptr render_thread_error_;
+    ShadingPath shading_path_{ShadingPath::Forward};
 
     ecs::EntityID active_camera_{ecs::EntityID{ecs::INVALID_ID}};
 };
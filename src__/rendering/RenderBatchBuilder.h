@@ -1,11 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
-#include <unordered_map>
 #include <vector>
 
 #include "InstanceBuffer.h"
 #include "RenderScene.h"
+#include "culling/VisibleInstances.h"
+#include "../core/radix_sort.h"
 #include "../resources/resource_types.h"
 #include "../logging/logging.h"
 
@@ -14,34 +17,102 @@ struct InstanceDrawRange {
     GLsizei instance_count{0};
 };
 
+// pass a batch list is built for, the shader is fixed per pass and materials are bindless (read per vertex), so
+// neither splits batches
+enum class BatchPass : std::uint8_t { Opaque = 0, Transparent = 1, Shadow = 2 };
+enum class DepthOrder : std::uint8_t { None, FrontToBack, BackToFront };
+
+struct BatchOrder {
+    BatchPass pass{BatchPass::Opaque};
+    DepthOrder depth{DepthOrder::None};
+    Vec3f eye{0.0f, 0.0f, 0.0f};
+};
+
 struct MeshBatch {
     MeshData* mesh{nullptr};
     bool double_sided{false};
+    // pass | cull mode | depth bucket | mesh, batches are returned sorted by it
+    std::uint64_t sort_key{0};
     std::vector<InstanceDrawRange> draws;
+    // set when the batch was built from CPU culled lists: draws index into visible_instances, which holds
+    // instance buffer slots and is uploaded to the remap buffer by FrustumCuller::upload
+    bool remapped{false};
+    std::vector<GLuint> visible_instances;
 };
 
 namespace detail {
 inline std::uintptr_t make_batch_key(MeshData* mesh, bool double_sided) {
     return (reinterpret_cast<std::uintptr_t>(mesh) << 1) ^ (double_sided ? 0x1u : 0x0u);
 }
+
+// logarithmic, fine close to the eye and still distinct at a few kilometres
+inline std::uint32_t depth_bucket(float distance) {
+    float bucket = std::log2(1.0f + std::max(distance, 0.0f)) * 2048.0f;
+    return static_cast<std::uint32_t>(std::min(bucket, 65535.0f));
+}
+
+// distance to the indexed bounds, or to the first instance when the entity is not indexed
+inline float eye_distance(const RenderableInstance& renderable, const Vec3f& eye) {
+    Vec3f offset{0.0f, 0.0f, 0.0f};
+    if (renderable.indexed) {
+        for (int axis = 0; axis < 3; ++axis) {
+            float closest = std::clamp(eye[axis], renderable.bounds.min[axis], renderable.bounds.max[axis]);
+            offset[axis] = closest - eye[axis];
+        }
+    } else if (const Mat4f* matrix = renderable.matrices()) {
+        offset = Vec3f{(*matrix)(0, 3) - eye[0], (*matrix)(1, 3) - eye[1], (*matrix)(2, 3) - eye[2]};
+    }
+    return offset.length();
+}
+
+// cull mode above depth: single sided batches come first, so culling is switched off at most once per pass. Every
+// batch is its own mesh, which makes the mesh bind per batch unavoidable and leaves depth to order them.
+inline std::uint64_t make_sort_key(BatchPass pass, bool double_sided, std::uint32_t depth, std::size_t mesh) {
+    return (static_cast<std::uint64_t>(pass) << 60) | (static_cast<std::uint64_t>(double_sided ? 1u : 0u) << 59) |
+           (static_cast<std::uint64_t>(depth & 0xFFFFu) << 43) | (static_cast<std::uint64_t>(mesh) & 0x7FFFFFFFFFFull);
+}
 } // namespace detail
 
+// enables or disables face culling for the batch, only when it differs from the current state
+inline void apply_cull_mode(const MeshBatch& batch, bool& culling) {
+    bool wanted = !batch.double_sided;
+    if (wanted == culling) {
+        return;
+    }
+    culling = wanted;
+    if (culling) {
+        glEnable(GL_CULL_FACE);
+    } else {
+        glDisable(GL_CULL_FACE);
+    }
+}
+
+// Groups the renderables passing the predicate into one batch per mesh and cull mode. Entries are radix sorted by
+// depth and then by batch, so the draws of a batch follow the requested depth order, and the batches come back
+// sorted by MeshBatch::sort_key.
 template<typename Predicate>
 std::vector<MeshBatch> build_mesh_batches(const RenderableList& renderables, InstanceBuffer& instance_buffer,
-                                          Predicate&& predicate) {
-    std::vector<MeshBatch> batches;
-    std::unordered_map<std::uintptr_t, std::size_t> batch_lookup;
+                                          Predicate&& predicate, const VisibleInstanceLists* visible = nullptr,
+                                          const BatchOrder& order = BatchOrder{}) {
+    struct Entry {
+        std::uint64_t batch_key{0};
+        std::uint32_t depth{0};
+        std::size_t renderable_index{0};
+        std::size_t base{0};
+    };
+    std::vector<Entry> entries;
+    std::vector<Entry> entry_scratch;
+    entries.reserve(renderables.size());
 
-    for (const auto& renderable : renderables) {
+    for (std::size_t renderable_index = 0; renderable_index < renderables.size(); ++renderable_index) {
+        const auto& renderable = renderables[renderable_index];
         if (!predicate(renderable)) {
             continue;
         }
-        auto* model = renderable.model;
-        auto* instances = renderable.instances;
-        if (!model || !instances || instances->count() == 0) {
+        if (renderable.instance_count == 0) {
             continue;
         }
-        auto mesh_ptr = model->mesh.get();
+        auto mesh_ptr = renderable.mesh.get();
         if (!mesh_ptr) {
             continue;
         }
@@ -49,38 +120,81 @@ std::vector<MeshBatch> build_mesh_batches(const RenderableList& renderables, Ins
             logging::log(0, logging::DEBUG, "RenderBatchBuilder skipping mesh not resident: " + mesh_ptr->get_path());
             continue;
         }
-        auto base = instance_buffer.base_instance(instances);
+        auto base = instance_buffer.base_instance(renderable.entity);
         if (!base.has_value()) {
             logging::log(0, logging::WARNING,
-                         "RenderBatchBuilder missing base instance for component " +
-                             std::to_string(reinterpret_cast<std::uintptr_t>(instances)));
+                         "RenderBatchBuilder missing base instance for entity " + std::to_string(renderable.entity));
             continue;
         }
 
-        auto key = detail::make_batch_key(mesh_ptr, model->double_sided);
-        std::size_t index = 0;
-        auto it = batch_lookup.find(key);
-        if (it == batch_lookup.end()) {
+        Entry entry;
+        entry.batch_key = detail::make_batch_key(mesh_ptr, renderable.double_sided);
+        if (order.depth != DepthOrder::None) {
+            entry.depth = detail::depth_bucket(detail::eye_distance(renderable, order.eye));
+            if (order.depth == DepthOrder::BackToFront) {
+                entry.depth = 0xFFFFu - entry.depth;
+            }
+        }
+        entry.renderable_index = renderable_index;
+        entry.base = *base;
+        entries.push_back(entry);
+    }
+
+    if (order.depth != DepthOrder::None) {
+        radix_sort(entries, entry_scratch, [](const Entry& entry) { return entry.depth; });
+    }
+    radix_sort(entries, entry_scratch, [](const Entry& entry) { return entry.batch_key; });
+
+    std::vector<MeshBatch> batches;
+    for (std::size_t entry_index = 0; entry_index < entries.size(); ++entry_index) {
+        const auto& entry = entries[entry_index];
+        const auto& renderable = renderables[entry.renderable_index];
+        // entries of a batch are adjacent, the first one is the nearest (or farthest) in depth order
+        if (entry_index == 0 || entries[entry_index - 1].batch_key != entry.batch_key) {
             MeshBatch batch;
-            batch.mesh = mesh_ptr;
-            batch.double_sided = model->double_sided;
-            index = batches.size();
+            batch.mesh = renderable.mesh.get();
+            batch.double_sided = renderable.double_sided;
+            batch.sort_key = detail::make_sort_key(order.pass, renderable.double_sided, entry.depth, batches.size());
+            batch.remapped = visible != nullptr;
             batches.push_back(std::move(batch));
-            batch_lookup.emplace(key, index);
-        } else {
-            index = it->second;
         }
 
-        auto& batch = batches[index];
-        if (model->allow_instancing) {
+        auto& batch = batches.back();
+        const std::size_t base = entry.base;
+        const std::size_t renderable_index = entry.renderable_index;
+        if (batch.remapped) {
+            const VisibleInstanceList* list = nullptr;
+            if (renderable_index < visible->size() && (*visible)[renderable_index].entity == renderable.entity &&
+                (*visible)[renderable_index].culled) {
+                list = &(*visible)[renderable_index];
+            }
+            std::size_t visible_count = list ? list->indices.size() : renderable.instance_count;
+            if (visible_count == 0) {
+                continue;
+            }
+            auto first = static_cast<GLuint>(batch.visible_instances.size());
+            for (std::size_t i = 0; i < visible_count; ++i) {
+                std::size_t local = list ? list->indices[i] : i;
+                batch.visible_instances.push_back(static_cast<GLuint>(base + local));
+            }
+            if (renderable.allow_instancing) {
+                batch.draws.push_back(InstanceDrawRange{first, static_cast<GLsizei>(visible_count)});
+            } else {
+                for (std::size_t i = 0; i < visible_count; ++i) {
+                    batch.draws.push_back(InstanceDrawRange{static_cast<GLuint>(first + i), 1});
+                }
+            }
+        } else if (renderable.allow_instancing) {
             batch.draws.push_back(
-                InstanceDrawRange{static_cast<GLuint>(*base), static_cast<GLsizei>(instances->count())});
+                InstanceDrawRange{static_cast<GLuint>(base), static_cast<GLsizei>(renderable.instance_count)});
         } else {
-            for (std::size_t i = 0; i < instances->count(); ++i) {
-                batch.draws.push_back(InstanceDrawRange{static_cast<GLuint>(*base + i), 1});
+            for (std::size_t i = 0; i < renderable.instance_count; ++i) {
+                batch.draws.push_back(InstanceDrawRange{static_cast<GLuint>(base + i), 1});
             }
         }
     }
 
+    std::vector<MeshBatch> batch_scratch;
+    radix_sort(batches, batch_scratch, [](const MeshBatch& batch) { return batch.sort_key; });
     return batches;
 }
@@ -0,0 +1,56 @@
+#include "RenderLights.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+void keep_shadow_state(DirectionalLight& light, const DirectionalLight& previous) {
+    light.shadow_rects = previous.shadow_rects;
+    light.current_shadow_resolution = previous.current_shadow_resolution;
+}
+
+void keep_shadow_state(SpotLight& light, const SpotLight& previous) {
+    light.shadow_rect = previous.shadow_rect;
+    light.current_shadow_resolution = previous.current_shadow_resolution;
+}
+
+void keep_shadow_state(PointLight& light, const PointLight& previous) {
+    std::copy(std::begin(previous.shadow_rects), std::end(previous.shadow_rects), std::begin(light.shadow_rects));
+    light.current_shadow_resolution = previous.current_shadow_resolution;
+}
+
+void update_light(DirectionalLight& light, const Transformation* transform) { light.update_matrices(transform); }
+
+void update_light(SpotLight& light, const Transformation* transform) { light.update_matrices(transform); }
+
+void update_light(PointLight& light, const Transformation* transform) { light.update_shadow_matrices(transform); }
+} // namespace
+
+void RenderLights::sync(const RenderSnapshot& snapshot) {
+    sync_entries(snapshot.directional_lights, directional_entries_, directional_);
+    sync_entries(snapshot.spot_lights, spot_entries_, spot_);
+    sync_entries(snapshot.point_lights, point_entries_, point_);
+}
+
+template<typename Light>
+void RenderLights::sync_entries(const std::vector<LightSnapshot<Light>>& snapshots,
+                                std::unordered_map<ecs::ID, Entry<Light>>& entries,
+                                std::vector<std::pair<Light*, Transformation*>>& lights) {
+    for (auto& [id, entry] : entries) {
+        entry.current = false;
+    }
+    lights.clear();
+    for (const auto& snapshot : snapshots) {
+        auto& entry = entries[snapshot.entity];
+        Light light = snapshot.light;
+        keep_shadow_state(light, entry.light);
+        entry.light = light;
+        entry.transform = snapshot.transform;
+        entry.current = true;
+        update_light(entry.light, &entry.transform);
+        lights.emplace_back(&entry.light, &entry.transform);
+    }
+    for (auto it = entries.begin(); it != entries.end();) {
+        it = it->second.current ? std::next(it) : entries.erase(it);
+    }
+}
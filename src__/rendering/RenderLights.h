@@ -0,0 +1,50 @@
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <ecs.h>
+
+#include "RenderSnapshot.h"
+#include "../lighting/directional_light.h"
+#include "../lighting/point_light.h"
+#include "../lighting/spot_light.h"
+#include "../math/transformation.h"
+
+// Render side copies of the light components. Every render snapshot replaces their settings, while the shadow state
+// kept across frames by the atlas, the scheduler and the shadow pass stays with the copy of the same entity. Lights
+// missing from a snapshot are dropped.
+class RenderLights {
+  public:
+    using DirectionalLightList = std::vector<std::pair<DirectionalLight*, Transformation*>>;
+    using SpotLightList = std::vector<std::pair<SpotLight*, Transformation*>>;
+    using PointLightList = std::vector<std::pair<PointLight*, Transformation*>>;
+
+    // also updates the light and shadow matrices from the snapshot transforms
+    void sync(const RenderSnapshot& snapshot);
+
+    const DirectionalLightList& directional() const { return directional_; }
+    const SpotLightList& spot() const { return spot_; }
+    const PointLightList& point() const { return point_; }
+
+  private:
+    template<typename Light>
+    struct Entry {
+        Light light;
+        Transformation transform;
+        bool current{false};
+    };
+
+    template<typename Light>
+    static void sync_entries(const std::vector<LightSnapshot<Light>>& snapshots,
+                             std::unordered_map<ecs::ID, Entry<Light>>& entries,
+                             std::vector<std::pair<Light*, Transformation*>>& lights);
+
+    std::unordered_map<ecs::ID, Entry<DirectionalLight>> directional_entries_;
+    std::unordered_map<ecs::ID, Entry<SpotLight>> spot_entries_;
+    std::unordered_map<ecs::ID, Entry<PointLight>> point_entries_;
+    DirectionalLightList directional_;
+    SpotLightList spot_;
+    PointLightList point_;
+};
@@ -1,20 +1,50 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
 #include <vector>
 
+#include <ecs.h>
+
 #include "components/ModelComponent.h"
 #include "components/Instances.h"
+#include "components/Occluder.h"
 #include "components/ShadowCaster.h"
 #include "components/Transparency.h"
 #include "components/Visible.h"
+#include "../math/bounds.h"
+#include "../math/mat.h"
+#include "../resources/mesh_data.h"
+
+// instance matrices of one entity, shared by every snapshot taken until its Instances component changes
+using InstanceTransforms = std::shared_ptr<const std::vector<Mat4f>>;
 
+// Render relevant state of one entity with a ModelComponent and Instances, copied out of the ECS when a frame is
+// extracted. Nothing past extraction reads the components, so systems may change them while the frame is prepared
+// and drawn.
 struct RenderableInstance {
-    ModelComponent* model{nullptr};
-    Instances* instances{nullptr};
-    Visibility* visibility{nullptr};
-    ShadowCaster* shadow{nullptr};
-    Transparency* transparency{nullptr};
+    ecs::ID entity{ecs::INVALID_ID};
+    std::shared_ptr<MeshData> mesh;
+    // mesh drawn into the software occlusion buffer, null when the entity is no enabled occluder
+    std::shared_ptr<MeshData> occluder_mesh;
+    bool double_sided{false};
+    bool allow_instancing{true};
+    // the model and its ShadowCaster component both cast shadows
+    bool casts_shadows{false};
     bool transparent{false};
+
+    std::size_t instance_count{0};
+    InstanceTransforms transforms;
+
+    // scene index state of the entity, bounds are only valid when indexed
+    bool indexed{false};
+    bool is_static{false};
+    AABB bounds;
+    // indexed bounds against the camera frustum: touching it at all, and fully inside
+    bool in_frustum{false};
+    bool inside_frustum{false};
+
+    [[nodiscard]] const Mat4f* matrices() const { return transforms ? transforms->data() : nullptr; }
 };
 
 using RenderableList = std::vector<RenderableInstance>;
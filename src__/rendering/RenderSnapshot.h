@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <ecs.h>
+
+#include "RenderScene.h"
+#include "../lighting/directional_light.h"
+#include "../lighting/point_light.h"
+#include "../lighting/spot_light.h"
+#include "../math/bounds.h"
+#include "../math/mat.h"
+#include "../math/transformation.h"
+
+// copy of an enabled light component and its global transform, without parent
+template<typename Light>
+struct LightSnapshot {
+    ecs::ID entity{ecs::INVALID_ID};
+    Light light;
+    Transformation transform;
+};
+
+// Render relevant ECS state of one frame, copied out on the simulation thread. Once a snapshot is extracted the
+// systems may change the world again, preparing and drawing the frame only reads the snapshot. Snapshots are reused
+// in a ring between the simulation and the render side, three of them with the default two frames in flight.
+struct RenderSnapshot {
+    std::uint64_t frame{0};
+    // framebuffer size, queried on the thread owning the window
+    int viewport_width{0};
+    int viewport_height{0};
+
+    bool camera_valid{false};
+    Mat4f view_matrix{Mat4f::eye()};
+    Mat4f projection_matrix{Mat4f::eye()};
+    Vec3f camera_position{0.0f, 0.0f, 0.0f};
+
+    RenderableList renderables;
+    std::vector<LightSnapshot<DirectionalLight>> directional_lights;
+    std::vector<LightSnapshot<SpotLight>> spot_lights;
+    std::vector<LightSnapshot<PointLight>> point_lights;
+    // world boxes whose static content changed since the previous snapshot
+    std::vector<AABB> static_changes;
+};
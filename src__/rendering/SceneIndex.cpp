@@ -0,0 +1,128 @@
+#include "SceneIndex.h"
+
+#include <algorithm>
+
+#include "components/Instances.h"
+#include "components/ModelComponent.h"
+#include "components/Visible.h"
+#include "../math/transformation.h"
+#include "../resources/mesh_data.h"
+
+SceneIndex::SceneIndex() : tree_(0.5f) {}
+
+namespace {
+bool same_bounds(const AABB& a, const AABB& b) {
+    for (int i = 0; i < 3; ++i) {
+        if (a.min[i] != b.min[i] || a.max[i] != b.max[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+void SceneIndex::update(ecs::ECS& ecs) {
+    ++stamp_;
+    static_changes_.clear();
+    for (auto& entity : ecs.each<ModelComponent>()) {
+        auto* model = entity.get<ModelComponent>();
+        auto* instances = entity.get<Instances>();
+        auto* transform = entity.get<Transformation>();
+        if (!model || !model->mesh || !model->mesh->bounds().valid() || (!instances && !transform)) {
+            continue;
+        }
+        if (instances && instances->empty()) {
+            continue;
+        }
+
+        ecs::ID id = model->component_id.id;
+        auto it = entries_.find(id);
+        bool known = it != entries_.end() && it->second.mesh == model->mesh.get();
+        if (it != entries_.end()) {
+            it->second.stamp = stamp_;
+        }
+        // instance matrices only change through Instances, which flags itself dirty until the next sync
+        if (known && instances && !instances->dirty()) {
+            continue;
+        }
+
+        const AABB& local = model->mesh->bounds();
+        AABB world;
+        if (instances) {
+            for (const auto& matrix : instances->transforms()) {
+                world.expand(local.transformed(matrix));
+            }
+        } else {
+            world = local.transformed(transform->global_matrix());
+        }
+
+        if (it == entries_.end()) {
+            // new entities start out static so scenes loaded in one go are cached right away
+            Entry entry;
+            entry.proxy = tree_.insert(world, id);
+            entry.mesh = model->mesh.get();
+            entry.stamp = stamp_;
+            entry.moved_stamp = stamp_ >= kSettleUpdates ? stamp_ - kSettleUpdates : 0;
+            entry.bounds = world;
+            entries_.emplace(id, entry);
+            static_changes_.push_back(world);
+        } else {
+            // a dirty instance set may move instances without changing the combined box
+            bool moved = !known || instances || !same_bounds(world, it->second.bounds);
+            if (!moved) {
+                continue;
+            }
+            if (is_static(id)) {
+                static_changes_.push_back(it->second.bounds);
+            }
+            it->second.mesh = model->mesh.get();
+            it->second.moved_stamp = stamp_;
+            it->second.bounds = world;
+            tree_.update(it->second.proxy, world);
+        }
+    }
+
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.stamp != stamp_) {
+            if (is_static(it->first)) {
+                static_changes_.push_back(it->second.bounds);
+            }
+            tree_.remove(it->second.proxy);
+            it = entries_.erase(it);
+            continue;
+        }
+        if (stamp_ - it->second.moved_stamp == kSettleUpdates) {
+            static_changes_.push_back(it->second.bounds);
+        }
+        ++it;
+    }
+}
+
+void SceneIndex::clear() {
+    tree_.clear();
+    entries_.clear();
+    static_changes_.clear();
+}
+
+void SceneIndex::query(const AABB& box, std::vector<ecs::EntityID>& result) const {
+    tree_.query(box, [&result](std::size_t id) { result.push_back(ecs::EntityID{id}); });
+}
+
+void SceneIndex::query(const BoundingSphere& sphere, std::vector<ecs::EntityID>& result) const {
+    tree_.query(sphere, [&result](std::size_t id) { result.push_back(ecs::EntityID{id}); });
+}
+
+void SceneIndex::query(const Frustum& frustum, std::vector<ecs::EntityID>& result) const {
+    tree_.query(frustum, [&result](std::size_t id, bool) { result.push_back(ecs::EntityID{id}); });
+}
+
+void SceneIndex::ray_cast(const Vec3f& origin, const Vec3f& direction, float max_distance,
+                          std::vector<ecs::EntityID>& result) const {
+    std::vector<std::pair<float, std::size_t>> hits;
+    tree_.ray_cast(origin, direction, max_distance,
+                   [&hits](std::size_t id, float distance) { hits.emplace_back(distance, id); });
+    std::sort(hits.begin(), hits.end());
+    for (const auto& hit : hits) {
+        result.push_back(ecs::EntityID{hit.second});
+    }
+}
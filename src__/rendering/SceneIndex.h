@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <ecs.h>
+
+#include "../math/aabb_tree.h"
+#include "../math/bounds.h"
+
+class MeshData;
+
+// Spatial index over all entities with a ModelComponent, keyed by entity id. World bounds are the mesh bounds
+// transformed by every instance matrix, or by the entity Transformation when it has no Instances component.
+// Must be updated before the frame's instance transforms are copied (MasterRenderer::instance_transforms), which
+// clears the instance dirty flags used to detect movement.
+// Entities that have not moved for kSettleUpdates updates count as static, caches of static content (e.g. static
+// shadow maps) are invalidated through static_changes().
+class SceneIndex {
+  public:
+    static constexpr std::uint64_t kSettleUpdates = 8;
+
+    SceneIndex();
+
+    void update(ecs::ECS& ecs);
+    void clear();
+
+    [[nodiscard]] bool contains(ecs::ID entity) const { return entries_.count(entity) != 0; }
+    // enlarged world bounds of the entity as stored in the tree, nullptr if not indexed
+    [[nodiscard]] const AABB* bounds(ecs::ID entity) const {
+        auto it = entries_.find(entity);
+        return it == entries_.end() ? nullptr : &tree_.fat_bounds(it->second.proxy);
+    }
+    [[nodiscard]] bool is_static(ecs::ID entity) const {
+        auto it = entries_.find(entity);
+        return it != entries_.end() && stamp_ - it->second.moved_stamp >= kSettleUpdates;
+    }
+    // world boxes whose static content changed in the last update: static entities that started moving, moving
+    // entities that settled, and static entities that appeared or were removed
+    [[nodiscard]] const std::vector<AABB>& static_changes() const { return static_changes_; }
+    [[nodiscard]] std::size_t size() const { return tree_.size(); }
+    [[nodiscard]] const AABBTree& tree() const { return tree_; }
+
+    void query(const AABB& box, std::vector<ecs::EntityID>& result) const;
+    void query(const BoundingSphere& sphere, std::vector<ecs::EntityID>& result) const;
+    void query(const Frustum& frustum, std::vector<ecs::EntityID>& result) const;
+    // entities hit by the ray, sorted by entry distance into their bounds
+    void ray_cast(const Vec3f& origin, const Vec3f& direction, float max_distance,
+                  std::vector<ecs::EntityID>& result) const;
+
+  private:
+    struct Entry {
+        int proxy{AABBTree::kNullNode};
+        const MeshData* mesh{nullptr};
+        std::uint64_t stamp{0};
+        std::uint64_t moved_stamp{0};
+        AABB bounds;
+    };
+
+    AABBTree tree_;
+    std::unordered_map<ecs::ID, Entry> entries_;
+    std::uint64_t stamp_{0};
+    std::vector<AABB> static_changes_;
+};
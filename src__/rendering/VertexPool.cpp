@@ -0,0 +1,122 @@
+#include "VertexPool.h"
+
+#include <string>
+
+#include "../logging/logging.h"
+
+VertexPool::VertexPool() = default;
+
+VertexPool::~VertexPool() = default;
+
+void VertexPool::sync(const std::vector<MeshBatch>& batches) {
+    ++stamp_;
+    bool stale = false;
+    for (const auto& batch : batches) {
+        if (!batch.mesh) {
+            continue;
+        }
+        auto it = entries_.find(batch.mesh);
+        if (it == entries_.end()) {
+            dirty_ |= append(batch.mesh);
+            continue;
+        }
+        // a reloaded or different mesh at the same address invalidates its range
+        stale |= it->second.generation != batch.mesh->gpu_generation();
+        it->second.used_stamp = stamp_;
+    }
+    // entries of meshes culled for a while stay, the ones of released meshes would otherwise pile up forever
+    for (const auto& [mesh, entry] : entries_) {
+        stale |= stamp_ - entry.used_stamp >= kEvictSyncs;
+    }
+    if (stale) {
+        rebuild(batches);
+    }
+    if (!dirty_) {
+        return;
+    }
+    vertex_buffer_.update_data(static_cast<GLsizeiptr>(vertices_.size() * sizeof(GpuVertex)), vertices_.data(),
+                               static_cast<GLenum>(GL_STATIC_DRAW));
+    vao_.bind();
+    index_buffer_.store_indices(indices_);
+    vao_.unbind();
+    dirty_ = false;
+    logging::log(0, logging::DEBUG,
+                 "VertexPool: pooled " + std::to_string(entries_.size()) + " meshes, " +
+                     std::to_string(vertices_.size()) + " vertices and " + std::to_string(indices_.size()) +
+                     " indices");
+}
+
+void VertexPool::bind() {
+    vertex_buffer_.bind(kVertexBinding);
+    vao_.bind();
+}
+
+void VertexPool::unbind() { vao_.unbind(); }
+
+const VertexPool::Range* VertexPool::find(const MeshData* mesh) const {
+    auto it = entries_.find(mesh);
+    return it != entries_.end() ? &it->second.range : nullptr;
+}
+
+void VertexPool::draw_instanced(const Range& range, GLsizei instance_count, GLuint base_instance) const {
+    if (instance_count <= 0 || range.index_count == 0) {
+        return;
+    }
+    glDrawElementsInstancedBaseVertexBaseInstance(
+        GL_TRIANGLES, static_cast<GLsizei>(range.index_count), GL_UNSIGNED_INT,
+        reinterpret_cast<const void*>(static_cast<std::uintptr_t>(range.first_index) * sizeof(std::uint32_t)),
+        instance_count, range.base_vertex, base_instance);
+}
+
+bool VertexPool::append(const MeshData* mesh) {
+    const auto& geometry = mesh->geometry();
+    std::size_t vertex_count = mesh->vertex_count();
+    if (vertex_count == 0 || geometry.indices.size() < 3 || geometry.normals.size() < vertex_count * 3) {
+        logging::log(0, logging::WARNING,
+                     "VertexPool: no geometry in RAM for " + mesh->get_path() + ", mesh is not drawn");
+        return false;
+    }
+
+    Entry entry;
+    entry.generation = mesh->gpu_generation();
+    entry.used_stamp = stamp_;
+    entry.range.first_index = static_cast<std::uint32_t>(indices_.size());
+    entry.range.index_count = static_cast<std::uint32_t>(geometry.indices.size());
+    entry.range.base_vertex = static_cast<std::int32_t>(vertices_.size());
+
+    bool has_uvs = geometry.texcoords.size() >= vertex_count * 2;
+    bool has_materials = geometry.material_slots.size() >= vertex_count;
+    vertices_.reserve(vertices_.size() + vertex_count);
+    for (std::size_t i = 0; i < vertex_count; ++i) {
+        GpuVertex vertex{};
+        for (int axis = 0; axis < 3; ++axis) {
+            vertex.position[axis] = geometry.positions[i * 3 + axis];
+            vertex.normal[axis] = geometry.normals[i * 3 + axis];
+        }
+        if (has_uvs) {
+            vertex.texcoord[0] = geometry.texcoords[i * 2 + 0];
+            vertex.texcoord[1] = geometry.texcoords[i * 2 + 1];
+        }
+        // what the mesh VAO's material attribute reads, 0 when it is disabled
+        vertex.material = has_materials ? mesh->gpu_material_id(geometry.material_slots[i]) : 0;
+        vertices_.push_back(vertex);
+    }
+
+    // indices stay mesh local, the draw adds the base vertex
+    indices_.insert(indices_.end(), geometry.indices.begin(), geometry.indices.end());
+
+    entries_.emplace(mesh, entry);
+    return true;
+}
+
+void VertexPool::rebuild(const std::vector<MeshBatch>& batches) {
+    entries_.clear();
+    vertices_.clear();
+    indices_.clear();
+    for (const auto& batch : batches) {
+        if (batch.mesh && entries_.find(batch.mesh) == entries_.end()) {
+            append(batch.mesh);
+        }
+    }
+    dirty_ = true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "RenderBatchBuilder.h"
+#include "../gldata/ssbo_data.h"
+#include "../gldata/vao_data.h"
+#include "../gldata/vbo_data.h"
+
+// Vertex and index pool for programmable vertex pulling. Every mesh drawn through the pool is appended once; vertex
+// shaders read its attributes from kVertexBinding by gl_VertexID (see shader/vertex_pull.glsl), so all meshes draw with
+// the single pool VAO bound, which only holds the pooled index buffer. A draw picks its mesh by first index and base
+// vertex, which also makes the draws of different meshes candidates for one multi-draw call.
+class VertexPool {
+  public:
+    static constexpr GLuint kVertexBinding = 15;
+
+    // where a mesh lives in the pool, in the units of DrawElementsIndirectCommand
+    struct Range {
+        std::uint32_t first_index{0};
+        std::uint32_t index_count{0};
+        std::int32_t base_vertex{0};
+    };
+
+    VertexPool();
+    ~VertexPool();
+
+    // meshes missing from the batches for this many syncs are evicted by compacting the pool
+    static constexpr std::uint64_t kEvictSyncs = 240;
+
+    // appends meshes of the batches that are not pooled yet and uploads the pool if it changed. The pool is rebuilt
+    // from the batches when a mesh was reloaded or has gone unused for kEvictSyncs syncs.
+    void sync(const std::vector<MeshBatch>& batches);
+    // binds the vertex SSBO and the pool VAO, draws through the pool expect both to stay bound
+    void bind();
+    void unbind();
+
+    // nullptr when the mesh's geometry is not available
+    [[nodiscard]] const Range* find(const MeshData* mesh) const;
+    void draw_instanced(const Range& range, GLsizei instance_count, GLuint base_instance) const;
+
+    [[nodiscard]] std::size_t vertex_count() const { return vertices_.size(); }
+    [[nodiscard]] std::size_t index_count() const { return indices_.size(); }
+
+  private:
+    // std430 layout of PulledVertex in shader/vertex_pull.glsl
+    struct GpuVertex {
+        float position[3];
+        float normal[3];
+        float texcoord[2];
+        std::int32_t material;
+    };
+    static_assert(sizeof(GpuVertex) == 36, "GpuVertex must match the std430 layout of PulledVertex");
+
+    struct Entry {
+        Range range;
+        // MeshData::gpu_generation when pooled, the key address alone may belong to a newer mesh
+        std::uint64_t generation{0};
+        std::uint64_t used_stamp{0};
+    };
+
+    bool append(const MeshData* mesh);
+    void rebuild(const std::vector<MeshBatch>& batches);
+
+    std::unordered_map<const MeshData*, Entry> entries_;
+    std::vector<GpuVertex> vertices_;
+    std::vector<std::uint32_t> indices_;
+    std::uint64_t stamp_{0};
+    bool dirty_{false};
+
+    SSBOData vertex_buffer_;
+    VAOData vao_;
+    VBOData index_buffer_;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <ecs.h>
+
+#include <memory>
+#include <utility>
+
+#include "../../resources/mesh_data.h"
+
+// Marks an entity as occluder for the CPU occlusion rasterizer. Without a proxy mesh the model mesh itself is drawn,
+// a simplified proxy (fully inside the visual mesh) keeps the rasterization cost low.
+struct Occluder : ecs::ComponentOf<Occluder> {
+    explicit Occluder(bool enabled = true) : enabled(enabled) {}
+    explicit Occluder(std::shared_ptr<MeshData> proxy_mesh) : proxy(std::move(proxy_mesh)) {}
+
+    std::shared_ptr<MeshData> proxy;
+    bool enabled{true};
+};
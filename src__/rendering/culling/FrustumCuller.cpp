@@ -0,0 +1,213 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define F3D_CULL_SSE 1
+#endif
+
+#include "OcclusionRasterizer.h"
+#include "../../core/worker_pool.h"
+#include "../../logging/logging.h"
+
+namespace {
+// instances per job, large enough to amortise scheduling but small enough to balance a single huge renderable
+constexpr std::size_t kJobSize = 2048;
+
+#ifdef F3D_CULL_SSE
+inline __m128 gather(const Mat4f* m, std::size_t count, int row, int col) {
+    // lanes past count repeat the first matrix, their results are masked out by the caller
+    float v[4];
+    for (std::size_t i = 0; i < 4; ++i) {
+        v[i] = m[i < count ? i : 0](row, col);
+    }
+    return _mm_loadu_ps(v);
+}
+#endif
+
+// appends the indices in [begin, end) whose world space sphere intersects the frustum, returns the rejected count
+std::size_t cull_instances(const Mat4f* matrices, std::size_t begin, std::size_t end, const BoundingSphere& sphere,
+                           const Frustum& frustum, std::vector<std::uint32_t>& visible) {
+    std::size_t rejected = 0;
+    std::size_t i = begin;
+#ifdef F3D_CULL_SSE
+    const __m128 lx = _mm_set1_ps(sphere.center[0]);
+    const __m128 ly = _mm_set1_ps(sphere.center[1]);
+    const __m128 lz = _mm_set1_ps(sphere.center[2]);
+    const __m128 lr = _mm_set1_ps(sphere.radius);
+
+    for (; i < end; i += 4) {
+        std::size_t count = std::min<std::size_t>(4, end - i);
+        const Mat4f* m = matrices + i;
+
+        __m128 center[3];
+        __m128 max_scale_sq = _mm_setzero_ps();
+        for (int row = 0; row < 3; ++row) {
+            center[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gather(m, count, row, 0), lx), _mm_mul_ps(gather(m, count, row, 1), ly)),
+                                     _mm_add_ps(_mm_mul_ps(gather(m, count, row, 2), lz), gather(m, count, row, 3)));
+        }
+        for (int col = 0; col < 3; ++col) {
+            __m128 a = gather(m, count, 0, col);
+            __m128 b = gather(m, count, 1, col);
+            __m128 c = gather(m, count, 2, col);
+            __m128 len_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+            max_scale_sq = _mm_max_ps(max_scale_sq, len_sq);
+        }
+        __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(lr, _mm_sqrt_ps(max_scale_sq)));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto& plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), center[0]), _mm_mul_ps(_mm_set1_ps(plane[1]), center[1])),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), center[2]), _mm_set1_ps(plane[3])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_radius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (std::size_t lane = 0; lane < count; ++lane) {
+            if (mask & (1 << lane)) {
+                visible.push_back(static_cast<std::uint32_t>(i + lane));
+            } else {
+                ++rejected;
+            }
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        if (frustum.intersects(sphere.transformed(matrices[i]))) {
+            visible.push_back(static_cast<std::uint32_t>(i));
+        } else {
+            ++rejected;
+        }
+    }
+    return rejected;
+}
+} // namespace
+
+FrustumCuller::FrustumCuller(WorkerPool* pool) : pool_(pool) {}
+
+FrustumCuller::~FrustumCuller() = default;
+
+void FrustumCuller::cull(const RenderableList& renderables, const Frustum& frustum) {
+    stats_ = CullingStats{};
+    results_.resize(renderables.size());
+    jobs_.clear();
+
+    bool occlusion = enabled_ && occlusion_ && occlusion_->has_occluders();
+
+    for (std::size_t renderable_index = 0; renderable_index < renderables.size(); ++renderable_index) {
+        const auto& renderable = renderables[renderable_index];
+        auto& result = results_[renderable_index];
+        result.entity = renderable.entity;
+        result.culled = false;
+        result.indices.clear();
+
+        if (!enabled_ || !renderable.transforms || !renderable.mesh) {
+            continue;
+        }
+        // meshes without bounds (not loaded yet or empty) are never rejected
+        if (renderable.mesh->bounding_sphere().radius <= 0.0f) {
+            continue;
+        }
+        std::size_t count = renderable.instance_count;
+        if (renderable.indexed) {
+            if (!renderable.in_frustum) {
+                result.culled = true;
+                stats_.tested += count;
+                stats_.rejected += count;
+                continue;
+            }
+            if (occlusion && !occlusion_->is_visible(renderable.bounds)) {
+                result.culled = true;
+                stats_.tested += count;
+                stats_.rejected += count;
+                stats_.occluded += count;
+                continue;
+            }
+            // fully inside entities still need per instance occlusion tests
+            if (renderable.inside_frustum && !occlusion) {
+                stats_.tested += count;
+                continue;
+            }
+        }
+        result.culled = true;
+        for (std::size_t begin = 0; begin < count; begin += kJobSize) {
+            Job job;
+            job.renderable = renderable_index;
+            job.begin = begin;
+            job.end = std::min(begin + kJobSize, count);
+            jobs_.push_back(std::move(job));
+        }
+    }
+
+    if (jobs_.empty()) {
+        log_stats();
+        return;
+    }
+
+    auto run_jobs = [this, &renderables, &frustum, occlusion](std::size_t begin, std::size_t end) {
+        for (std::size_t j = begin; j < end; ++j) {
+            auto& job = jobs_[j];
+            const auto& renderable = renderables[job.renderable];
+            job.visible.clear();
+            job.visible.reserve(job.end - job.begin);
+            const auto& sphere = renderable.mesh->bounding_sphere();
+            const Mat4f* matrices = renderable.matrices();
+            job.rejected = cull_instances(matrices, job.begin, job.end, sphere, frustum, job.visible);
+            job.occluded = 0;
+            if (occlusion) {
+                auto occluded = [this, matrices, &sphere](std::uint32_t i) {
+                    return !occlusion_->is_visible(sphere.transformed(matrices[i]));
+                };
+                auto last = std::remove_if(job.visible.begin(), job.visible.end(), occluded);
+                job.occluded = static_cast<std::size_t>(job.visible.end() - last);
+                job.rejected += job.occluded;
+                job.visible.erase(last, job.visible.end());
+            }
+        }
+    };
+    if (pool_) {
+        pool_->parallel_for(jobs_.size(), 1, run_jobs);
+    } else {
+        run_jobs(0, jobs_.size());
+    }
+
+    // jobs are ordered by renderable and range, so appending keeps the indices sorted
+    for (const auto& job : jobs_) {
+        auto& indices = results_[job.renderable].indices;
+        indices.insert(indices.end(), job.visible.begin(), job.visible.end());
+        stats_.tested += job.end - job.begin;
+        stats_.rejected += job.rejected;
+        stats_.occluded += job.occluded;
+    }
+
+    log_stats();
+}
+
+void FrustumCuller::log_stats() const {
+    logging::log(0, logging::DEBUG,
+                 "FrustumCuller: tested " + std::to_string(stats_.tested) + " instances, rejected " +
+                     std::to_string(stats_.rejected) + " (" + std::to_string(stats_.occluded) + " occluded)");
+}
+
+void FrustumCuller::upload(std::vector<MeshBatch>& batches, GLuint binding) {
+    staging_.clear();
+    for (auto& batch : batches) {
+        if (!batch.remapped) {
+            continue;
+        }
+        auto offset = static_cast<GLuint>(staging_.size());
+        staging_.insert(staging_.end(), batch.visible_instances.begin(), batch.visible_instances.end());
+        for (auto& draw : batch.draws) {
+            draw.base_instance += offset;
+        }
+    }
+    if (staging_.empty()) {
+        staging_.push_back(0);
+    }
+    visible_buffer_.update_data(static_cast<GLsizeiptr>(staging_.size() * sizeof(GLuint)), staging_.data(),
+                                static_cast<GLenum>(GL_STREAM_DRAW));
+    visible_buffer_.bind(binding);
+}
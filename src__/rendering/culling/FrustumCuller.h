@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "VisibleInstances.h"
+#include "../RenderBatchBuilder.h"
+#include "../RenderScene.h"
+#include "../../gldata/ssbo_data.h"
+#include "../../math/bounds.h"
+
+class OcclusionRasterizer;
+class WorkerPool;
+
+struct CullingStats {
+    std::size_t tested{0};
+    std::size_t rejected{0};
+    // part of rejected that passed the frustum but was hidden behind occluders
+    std::size_t occluded{0};
+
+    [[nodiscard]] std::size_t visible() const { return tested - rejected; }
+};
+
+// CPU culling stage run before InstanceBuffer::pack. Tests the bounding sphere of every instance against the view
+// frustum four at a time with SSE, spread across the worker pool, and keeps a compacted index list per renderable.
+// Batches built from these lists are uploaded to the same remap binding the GPU culler uses. Indexed entities are
+// accepted or rejected whole by the frustum test of the scene index tree recorded at extraction, and only those
+// crossing a plane are tested per instance.
+class FrustumCuller {
+  public:
+    explicit FrustumCuller(WorkerPool* pool = nullptr);
+    ~FrustumCuller();
+
+    void set_enabled(bool enabled) { enabled_ = enabled; }
+    bool enabled() const { return enabled_; }
+
+    // instances surviving the frustum test are also tested against the occluder depth of the rasterizer
+    void set_occlusion(const OcclusionRasterizer* occlusion) { occlusion_ = occlusion; }
+
+    void cull(const RenderableList& renderables, const Frustum& frustum);
+
+    const VisibleInstanceLists& results() const { return results_; }
+    // hands the lists of the last cull to a frame packet, taking back the storage of the packet's previous lists
+    void take_results(VisibleInstanceLists& lists) { lists.swap(results_); }
+    const CullingStats& stats() const { return stats_; }
+
+    // rewrites the draws of remapped batches to offsets into the uploaded remap buffer and binds it; pass
+    // GpuCuller::kCandidateInstanceBinding to feed the lists into the GPU culler instead of drawing them directly
+    void upload(std::vector<MeshBatch>& batches, GLuint binding);
+
+  private:
+    struct Job {
+        std::size_t renderable{0};
+        std::size_t begin{0};
+        std::size_t end{0};
+        std::size_t rejected{0};
+        // instances of this job dropped by the occlusion test, summed into CullingStats::occluded
+        std::size_t occluded{0};
+        std::vector<std::uint32_t> visible;
+    };
+
+    void log_stats() const;
+
+    WorkerPool* pool_{nullptr};
+    const OcclusionRasterizer* occlusion_{nullptr};
+    bool enabled_{true};
+
+    VisibleInstanceLists results_;
+    std::vector<Job> jobs_;
+    CullingStats stats_;
+
+    SSBOData visible_buffer_;
+    std::vector<GLuint> staging_;
+};
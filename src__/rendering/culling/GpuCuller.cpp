@@ -0,0 +1,179 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <string>
+
+#include "HiZBuffer.h"
+#include "../VertexPool.h"
+#include "../../logging/logging.h"
+
+namespace {
+constexpr GLuint kWorkGroupSize = 64;
+constexpr GLuint kRangeBinding = 4;
+constexpr GLuint kBatchBinding = 5;
+constexpr GLuint kCommandBinding = 6;
+constexpr GLuint kHistoryBinding = 7;
+constexpr GLuint kHiZTextureUnit = 0;
+} // namespace
+
+GpuCuller::GpuCuller() : shader_(std::make_unique<CullingShader>()) {}
+
+GpuCuller::~GpuCuller() = default;
+
+bool GpuCuller::init(const std::filesystem::path& shader_dir) {
+    ready_ = shader_->init(shader_dir);
+    return ready_;
+}
+
+void GpuCuller::cull(const std::vector<MeshBatch>& batches, InstanceBuffer& instance_buffer,
+                     const Mat4f& view_projection, float lod_scale, OcclusionPhase phase, const HiZBuffer* hiz,
+                     const VertexPool* vertex_pool) {
+    if (phase == OcclusionPhase::Late && (!hiz || !hiz->valid())) {
+        logging::log(0, logging::WARNING, "GpuCuller: late occlusion phase without a Hi-Z pyramid");
+        phase = OcclusionPhase::None;
+    }
+    active_pass_ = phase == OcclusionPhase::Late ? 1 : 0;
+    auto& pass = passes_[active_pass_];
+    auto& commands = pass.commands;
+    pass.pooled = vertex_pool != nullptr;
+
+    ranges_.clear();
+    batch_bounds_.clear();
+    commands.clear();
+
+    GLuint total_instances = 0;
+    for (std::size_t batch_index = 0; batch_index < batches.size(); ++batch_index) {
+        const auto& batch = batches[batch_index];
+
+        DrawElementsIndirectCommand command;
+        command.base_instance = total_instances;
+
+        CullBatch bounds;
+        if (batch.mesh) {
+            const auto& sphere = batch.mesh->bounding_sphere();
+            bounds.bounding_sphere[0] = sphere.center[0];
+            bounds.bounding_sphere[1] = sphere.center[1];
+            bounds.bounding_sphere[2] = sphere.center[2];
+            bounds.bounding_sphere[3] = sphere.radius;
+            command.count = static_cast<GLuint>(batch.mesh->index_count());
+            if (vertex_pool) {
+                // meshes missing from the pool get an empty command and are skipped by draw()
+                const auto* range = vertex_pool->find(batch.mesh);
+                command.count = range ? range->index_count : 0;
+                command.first_index = range ? range->first_index : 0;
+                command.base_vertex = range ? range->base_vertex : 0;
+            }
+        }
+
+        for (const auto& draw : batch.draws) {
+            if (draw.instance_count <= 0) {
+                continue;
+            }
+            if (static_cast<std::size_t>(draw.base_instance) + draw.instance_count > instance_buffer.total_instances()) {
+                logging::log(0, logging::ERROR,
+                             "GpuCuller: draw range exceeds SSBO (base=" + std::to_string(draw.base_instance) +
+                                 ", count=" + std::to_string(draw.instance_count) + ")");
+                continue;
+            }
+            // non-instanced models emit one range per instance; merge neighbours to keep the range table small
+            if (!ranges_.empty() && ranges_.back().batch_index == batch_index &&
+                ranges_.back().first_instance + ranges_.back().instance_count == draw.base_instance) {
+                ranges_.back().instance_count += static_cast<GLuint>(draw.instance_count);
+            } else {
+                CullRange range;
+                range.first_instance = draw.base_instance;
+                range.instance_count = static_cast<GLuint>(draw.instance_count);
+                range.batch_index = static_cast<GLuint>(batch_index);
+                range.thread_offset = total_instances;
+                ranges_.push_back(range);
+            }
+            total_instances += static_cast<GLuint>(draw.instance_count);
+        }
+
+        batch_bounds_.push_back(bounds);
+        commands.push_back(command);
+    }
+
+    if (commands.empty()) {
+        return;
+    }
+
+    range_buffer_.update_data(static_cast<GLsizeiptr>(std::max<std::size_t>(ranges_.size(), 1) * sizeof(CullRange)),
+                              ranges_.empty() ? nullptr : ranges_.data(), static_cast<GLenum>(GL_STREAM_DRAW));
+    batch_buffer_.update_data(static_cast<GLsizeiptr>(batch_bounds_.size() * sizeof(CullBatch)), batch_bounds_.data(),
+                              static_cast<GLenum>(GL_STREAM_DRAW));
+    pass.command_buffer.update_data(static_cast<GLsizeiptr>(commands.size() * sizeof(DrawElementsIndirectCommand)),
+                                    commands.data(), static_cast<GLenum>(GL_DYNAMIC_DRAW));
+    if (total_instances > pass.visible_capacity || pass.visible_capacity == 0) {
+        pass.visible_capacity = std::max<std::size_t>(total_instances, 1);
+        pass.visible_buffer.update_data(static_cast<GLsizeiptr>(pass.visible_capacity * sizeof(GLuint)), nullptr,
+                                        static_cast<GLenum>(GL_DYNAMIC_DRAW));
+    }
+    if (phase != OcclusionPhase::None && history_size_ != instance_buffer.total_instances()) {
+        // layout changed, treat everything as visible so the early phase does not drop anything for a frame
+        history_size_ = instance_buffer.total_instances();
+        std::vector<GLuint> history(std::max<std::size_t>(history_size_, 1), 1u);
+        history_buffer_.update_data(static_cast<GLsizeiptr>(history.size() * sizeof(GLuint)), history.data(),
+                                    static_cast<GLenum>(GL_DYNAMIC_DRAW));
+    }
+
+    if (total_instances == 0) {
+        return;
+    }
+
+    shader_->start();
+    shader_->set_frustum(Frustum(view_projection));
+    shader_->set_range_count(static_cast<GLuint>(ranges_.size()), total_instances);
+    shader_->set_lod_params(lod_scale, min_pixel_radius_);
+    shader_->set_occlusion_phase(static_cast<int>(phase));
+    shader_->set_candidate_remap(std::any_of(batches.begin(), batches.end(),
+                                             [](const MeshBatch& batch) { return batch.remapped; }));
+    if (phase == OcclusionPhase::Late) {
+        shader_->set_hiz(view_projection, hiz->width(), hiz->height(), hiz->levels(), kHiZTextureUnit);
+        glActiveTexture(GL_TEXTURE0 + kHiZTextureUnit);
+        glBindTexture(GL_TEXTURE_2D, hiz->texture());
+    }
+
+    instance_buffer.bind(0);
+    pass.visible_buffer.bind(kVisibleInstanceBinding);
+    range_buffer_.bind(kRangeBinding);
+    batch_buffer_.bind(kBatchBinding);
+    pass.command_buffer.bind(kCommandBinding);
+    if (phase != OcclusionPhase::None) {
+        history_buffer_.bind(kHistoryBinding);
+    }
+
+    glDispatchCompute((total_instances + kWorkGroupSize - 1) / kWorkGroupSize, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    shader_->stop();
+    if (phase == OcclusionPhase::Late) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    logging::log(0, logging::DEBUG,
+                 "GpuCuller: dispatched " + std::to_string(total_instances) + " instances over " +
+                     std::to_string(ranges_.size()) + " ranges into " + std::to_string(commands.size()) +
+                     " indirect commands (phase " + std::to_string(static_cast<int>(phase)) + ")");
+}
+
+void GpuCuller::begin_draw() {
+    auto& pass = passes_[active_pass_];
+    pass.visible_buffer.bind(kVisibleInstanceBinding);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, static_cast<GLuint>(pass.command_buffer));
+}
+
+void GpuCuller::draw(std::size_t batch_index, const MeshBatch& batch, MeshStream stream) const {
+    const auto& pass = passes_[active_pass_];
+    const auto& commands = pass.commands;
+    if (!batch.mesh || batch_index >= commands.size() || commands[batch_index].count == 0) {
+        return;
+    }
+    if (pass.pooled) {
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                               reinterpret_cast<const void*>(batch_index * sizeof(DrawElementsIndirectCommand)));
+        return;
+    }
+    batch.mesh->draw_indirect(static_cast<GLintptr>(batch_index * sizeof(DrawElementsIndirectCommand)), stream);
+}
+
+void GpuCuller::end_draw() { glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0); }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../InstanceBuffer.h"
+#include "../RenderBatchBuilder.h"
+#include "../../gldata/ssbo_data.h"
+#include "../../math/bounds.h"
+#include "../../shader/culling/CullingShader.h"
+
+class HiZBuffer;
+class VertexPool;
+
+struct DrawElementsIndirectCommand {
+    GLuint count{0};
+    GLuint instance_count{0};
+    GLuint first_index{0};
+    GLint base_vertex{0};
+    GLuint base_instance{0};
+};
+
+// Two pass occlusion culling: the early pass draws what was visible last frame, the Hi-Z pyramid is built from that
+// depth and the late pass tests everything against it, drawing only instances that became visible this frame.
+enum class OcclusionPhase { None, Early, Late };
+
+// Compute pre-pass that frustum and screen-size culls instances on the GPU and compacts the survivors into one
+// indirect draw command per batch. Vertex shaders fetch the surviving instance ids from kVisibleInstanceBinding.
+class GpuCuller {
+  public:
+    static constexpr GLuint kVisibleInstanceBinding = 1;
+    // instance slots of batches built from CPU culled lists (MeshBatch::remapped), read instead of the raw ranges
+    static constexpr GLuint kCandidateInstanceBinding = 8;
+
+    GpuCuller();
+    ~GpuCuller();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_enabled(bool enabled) { enabled_ = enabled; }
+    // stays off when the compute shader failed to build, its indirect commands would draw nothing
+    bool enabled() const { return enabled_ && ready_; }
+
+    // instances whose projected radius is smaller than this many pixels are dropped
+    void set_min_pixel_radius(float radius) { min_pixel_radius_ = radius; }
+
+    void set_occlusion_enabled(bool enabled) { occlusion_enabled_ = enabled; }
+    bool occlusion_enabled() const { return occlusion_enabled_; }
+
+    // lod_scale is projection(1,1) * 0.5 * viewport height, pass 0 to disable the screen size test (e.g. shadows).
+    // The late phase requires the Hi-Z pyramid of the depth written by the early phase draws. With a vertex pool the
+    // commands address the pooled meshes and draw() expects the pool to be bound instead of the mesh VAOs.
+    void cull(const std::vector<MeshBatch>& batches, InstanceBuffer& instance_buffer, const Mat4f& view_projection,
+              float lod_scale = 0.0f, OcclusionPhase phase = OcclusionPhase::None, const HiZBuffer* hiz = nullptr,
+              const VertexPool* vertex_pool = nullptr);
+
+    void begin_draw();
+    void draw(std::size_t batch_index, const MeshBatch& batch, MeshStream stream = MeshStream::Full) const;
+    void end_draw();
+
+  private:
+    struct CullRange {
+        GLuint first_instance{0};
+        GLuint instance_count{0};
+        GLuint batch_index{0};
+        GLuint thread_offset{0};
+    };
+
+    struct CullBatch {
+        float bounding_sphere[4]{0.0f, 0.0f, 0.0f, 0.0f};
+    };
+
+    // the late phase writes to its own buffers so it never overwrites data the early draws still read
+    struct PassBuffers {
+        SSBOData command_buffer;
+        SSBOData visible_buffer;
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::size_t visible_capacity{0};
+        // the commands were built against a VertexPool
+        bool pooled{false};
+    };
+
+    std::unique_ptr<CullingShader> shader_;
+
+    SSBOData range_buffer_;
+    SSBOData batch_buffer_;
+    // one flag per instance slot, set when the instance passed the last late phase
+    SSBOData history_buffer_;
+    std::size_t history_size_{0};
+
+    std::vector<CullRange> ranges_;
+    std::vector<CullBatch> batch_bounds_;
+    PassBuffers passes_[2];
+    std::size_t active_pass_{0};
+
+    bool enabled_{true};
+    bool ready_{false};
+    bool occlusion_enabled_{true};
+    float min_pixel_radius_{1.0f};
+};
@@ -0,0 +1,85 @@
+#include "HiZBuffer.h"
+
+#include <algorithm>
+#include <string>
+
+#include "../../logging/logging.h"
+
+namespace {
+constexpr GLuint kGroupSize = 8;
+}
+
+HiZBuffer::HiZBuffer() : shader_(std::make_unique<HiZShader>()) {}
+
+HiZBuffer::~HiZBuffer() = default;
+
+bool HiZBuffer::init(const std::filesystem::path& shader_dir) {
+    ready_ = shader_->init(shader_dir);
+    return ready_;
+}
+
+void HiZBuffer::resize(int width, int height) {
+    width_ = width;
+    height_ = height;
+    levels_ = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2) {
+        ++levels_;
+    }
+
+    TextureSpecification spec;
+    spec.type = TextureType::TEX_2D;
+    spec.internal_format = GL_R32F;
+    spec.data_format = GL_RED;
+    spec.data_type = GL_FLOAT;
+    spec.min_filter = GL_NEAREST_MIPMAP_NEAREST;
+    spec.mag_filter = GL_NEAREST;
+    spec.wrap_s = GL_CLAMP_TO_EDGE;
+    spec.wrap_t = GL_CLAMP_TO_EDGE;
+    spec.wrap_r = GL_CLAMP_TO_EDGE;
+    // allocates the full mip chain, the contents are written by the build pass
+    spec.generate_mipmaps = true;
+
+    pyramid_ = std::make_unique<TextureData>(TextureType::TEX_2D);
+    pyramid_->set_data(width, height, spec, nullptr);
+
+    logging::log(0, logging::DEBUG,
+                 "HiZBuffer: allocated " + std::to_string(width) + "x" + std::to_string(height) + " pyramid with " +
+                     std::to_string(levels_) + " levels");
+}
+
+void HiZBuffer::build(const TextureData& depth, int width, int height) {
+    if (!ready_ || width <= 0 || height <= 0) {
+        return;
+    }
+    if (!pyramid_ || width != width_ || height != height_) {
+        resize(width, height);
+    }
+
+    shader_->start();
+    glActiveTexture(GL_TEXTURE0);
+
+    int source_width = width_;
+    int source_height = height_;
+    for (int level = 0; level < levels_; ++level) {
+        int target_width = std::max(1, width_ >> level);
+        int target_height = std::max(1, height_ >> level);
+
+        if (level == 0) {
+            glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(depth));
+            shader_->set_source(0, source_width, source_height, true);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, texture());
+            shader_->set_source(level - 1, source_width, source_height, false);
+        }
+        glBindImageTexture(0, texture(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((target_width + kGroupSize - 1) / kGroupSize, (target_height + kGroupSize - 1) / kGroupSize, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        source_width = target_width;
+        source_height = target_height;
+    }
+
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    shader_->stop();
+}
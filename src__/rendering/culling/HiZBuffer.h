@@ -0,0 +1,39 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+
+#include <glad/glad.h>
+
+#include "../../gldata/texture_data.h"
+#include "../../shader/culling/HiZShader.h"
+
+// Max-depth mip pyramid of a depth attachment, sampled by the GPU culler to reject instances hidden behind
+// already rendered geometry. Level 0 matches the depth attachment, each level halves the previous one.
+class HiZBuffer {
+  public:
+    HiZBuffer();
+    ~HiZBuffer();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void build(const TextureData& depth, int width, int height);
+
+    // false when the build shader failed, build() is a no-op then
+    bool ready() const { return ready_; }
+    bool valid() const { return ready_ && pyramid_ != nullptr && levels_ > 0; }
+    GLuint texture() const { return pyramid_ ? static_cast<GLuint>(*pyramid_) : 0; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int levels() const { return levels_; }
+
+  private:
+    void resize(int width, int height);
+
+    std::unique_ptr<HiZShader> shader_;
+    std::unique_ptr<TextureData> pyramid_;
+    int width_{0};
+    int height_{0};
+    int levels_{0};
+    bool ready_{false};
+};
@@ -0,0 +1,318 @@
+#include "OcclusionRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define F3D_RASTER_SSE 1
+#endif
+
+#include "../../core/worker_pool.h"
+#include "../../logging/logging.h"
+
+namespace {
+constexpr int kBandRows = 16;
+constexpr std::size_t kInstancesPerJob = 64;
+constexpr float kMinClipW = 1e-4f;
+
+struct ClipVertex {
+    float x, y, z, w;
+};
+
+// clip space position of a point; ok is false when it lies in front of the near plane
+inline ClipVertex project(const Mat4f& m, float x, float y, float z) {
+    ClipVertex v;
+#ifdef F3D_RASTER_SSE
+    __m128 c0 = _mm_setr_ps(m(0, 0), m(1, 0), m(2, 0), m(3, 0));
+    __m128 c1 = _mm_setr_ps(m(0, 1), m(1, 1), m(2, 1), m(3, 1));
+    __m128 c2 = _mm_setr_ps(m(0, 2), m(1, 2), m(2, 2), m(3, 2));
+    __m128 c3 = _mm_setr_ps(m(0, 3), m(1, 3), m(2, 3), m(3, 3));
+    __m128 clip = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(x)), _mm_mul_ps(c1, _mm_set1_ps(y))),
+                             _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(z)), c3));
+    float out[4];
+    _mm_storeu_ps(out, clip);
+    v = ClipVertex{out[0], out[1], out[2], out[3]};
+#else
+    v.x = m(0, 0) * x + m(0, 1) * y + m(0, 2) * z + m(0, 3);
+    v.y = m(1, 0) * x + m(1, 1) * y + m(1, 2) * z + m(1, 3);
+    v.z = m(2, 0) * x + m(2, 1) * y + m(2, 2) * z + m(2, 3);
+    v.w = m(3, 0) * x + m(3, 1) * y + m(3, 2) * z + m(3, 3);
+#endif
+    return v;
+}
+
+inline bool behind_near_plane(const ClipVertex& v) { return v.w <= kMinClipW || v.z < -v.w; }
+} // namespace
+
+OcclusionRasterizer::OcclusionRasterizer(WorkerPool* pool, int width, int height) : pool_(pool) {
+    resize(width, height);
+}
+
+void OcclusionRasterizer::resize(int width, int height) {
+    width_ = std::max(width, 1);
+    height_ = std::max(height, 1);
+    // rows are padded to whole SSE lanes
+    stride_ = (width_ + 3) & ~3;
+    depth_.assign(static_cast<std::size_t>(stride_) * height_, 1.0f);
+}
+
+void OcclusionRasterizer::rasterize(const RenderableList& renderables, const Mat4f& view_projection) {
+    std::fill(depth_.begin(), depth_.end(), 1.0f);
+    triangles_.clear();
+    jobs_.clear();
+    if (!enabled_) {
+        return;
+    }
+    view_projection_ = view_projection;
+
+    for (const auto& renderable : renderables) {
+        if (!renderable.occluder_mesh || renderable.transparent || !renderable.transforms) {
+            continue;
+        }
+        const MeshData* mesh = renderable.occluder_mesh.get();
+        if (!mesh || mesh->index_count() < 3 || mesh->vertex_count() == 0) {
+            continue;
+        }
+        for (std::size_t begin = 0; begin < renderable.instance_count; begin += kInstancesPerJob) {
+            Job job;
+            job.renderable = &renderable;
+            job.mesh = mesh;
+            job.begin = begin;
+            job.end = std::min(begin + kInstancesPerJob, renderable.instance_count);
+            jobs_.push_back(std::move(job));
+        }
+    }
+    if (jobs_.empty()) {
+        return;
+    }
+
+    auto run_jobs = [this](std::size_t begin, std::size_t end) {
+        for (std::size_t j = begin; j < end; ++j) {
+            transform_job(jobs_[j]);
+        }
+    };
+    if (pool_) {
+        pool_->parallel_for(jobs_.size(), 1, run_jobs);
+    } else {
+        run_jobs(0, jobs_.size());
+    }
+    for (auto& job : jobs_) {
+        triangles_.insert(triangles_.end(), job.triangles.begin(), job.triangles.end());
+    }
+
+    // every band owns its rows of the depth buffer, so bands never write the same memory
+    std::size_t band_count = static_cast<std::size_t>((height_ + kBandRows - 1) / kBandRows);
+    auto run_bands = [this](std::size_t begin, std::size_t end) {
+        for (std::size_t band = begin; band < end; ++band) {
+            int y_begin = static_cast<int>(band) * kBandRows;
+            rasterize_band(y_begin, std::min(y_begin + kBandRows, height_));
+        }
+    };
+    if (pool_) {
+        pool_->parallel_for(band_count, 1, run_bands);
+    } else {
+        run_bands(0, band_count);
+    }
+
+    logging::log(0, logging::DEBUG,
+                 "OcclusionRasterizer: rasterized " + std::to_string(triangles_.size()) + " occluder triangles from " +
+                     std::to_string(jobs_.size()) + " jobs");
+}
+
+void OcclusionRasterizer::transform_job(Job& job) const {
+    job.triangles.clear();
+    const auto& geometry = job.mesh->geometry();
+    const auto& positions = geometry.positions;
+    const auto& indices = geometry.indices;
+    const bool double_sided = job.renderable->double_sided;
+    const float half_width = 0.5f * static_cast<float>(width_);
+    const float half_height = 0.5f * static_cast<float>(height_);
+
+    std::vector<ClipVertex> clip(positions.size() / 3);
+    const Mat4f* matrices = job.renderable->matrices();
+    for (std::size_t instance = job.begin; instance < job.end; ++instance) {
+        Mat4f mvp = view_projection_.matmul(matrices[instance]);
+        for (std::size_t v = 0; v < clip.size(); ++v) {
+            clip[v] = project(mvp, positions[v * 3 + 0], positions[v * 3 + 1], positions[v * 3 + 2]);
+        }
+
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const ClipVertex* v[3] = {&clip[indices[i]], &clip[indices[i + 1]], &clip[indices[i + 2]]};
+            // triangles crossing the near plane are dropped, which only ever makes the occluder smaller
+            if (behind_near_plane(*v[0]) || behind_near_plane(*v[1]) || behind_near_plane(*v[2])) {
+                continue;
+            }
+            ScreenTriangle triangle;
+            for (int k = 0; k < 3; ++k) {
+                float inv_w = 1.0f / v[k]->w;
+                triangle.x[k] = (v[k]->x * inv_w + 1.0f) * half_width;
+                triangle.y[k] = (v[k]->y * inv_w + 1.0f) * half_height;
+                triangle.z[k] = v[k]->z * inv_w * 0.5f + 0.5f;
+            }
+
+            float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+                         (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+            if (area == 0.0f || (area < 0.0f && !double_sided)) {
+                continue;
+            }
+            if (area < 0.0f) {
+                std::swap(triangle.x[1], triangle.x[2]);
+                std::swap(triangle.y[1], triangle.y[2]);
+                std::swap(triangle.z[1], triangle.z[2]);
+            }
+
+            float min_x = std::min({triangle.x[0], triangle.x[1], triangle.x[2]});
+            float max_x = std::max({triangle.x[0], triangle.x[1], triangle.x[2]});
+            float min_y = std::min({triangle.y[0], triangle.y[1], triangle.y[2]});
+            float max_y = std::max({triangle.y[0], triangle.y[1], triangle.y[2]});
+            if (max_x < 0.0f || min_x > static_cast<float>(width_) || max_y < 0.0f ||
+                min_y > static_cast<float>(height_)) {
+                continue;
+            }
+            triangle.min_y = std::max(0, static_cast<int>(std::floor(min_y)));
+            triangle.max_y = std::min(height_ - 1, static_cast<int>(std::ceil(max_y)));
+            job.triangles.push_back(triangle);
+        }
+    }
+}
+
+void OcclusionRasterizer::rasterize_band(int y_begin, int y_end) {
+    for (const auto& triangle : triangles_) {
+        if (triangle.max_y < y_begin || triangle.min_y >= y_end) {
+            continue;
+        }
+        rasterize_triangle(triangle, y_begin, y_end);
+    }
+}
+
+void OcclusionRasterizer::rasterize_triangle(const ScreenTriangle& t, int y_begin, int y_end) {
+    // edge functions e_i(x, y) = a_i * x + b_i * y + c_i, positive inside for counter clockwise triangles
+    float a[3], b[3], c[3];
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+        a[i] = t.y[j] - t.y[k];
+        b[i] = t.x[k] - t.x[j];
+        c[i] = t.x[j] * t.y[k] - t.y[j] * t.x[k];
+    }
+    float area = c[0] + c[1] + c[2];
+    if (area <= 0.0f) {
+        return;
+    }
+    // depth plane z(x, y) = za * x + zb * y + zc
+    float inv_area = 1.0f / area;
+    float za = (a[0] * t.z[0] + a[1] * t.z[1] + a[2] * t.z[2]) * inv_area;
+    float zb = (b[0] * t.z[0] + b[1] * t.z[1] + b[2] * t.z[2]) * inv_area;
+    float zc = (c[0] * t.z[0] + c[1] * t.z[1] + c[2] * t.z[2]) * inv_area;
+
+    int min_x = std::max(0, static_cast<int>(std::floor(std::min({t.x[0], t.x[1], t.x[2]}))));
+    int max_x = std::min(width_ - 1, static_cast<int>(std::ceil(std::max({t.x[0], t.x[1], t.x[2]}))));
+    int row_begin = std::max(y_begin, t.min_y);
+    int row_end = std::min(y_end - 1, t.max_y);
+    min_x &= ~3;
+
+    for (int y = row_begin; y <= row_end; ++y) {
+        float py = static_cast<float>(y) + 0.5f;
+        float* row = depth_.data() + static_cast<std::size_t>(y) * stride_;
+#ifdef F3D_RASTER_SSE
+        const __m128 zero = _mm_setzero_ps();
+        __m128 e_row[3];
+        __m128 e_step[3];
+        __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(min_x)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+        for (int i = 0; i < 3; ++i) {
+            e_row[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[i]), px), _mm_set1_ps(b[i] * py + c[i]));
+            e_step[i] = _mm_set1_ps(a[i] * 4.0f);
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), _mm_set1_ps(zb * py + zc));
+        __m128 z_step = _mm_set1_ps(za * 4.0f);
+        for (int x = min_x; x <= max_x; x += 4) {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e_row[0], zero), _mm_cmpge_ps(e_row[1], zero)),
+                                       _mm_cmpge_ps(e_row[2], zero));
+            if (_mm_movemask_ps(inside) != 0) {
+                __m128 old_depth = _mm_loadu_ps(row + x);
+                __m128 new_depth = _mm_min_ps(old_depth, _mm_max_ps(z, zero));
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, new_depth), _mm_andnot_ps(inside, old_depth)));
+            }
+            for (int i = 0; i < 3; ++i) {
+                e_row[i] = _mm_add_ps(e_row[i], e_step[i]);
+            }
+            z = _mm_add_ps(z, z_step);
+        }
+#else
+        for (int x = min_x; x <= max_x; ++x) {
+            float px = static_cast<float>(x) + 0.5f;
+            float e0 = a[0] * px + b[0] * py + c[0];
+            float e1 = a[1] * px + b[1] * py + c[1];
+            float e2 = a[2] * px + b[2] * py + c[2];
+            if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+                float z = std::max(0.0f, za * px + zb * py + zc);
+                row[x] = std::min(row[x], z);
+            }
+        }
+#endif
+    }
+}
+
+bool OcclusionRasterizer::is_visible(const AABB& world_box) const {
+    if (!has_occluders() || !world_box.valid()) {
+        return true;
+    }
+
+    float min_x = std::numeric_limits<float>::max();
+    float min_y = std::numeric_limits<float>::max();
+    float max_x = std::numeric_limits<float>::lowest();
+    float max_y = std::numeric_limits<float>::lowest();
+    float min_depth = 1.0f;
+    for (int i = 0; i < 8; ++i) {
+        float x = (i & 1) ? world_box.max[0] : world_box.min[0];
+        float y = (i & 2) ? world_box.max[1] : world_box.min[1];
+        float z = (i & 4) ? world_box.max[2] : world_box.min[2];
+        ClipVertex v = project(view_projection_, x, y, z);
+        if (behind_near_plane(v)) {
+            return true;
+        }
+        float inv_w = 1.0f / v.w;
+        min_x = std::min(min_x, v.x * inv_w);
+        max_x = std::max(max_x, v.x * inv_w);
+        min_y = std::min(min_y, v.y * inv_w);
+        max_y = std::max(max_y, v.y * inv_w);
+        min_depth = std::min(min_depth, v.z * inv_w * 0.5f + 0.5f);
+    }
+
+    int x0 = std::max(0, static_cast<int>(std::floor((min_x + 1.0f) * 0.5f * static_cast<float>(width_))));
+    int x1 = std::min(width_ - 1, static_cast<int>(std::floor((max_x + 1.0f) * 0.5f * static_cast<float>(width_))));
+    int y0 = std::max(0, static_cast<int>(std::floor((min_y + 1.0f) * 0.5f * static_cast<float>(height_))));
+    int y1 = std::min(height_ - 1, static_cast<int>(std::floor((max_y + 1.0f) * 0.5f * static_cast<float>(height_))));
+    if (x0 > x1 || y0 > y1) {
+        // off screen, leave that decision to the frustum test
+        return true;
+    }
+
+    for (int y = y0; y <= y1; ++y) {
+        const float* row = depth_.data() + static_cast<std::size_t>(y) * stride_;
+        int x = x0;
+#ifdef F3D_RASTER_SSE
+        __m128 box_depth = _mm_set1_ps(min_depth);
+        for (; x + 3 <= x1; x += 4) {
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), box_depth)) != 0) {
+                return true;
+            }
+        }
+#endif
+        for (; x <= x1; ++x) {
+            if (row[x] >= min_depth) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool OcclusionRasterizer::is_visible(const BoundingSphere& world_sphere) const {
+    AABB box;
+    box.min = world_sphere.center - Vec3f{world_sphere.radius, world_sphere.radius, world_sphere.radius};
+    box.max = world_sphere.center + Vec3f{world_sphere.radius, world_sphere.radius, world_sphere.radius};
+    return is_visible(box);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "../RenderScene.h"
+#include "../../math/bounds.h"
+#include "../../math/mat.h"
+
+class WorkerPool;
+
+// CPU software occlusion culling. Occluder meshes (entities with an Occluder component) are rasterized into a small
+// depth buffer, four pixels at a time with SSE, with the screen split into row bands across the worker pool.
+// Bounds are then tested against the buffer; nothing touches the GPU, so it also runs on headless hosts.
+// Depth is the window space depth in [0, 1], smaller is closer.
+class OcclusionRasterizer {
+  public:
+    explicit OcclusionRasterizer(WorkerPool* pool = nullptr, int width = 320, int height = 192);
+
+    void set_enabled(bool enabled) { enabled_ = enabled; }
+    bool enabled() const { return enabled_; }
+
+    void resize(int width, int height);
+
+    // clears the depth buffer and draws every enabled occluder of the list
+    void rasterize(const RenderableList& renderables, const Mat4f& view_projection);
+
+    // conservative: true unless the whole box lies behind the rasterized occluders
+    [[nodiscard]] bool is_visible(const AABB& world_box) const;
+    [[nodiscard]] bool is_visible(const BoundingSphere& world_sphere) const;
+
+    [[nodiscard]] bool has_occluders() const { return enabled_ && !triangles_.empty(); }
+    [[nodiscard]] std::size_t triangle_count() const { return triangles_.size(); }
+    [[nodiscard]] int width() const { return width_; }
+    [[nodiscard]] int height() const { return height_; }
+    [[nodiscard]] float depth_at(int x, int y) const { return depth_[static_cast<std::size_t>(y) * stride_ + x]; }
+
+  private:
+    struct ScreenTriangle {
+        float x[3];
+        float y[3];
+        float z[3];
+        int min_y;
+        int max_y;
+    };
+
+    struct Job {
+        const RenderableInstance* renderable{nullptr};
+        const MeshData* mesh{nullptr};
+        std::size_t begin{0};
+        std::size_t end{0};
+        std::vector<ScreenTriangle> triangles;
+    };
+
+    void transform_job(Job& job) const;
+    void rasterize_band(int y_begin, int y_end);
+    void rasterize_triangle(const ScreenTriangle& triangle, int y_begin, int y_end);
+
+    WorkerPool* pool_{nullptr};
+    bool enabled_{true};
+
+    int width_{0};
+    int height_{0};
+    int stride_{0};
+    std::vector<float> depth_;
+
+    Mat4f view_projection_;
+    std::vector<Job> jobs_;
+    std::vector<ScreenTriangle> triangles_;
+};
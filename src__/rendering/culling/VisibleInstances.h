@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <ecs.h>
+
+// Output of the CPU culling stage for one renderable: the local indices of its surviving instances.
+// When culled is false the renderable was not tested (e.g. mesh without bounds) and all instances are drawn.
+struct VisibleInstanceList {
+    ecs::ID entity{ecs::INVALID_ID};
+    bool culled{false};
+    std::vector<std::uint32_t> indices;
+};
+
+// indexed like the RenderableList that was culled
+using VisibleInstanceLists = std::vector<VisibleInstanceList>;
@@ -0,0 +1,358 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+
+#include "../../logging/logging.h"
+
+namespace {
+std::size_t bytes_per_texel(GLint internal_format) {
+    switch (internal_format) {
+    case GL_R8:
+        return 1;
+    case GL_R16F:
+        return 2;
+    case GL_RGBA16F:
+    case GL_RG32UI:
+    case GL_RG32F:
+        return 8;
+    case GL_RGBA32F:
+    case GL_RGBA32UI:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+std::size_t texture_bytes(const RenderTextureDesc& desc) {
+    return static_cast<std::size_t>(desc.width) * static_cast<std::size_t>(desc.height) *
+           bytes_per_texel(desc.internal_format);
+}
+
+TextureData::SPtr create_texture(const RenderTextureDesc& desc) {
+    TextureSpecification spec;
+    spec.type = TextureType::TEX_2D;
+    spec.internal_format = desc.internal_format;
+    spec.data_format = desc.format;
+    spec.data_type = desc.type;
+    spec.min_filter = GL_NEAREST;
+    spec.mag_filter = GL_NEAREST;
+    spec.wrap_s = GL_CLAMP_TO_EDGE;
+    spec.wrap_t = GL_CLAMP_TO_EDGE;
+    spec.wrap_r = GL_CLAMP_TO_EDGE;
+    spec.generate_mipmaps = false;
+    auto texture = std::make_shared<TextureData>(TextureType::TEX_2D);
+    const void* data[6] = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+    texture->set_data(desc.width, desc.height, spec, data);
+    return texture;
+}
+} // namespace
+
+RenderGraph::Handle RenderGraph::Builder::create(const std::string& name, const RenderTextureDesc& desc) {
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    graph_.resources_.push_back(std::move(resource));
+    auto handle = static_cast<Handle>(graph_.resources_.size() - 1);
+    graph_.passes_[pass_].creates.push_back(handle);
+    return write(handle);
+}
+
+RenderGraph::Handle RenderGraph::Builder::read(Handle resource) {
+    if (resource == kInvalidHandle) {
+        return resource;
+    }
+    graph_.passes_[pass_].reads.push_back(resource);
+    graph_.resources_[resource].readers.push_back(pass_);
+    return resource;
+}
+
+RenderGraph::Handle RenderGraph::Builder::write(Handle resource) {
+    if (resource == kInvalidHandle) {
+        return resource;
+    }
+    graph_.passes_[pass_].writes.push_back(resource);
+    graph_.resources_[resource].writers.push_back(pass_);
+    if (graph_.resources_[resource].imported) {
+        side_effect();
+    }
+    return resource;
+}
+
+void RenderGraph::Builder::side_effect() { graph_.passes_[pass_].side_effect = true; }
+
+TextureData* RenderGraph::Resources::texture(Handle resource) const {
+    if (resource == kInvalidHandle) {
+        return nullptr;
+    }
+    return graph_.resources_[resource].texture.get();
+}
+
+const FBOData::SPtr& RenderGraph::Resources::framebuffer(const std::vector<Handle>& colors, Handle depth) {
+    std::vector<GLuint> key;
+    key.reserve(colors.size() + 2);
+    for (auto color : colors) {
+        auto* texture = this->texture(color);
+        key.push_back(texture ? static_cast<GLuint>(*texture) : 0);
+    }
+    key.push_back(0);
+    auto* depth_texture = texture(depth);
+    key.push_back(depth_texture ? static_cast<GLuint>(*depth_texture) : 0);
+
+    auto& framebuffer = graph_.framebuffers_[key];
+    if (framebuffer) {
+        return framebuffer;
+    }
+    framebuffer = std::make_shared<FBOData>();
+    std::vector<GLenum> buffers;
+    for (std::size_t i = 0; i < colors.size(); ++i) {
+        auto attachment = static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i);
+        framebuffer->attach_texture(attachment, graph_.resources_[colors[i]].texture);
+        buffers.push_back(attachment);
+    }
+    if (depth != kInvalidHandle) {
+        framebuffer->attach_texture(GL_DEPTH_ATTACHMENT, graph_.resources_[depth].texture);
+    }
+    framebuffer->bind();
+    if (buffers.empty()) {
+        glDrawBuffer(GL_NONE);
+    } else {
+        glDrawBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+    }
+    framebuffer->unbind();
+    if (!framebuffer->check_status()) {
+        logging::log(0, logging::ERROR, "RenderGraph: framebuffer incomplete");
+    }
+    return framebuffer;
+}
+
+RenderGraph::RenderGraph() = default;
+
+RenderGraph::~RenderGraph() = default;
+
+void RenderGraph::reset() {
+    resources_.clear();
+    passes_.clear();
+    order_.clear();
+}
+
+RenderGraph::Handle RenderGraph::import_texture(const std::string& name, TextureData* texture) {
+    Resource resource;
+    resource.name = name;
+    // the graph never owns imported textures
+    resource.texture = TextureData::SPtr(texture, [](TextureData*) {});
+    resource.imported = true;
+    resources_.push_back(std::move(resource));
+    return static_cast<Handle>(resources_.size() - 1);
+}
+
+void RenderGraph::add_pass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute) {
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    passes_.push_back(std::move(pass));
+    Builder builder(*this, passes_.size() - 1);
+    setup(builder);
+}
+
+bool RenderGraph::writes(const Pass& pass, Handle resource) const {
+    return std::find(pass.writes.begin(), pass.writes.end(), resource) != pass.writes.end();
+}
+
+void RenderGraph::compile() {
+    cull_passes();
+    sort_passes();
+    allocate_textures();
+
+    stats_.passes = passes_.size();
+    stats_.culled_passes = passes_.size() - order_.size();
+}
+
+void RenderGraph::execute() {
+    Resources resources(*this);
+    for (auto pass_index : order_) {
+        auto& pass = passes_[pass_index];
+        if (pass.execute) {
+            pass.execute(resources);
+        }
+    }
+}
+
+void RenderGraph::cull_passes() {
+    // a pass survives while one of its outputs is read by a surviving pass or it has a side effect; reads of a
+    // resource the same pass writes do not keep it alive
+    std::vector<int> pass_refs(passes_.size(), 0);
+    std::vector<int> resource_refs(resources_.size(), 0);
+    for (std::size_t p = 0; p < passes_.size(); ++p) {
+        auto& pass = passes_[p];
+        pass.culled = false;
+        pass_refs[p] = static_cast<int>(pass.writes.size());
+        for (auto resource : pass.reads) {
+            if (!writes(pass, resource)) {
+                ++resource_refs[resource];
+            }
+        }
+    }
+
+    std::vector<Handle> unreferenced;
+    auto cull = [&](Pass& pass) {
+        pass.culled = true;
+        for (auto read : pass.reads) {
+            if (!writes(pass, read) && --resource_refs[read] == 0) {
+                unreferenced.push_back(read);
+            }
+        }
+    };
+    for (std::size_t r = 0; r < resources_.size(); ++r) {
+        if (resource_refs[r] == 0) {
+            unreferenced.push_back(static_cast<Handle>(r));
+        }
+    }
+    for (std::size_t p = 0; p < passes_.size(); ++p) {
+        if (pass_refs[p] == 0 && !passes_[p].side_effect) {
+            cull(passes_[p]);
+        }
+    }
+    while (!unreferenced.empty()) {
+        auto resource = unreferenced.back();
+        unreferenced.pop_back();
+        for (auto writer : resources_[resource].writers) {
+            auto& pass = passes_[writer];
+            if (pass.culled || pass.side_effect || --pass_refs[writer] > 0) {
+                continue;
+            }
+            cull(pass);
+        }
+    }
+}
+
+void RenderGraph::sort_passes() {
+    // writers of a resource run in declaration order, passes that only read it run after all of them
+    std::vector<std::vector<std::size_t>> edges(passes_.size());
+    std::vector<int> in_degree(passes_.size(), 0);
+    auto add_edge = [&](std::size_t from, std::size_t to) {
+        if (from == to || passes_[from].culled || passes_[to].culled) {
+            return;
+        }
+        edges[from].push_back(to);
+        ++in_degree[to];
+    };
+    for (auto& resource : resources_) {
+        for (std::size_t i = 1; i < resource.writers.size(); ++i) {
+            add_edge(resource.writers[i - 1], resource.writers[i]);
+        }
+        for (auto reader : resource.readers) {
+            if (writes(passes_[reader], static_cast<Handle>(&resource - resources_.data()))) {
+                continue;
+            }
+            for (auto writer : resource.writers) {
+                add_edge(writer, reader);
+            }
+        }
+    }
+
+    order_.clear();
+    std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<>> ready;
+    std::size_t alive = 0;
+    for (std::size_t p = 0; p < passes_.size(); ++p) {
+        if (passes_[p].culled) {
+            continue;
+        }
+        ++alive;
+        if (in_degree[p] == 0) {
+            ready.push(p);
+        }
+    }
+    while (!ready.empty()) {
+        auto pass = ready.top();
+        ready.pop();
+        order_.push_back(pass);
+        for (auto next : edges[pass]) {
+            if (--in_degree[next] == 0) {
+                ready.push(next);
+            }
+        }
+    }
+
+    if (order_.size() != alive) {
+        logging::log(0, logging::ERROR, "RenderGraph: dependency cycle, running passes in declaration order");
+        order_.clear();
+        for (std::size_t p = 0; p < passes_.size(); ++p) {
+            if (!passes_[p].culled) {
+                order_.push_back(p);
+            }
+        }
+    }
+}
+
+void RenderGraph::allocate_textures() {
+    for (std::size_t position = 0; position < order_.size(); ++position) {
+        const auto& pass = passes_[order_[position]];
+        for (const auto* list : {&pass.reads, &pass.writes}) {
+            for (auto handle : *list) {
+                auto& resource = resources_[handle];
+                if (resource.first_use < 0) {
+                    resource.first_use = static_cast<int>(position);
+                }
+                resource.last_use = static_cast<int>(position);
+            }
+        }
+    }
+
+    for (auto& physical : pool_) {
+        physical.busy_until = -1;
+        physical.used = false;
+    }
+
+    stats_.transient_textures = 0;
+    stats_.transient_bytes = 0;
+    // resources are handed out in order of first use so a texture freed by an earlier pass can back a later one
+    std::vector<Handle> transients;
+    for (std::size_t r = 0; r < resources_.size(); ++r) {
+        if (!resources_[r].imported && resources_[r].first_use >= 0) {
+            transients.push_back(static_cast<Handle>(r));
+        }
+    }
+    std::stable_sort(transients.begin(), transients.end(),
+                     [&](Handle a, Handle b) { return resources_[a].first_use < resources_[b].first_use; });
+    for (auto handle : transients) {
+        auto& resource = resources_[handle];
+        resource.texture = pool_[acquire(resource.desc, resource.first_use, resource.last_use)].texture;
+        ++stats_.transient_textures;
+        stats_.transient_bytes += texture_bytes(resource.desc);
+    }
+
+    // physical textures no pass needed this frame are released together with every framebuffer built from them
+    std::size_t before = pool_.size();
+    pool_.erase(std::remove_if(pool_.begin(), pool_.end(), [](const PhysicalTexture& physical) { return !physical.used; }),
+                pool_.end());
+    if (pool_.size() != before) {
+        framebuffers_.clear();
+    }
+
+    stats_.physical_textures = pool_.size();
+    stats_.physical_bytes = 0;
+    for (const auto& physical : pool_) {
+        stats_.physical_bytes += texture_bytes(physical.desc);
+    }
+}
+
+int RenderGraph::acquire(const RenderTextureDesc& desc, int first_use, int last_use) {
+    for (std::size_t i = 0; i < pool_.size(); ++i) {
+        auto& physical = pool_[i];
+        if (physical.desc == desc && physical.busy_until < first_use) {
+            physical.busy_until = last_use;
+            physical.used = true;
+            return static_cast<int>(i);
+        }
+    }
+    PhysicalTexture physical;
+    physical.desc = desc;
+    physical.texture = create_texture(desc);
+    physical.busy_until = last_use;
+    physical.used = true;
+    pool_.push_back(std::move(physical));
+    return static_cast<int>(pool_.size() - 1);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../../gldata/fbo_data.h"
+#include "../../gldata/texture_data.h"
+
+struct RenderTextureDesc {
+    int width{0};
+    int height{0};
+    GLint internal_format{GL_RGBA8};
+    GLenum format{GL_RGBA};
+    GLenum type{GL_UNSIGNED_BYTE};
+
+    bool operator==(const RenderTextureDesc& other) const {
+        return width == other.width && height == other.height && internal_format == other.internal_format &&
+               format == other.format && type == other.type;
+    }
+};
+
+struct RenderGraphStats {
+    std::size_t passes{0};
+    std::size_t culled_passes{0};
+    std::size_t transient_textures{0};
+    std::size_t physical_textures{0};
+    // memory the transient textures would take without aliasing and what is actually allocated for them
+    std::size_t transient_bytes{0};
+    std::size_t physical_bytes{0};
+};
+
+// Frame graph. Passes declare the textures they create, read and write; compile() drops passes nothing depends on,
+// orders the rest by their dependencies and backs transient textures with pooled physical ones, reusing a physical
+// texture for every transient of the same description whose lifetime does not overlap. Physical textures and the
+// framebuffers built from them persist across frames as long as a frame keeps using them. Transient textures hold
+// undefined contents when a pass first writes them, so the creating pass clears what it needs.
+class RenderGraph {
+  public:
+    using Handle = int;
+    static constexpr Handle kInvalidHandle = -1;
+
+    class Builder {
+      public:
+        Handle create(const std::string& name, const RenderTextureDesc& desc);
+        Handle read(Handle resource);
+        Handle write(Handle resource);
+        // the pass has effects outside the graph, e.g. presents to the window, and is never culled
+        void side_effect();
+
+      private:
+        friend class RenderGraph;
+        Builder(RenderGraph& graph, std::size_t pass) : graph_(graph), pass_(pass) {}
+
+        RenderGraph& graph_;
+        std::size_t pass_;
+    };
+
+    class Resources {
+      public:
+        [[nodiscard]] TextureData* texture(Handle resource) const;
+        // framebuffer with the given color attachments and optional depth, draw buffers enable every color attachment
+        const FBOData::SPtr& framebuffer(const std::vector<Handle>& colors, Handle depth = kInvalidHandle);
+
+      private:
+        friend class RenderGraph;
+        explicit Resources(RenderGraph& graph) : graph_(graph) {}
+
+        RenderGraph& graph_;
+    };
+
+    using SetupFunction = std::function<void(Builder&)>;
+    using ExecuteFunction = std::function<void(Resources&)>;
+
+    RenderGraph();
+    ~RenderGraph();
+
+    // starts a new frame, passes and resources of the previous one are dropped while physical textures are kept
+    void reset();
+    // texture owned outside the graph, never aliased; writing it is a side effect since it outlives the frame
+    Handle import_texture(const std::string& name, TextureData* texture);
+    void add_pass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute);
+
+    void compile();
+    void execute();
+
+    [[nodiscard]] const RenderGraphStats& stats() const { return stats_; }
+
+  private:
+    struct Resource {
+        std::string name;
+        RenderTextureDesc desc;
+        TextureData::SPtr texture;
+        bool imported{false};
+        std::vector<std::size_t> writers;
+        std::vector<std::size_t> readers;
+        // first and last position in order_ of the passes using it
+        int first_use{-1};
+        int last_use{-1};
+    };
+    struct Pass {
+        std::string name;
+        ExecuteFunction execute;
+        std::vector<Handle> creates;
+        std::vector<Handle> reads;
+        std::vector<Handle> writes;
+        bool side_effect{false};
+        bool culled{false};
+    };
+    struct PhysicalTexture {
+        RenderTextureDesc desc;
+        TextureData::SPtr texture;
+        // last position in order_ of the transient currently backed by it, -1 when unused this frame
+        int busy_until{-1};
+        bool used{false};
+    };
+
+    [[nodiscard]] bool writes(const Pass& pass, Handle resource) const;
+    void cull_passes();
+    void sort_passes();
+    void allocate_textures();
+    int acquire(const RenderTextureDesc& desc, int first_use, int last_use);
+
+    std::vector<Resource> resources_;
+    std::vector<Pass> passes_;
+    // execution order of the passes that survived culling
+    std::vector<std::size_t> order_;
+    std::vector<PhysicalTexture> pool_;
+    std::map<std::vector<GLuint>, FBOData::SPtr> framebuffers_;
+    RenderGraphStats stats_;
+};
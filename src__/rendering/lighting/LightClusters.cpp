@@ -0,0 +1,294 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../../core/worker_pool.h"
+
+namespace {
+constexpr float kPi = 3.14159265359f;
+constexpr int kClustersPerSlice = LightClusters::kGridX * LightClusters::kGridY;
+
+// clip distances of a GL style perspective or orthographic projection
+bool projection_depth_range(const Mat4f& projection, float& near_plane, float& far_plane) {
+    float a = projection(2, 2);
+    float b = projection(2, 3);
+    if (projection(3, 3) == 0.0f) {
+        near_plane = b / (a - 1.0f);
+        far_plane = b / (a + 1.0f);
+    } else {
+        near_plane = (b + 1.0f) / a;
+        far_plane = (b - 1.0f) / a;
+    }
+    return std::isfinite(near_plane) && std::isfinite(far_plane) && far_plane > near_plane;
+}
+
+Vec3f transform_point(const Mat4f& matrix, const Vec3f& point) {
+    Vec4f result = matrix.matmul(Vec4f{point[0], point[1], point[2], 1.0f});
+    return Vec3f{result[0], result[1], result[2]};
+}
+
+// smallest sphere around the cone of a spot light clipped at its range
+BoundingSphere spot_bounds(const Vec3f& position, const Vec3f& direction, float range, float half_angle) {
+    BoundingSphere sphere;
+    if (half_angle >= 0.5f * kPi) {
+        sphere.center = position;
+        sphere.radius = range;
+    } else if (half_angle > 0.25f * kPi) {
+        sphere.center = position + direction * (range * std::cos(half_angle));
+        sphere.radius = range * std::sin(half_angle);
+    } else {
+        float radius = range / (2.0f * std::cos(half_angle));
+        sphere.center = position + direction * radius;
+        sphere.radius = radius;
+    }
+    return sphere;
+}
+
+template<typename T>
+void upload(SSBOData& buffer, const std::vector<T>& data) {
+    // an empty store cannot back a binding, the shader never reads the placeholder
+    if (data.empty()) {
+        T placeholder{};
+        buffer.update_data(sizeof(T), &placeholder);
+        return;
+    }
+    buffer.update_data(static_cast<GLsizeiptr>(data.size() * sizeof(T)), data.data());
+}
+} // namespace
+
+LightClusters::LightClusters(WorkerPool* pool) : pool_(pool), grid_projection_(Mat4f::eye()) {}
+
+LightClusters::~LightClusters() = default;
+
+void LightClusters::update_grid(const Mat4f& projection) {
+    if (!cluster_bounds_.empty() && projection == grid_projection_) {
+        return;
+    }
+    grid_projection_ = projection;
+    perspective_ = projection(3, 3) == 0.0f;
+    if (!projection_depth_range(projection, near_, far_) || (perspective_ && near_ <= 0.0f)) {
+        near_ = 0.1f;
+        far_ = 100.0f;
+    }
+    if (perspective_) {
+        float log_range = std::log(far_ / near_);
+        depth_scale_ = static_cast<float>(kGridZ) / log_range;
+        depth_bias_ = -static_cast<float>(kGridZ) * std::log(near_) / log_range;
+    } else {
+        depth_scale_ = static_cast<float>(kGridZ) / (far_ - near_);
+        depth_bias_ = -near_ * depth_scale_;
+    }
+
+    // view space point on the near plane for every tile corner, moved along its view ray to the slice depths
+    Mat4f inverse_projection = projection.inverse();
+    std::vector<Vec3f> corners(static_cast<std::size_t>((kGridX + 1) * (kGridY + 1)));
+    for (int y = 0; y <= kGridY; ++y) {
+        for (int x = 0; x <= kGridX; ++x) {
+            float ndc_x = -1.0f + 2.0f * static_cast<float>(x) / kGridX;
+            float ndc_y = -1.0f + 2.0f * static_cast<float>(y) / kGridY;
+            Vec4f point = inverse_projection.matmul(Vec4f{ndc_x, ndc_y, -1.0f, 1.0f});
+            corners[y * (kGridX + 1) + x] = Vec3f{point[0], point[1], point[2]} / point[3];
+        }
+    }
+    auto at_depth = [&](const Vec3f& near_point, float depth) {
+        if (perspective_) {
+            return near_point * (depth / near_);
+        }
+        return Vec3f{near_point[0], near_point[1], -depth};
+    };
+    auto slice_depth = [&](int slice) {
+        float t = static_cast<float>(slice) / kGridZ;
+        return perspective_ ? near_ * std::pow(far_ / near_, t) : near_ + (far_ - near_) * t;
+    };
+
+    cluster_bounds_.assign(static_cast<std::size_t>(kClustersPerSlice * kGridZ), AABB{});
+    for (int z = 0; z < kGridZ; ++z) {
+        float depths[2] = {slice_depth(z), slice_depth(z + 1)};
+        for (int y = 0; y < kGridY; ++y) {
+            for (int x = 0; x < kGridX; ++x) {
+                AABB& box = cluster_bounds_[z * kClustersPerSlice + y * kGridX + x];
+                for (int corner = 0; corner < 4; ++corner) {
+                    const Vec3f& near_point = corners[(y + corner / 2) * (kGridX + 1) + x + corner % 2];
+                    box.expand(at_depth(near_point, depths[0]));
+                    box.expand(at_depth(near_point, depths[1]));
+                }
+            }
+        }
+    }
+}
+
+int LightClusters::depth_slice(float depth) const {
+    float coordinate = perspective_ ? std::log(std::max(depth, 1e-4f)) : depth;
+    int slice = static_cast<int>(std::floor(coordinate * depth_scale_ + depth_bias_));
+    return std::clamp(slice, 0, kGridZ - 1);
+}
+
+void LightClusters::add_light(const GpuLight& light, const BoundingSphere& world_sphere, const Mat4f& view,
+                              const Mat4f& projection) {
+    auto index = static_cast<std::uint32_t>(lights_.size());
+    lights_.push_back(light);
+
+    LightRange range;
+    range.sphere.center = transform_point(view, world_sphere.center);
+    range.sphere.radius = world_sphere.radius;
+    const Vec3f& center = range.sphere.center;
+    float radius = range.sphere.radius;
+    float depth = -center[2];
+    if (depth + radius < near_ || depth - radius > far_) {
+        return;
+    }
+    range.min[2] = depth_slice(std::max(depth - radius, near_));
+    range.max[2] = depth_slice(std::min(depth + radius, far_));
+
+    // screen rectangle of the view space box around the sphere, the whole screen once it reaches the near plane
+    range.min[0] = 0;
+    range.min[1] = 0;
+    range.max[0] = kGridX - 1;
+    range.max[1] = kGridY - 1;
+    if (!perspective_ || depth - radius > near_) {
+        float ndc_min[2] = {1.0f, 1.0f};
+        float ndc_max[2] = {-1.0f, -1.0f};
+        for (int corner = 0; corner < 8; ++corner) {
+            Vec4f point{center[0] + ((corner & 1) ? radius : -radius), center[1] + ((corner & 2) ? radius : -radius),
+                        center[2] + ((corner & 4) ? radius : -radius), 1.0f};
+            Vec4f clip = projection.matmul(point);
+            for (int axis = 0; axis < 2; ++axis) {
+                float ndc = clip[axis] / clip[3];
+                ndc_min[axis] = std::min(ndc_min[axis], ndc);
+                ndc_max[axis] = std::max(ndc_max[axis], ndc);
+            }
+        }
+        const int grid[2] = {kGridX, kGridY};
+        for (int axis = 0; axis < 2; ++axis) {
+            if (ndc_max[axis] < -1.0f || ndc_min[axis] > 1.0f) {
+                return;
+            }
+            range.min[axis] = std::clamp(static_cast<int>((ndc_min[axis] * 0.5f + 0.5f) * grid[axis]), 0, grid[axis] - 1);
+            range.max[axis] = std::clamp(static_cast<int>((ndc_max[axis] * 0.5f + 0.5f) * grid[axis]), 0, grid[axis] - 1);
+        }
+    }
+    range.index = index;
+    ranges_.push_back(range);
+}
+
+void LightClusters::build(const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                          const std::vector<std::pair<PointLight*, Transformation*>>& point_lights, const Mat4f& view,
+                          const Mat4f& projection) {
+    update_grid(projection);
+    lights_.clear();
+    shadow_views_.clear();
+    ranges_.clear();
+
+    for (const auto& [light, transform] : spot_lights) {
+        if (!light || light->range <= 0.0f) {
+            continue;
+        }
+        Vec3f position = light->position(transform);
+        Vec3f direction = light->direction(transform);
+        float half_angle = std::max(light->outer_angle_deg, light->inner_angle_deg) * kPi / 180.0f;
+
+        GpuLight gpu;
+        gpu.position_range = Vec4f{position[0], position[1], position[2], light->range};
+        gpu.color_intensity = Vec4f{light->color[0], light->color[1], light->color[2], light->intensity};
+        gpu.direction_type = Vec4f{direction[0], direction[1], direction[2], 1.0f};
+        float first_view = -1.0f;
+        if (light->casts_shadows && light->current_shadow_resolution > 0) {
+            first_view = static_cast<float>(shadow_views_.size());
+            shadow_views_.push_back({light->shadow_rect.view_projection, light->shadow_rect.uv});
+        }
+        gpu.params = Vec4f{std::cos(light->inner_angle_deg * kPi / 180.0f),
+                           std::cos(light->outer_angle_deg * kPi / 180.0f), first_view, 0.0f};
+        add_light(gpu, spot_bounds(position, direction, light->range, half_angle), view, projection);
+    }
+
+    for (const auto& [light, transform] : point_lights) {
+        if (!light || light->radius <= 0.0f) {
+            continue;
+        }
+        Vec3f position = light->position(transform);
+
+        GpuLight gpu;
+        gpu.position_range = Vec4f{position[0], position[1], position[2], light->radius};
+        gpu.color_intensity = Vec4f{light->color[0], light->color[1], light->color[2], light->intensity};
+        gpu.direction_type = Vec4f{0.0f, 0.0f, 0.0f, 0.0f};
+        float first_view = -1.0f;
+        if (light->casts_shadows && light->current_shadow_resolution > 0) {
+            first_view = static_cast<float>(shadow_views_.size());
+            for (const auto& rect : light->shadow_rects) {
+                shadow_views_.push_back({rect.view_projection, rect.uv});
+            }
+        }
+        float far_plane = light->shadow_far > light->shadow_near ? light->shadow_far : light->radius;
+        gpu.params = Vec4f{0.0f, 0.0f, first_view, far_plane};
+        BoundingSphere sphere;
+        sphere.center = position;
+        sphere.radius = light->radius;
+        add_light(gpu, sphere, view, projection);
+    }
+
+    // every depth slice counts, offsets and fills its own clusters, so slices run in parallel without sharing
+    slice_indices_.resize(kGridZ);
+    slice_counts_.resize(kGridZ);
+    auto fill_slices = [&](std::size_t begin, std::size_t end) {
+        for (std::size_t z = begin; z < end; ++z) {
+            auto& counts = slice_counts_[z];
+            auto& indices = slice_indices_[z];
+            counts.assign(kClustersPerSlice + 1, 0);
+            indices.clear();
+            auto visit = [&](auto&& on_cluster) {
+                for (const auto& range : ranges_) {
+                    if (static_cast<int>(z) < range.min[2] || static_cast<int>(z) > range.max[2]) {
+                        continue;
+                    }
+                    for (int y = range.min[1]; y <= range.max[1]; ++y) {
+                        for (int x = range.min[0]; x <= range.max[0]; ++x) {
+                            int local = y * kGridX + x;
+                            if (cluster_bounds_[z * kClustersPerSlice + local].overlaps(range.sphere.center,
+                                                                                       range.sphere.radius)) {
+                                on_cluster(local, range.index);
+                            }
+                        }
+                    }
+                }
+            };
+            visit([&](int local, std::uint32_t) { ++counts[local + 1]; });
+            for (int i = 0; i < kClustersPerSlice; ++i) {
+                counts[i + 1] += counts[i];
+            }
+            indices.resize(counts[kClustersPerSlice]);
+            std::vector<std::uint32_t> cursor(counts.begin(), counts.end() - 1);
+            visit([&](int local, std::uint32_t index) { indices[cursor[local]++] = index; });
+        }
+    };
+    if (pool_) {
+        pool_->parallel_for(kGridZ, 1, fill_slices);
+    } else {
+        fill_slices(0, kGridZ);
+    }
+
+    clusters_.resize(static_cast<std::size_t>(kClustersPerSlice * kGridZ) * 2);
+    light_indices_.clear();
+    for (int z = 0; z < kGridZ; ++z) {
+        auto base = static_cast<std::uint32_t>(light_indices_.size());
+        const auto& counts = slice_counts_[z];
+        for (int local = 0; local < kClustersPerSlice; ++local) {
+            std::size_t cluster = static_cast<std::size_t>(z * kClustersPerSlice + local);
+            clusters_[cluster * 2] = base + counts[local];
+            clusters_[cluster * 2 + 1] = counts[local + 1] - counts[local];
+        }
+        light_indices_.insert(light_indices_.end(), slice_indices_[z].begin(), slice_indices_[z].end());
+    }
+
+    upload(light_buffer_, lights_);
+    upload(shadow_view_buffer_, shadow_views_);
+    upload(cluster_buffer_, clusters_);
+    upload(light_index_buffer_, light_indices_);
+}
+
+void LightClusters::bind() {
+    light_buffer_.bind(kLightBinding);
+    shadow_view_buffer_.bind(kShadowViewBinding);
+    cluster_buffer_.bind(kClusterBinding);
+    light_index_buffer_.bind(kLightIndexBinding);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../../gldata/ssbo_data.h"
+#include "../../lighting/point_light.h"
+#include "../../lighting/spot_light.h"
+#include "../../math/bounds.h"
+#include "../../math/mat.h"
+#include "../../math/transformation.h"
+
+class WorkerPool;
+
+// Clustered forward lighting. Spot and point lights are uploaded to one SSBO and assigned on the CPU to the clusters
+// of a view space froxel grid (screen tiles times exponential depth slices) their bounding sphere touches. Each
+// fragment then only loops over the light indices of its cluster. Shadowed lights reference their atlas tiles in a
+// separate shadow view SSBO, so must be built after the shadow pass recorded the matrices it rendered with.
+class LightClusters {
+  public:
+    static constexpr GLuint kLightBinding = 9;
+    static constexpr GLuint kShadowViewBinding = 10;
+    static constexpr GLuint kClusterBinding = 11;
+    static constexpr GLuint kLightIndexBinding = 12;
+
+    static constexpr int kGridX = 16;
+    static constexpr int kGridY = 9;
+    static constexpr int kGridZ = 24;
+
+    explicit LightClusters(WorkerPool* pool = nullptr);
+    ~LightClusters();
+
+    void build(const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+               const std::vector<std::pair<PointLight*, Transformation*>>& point_lights, const Mat4f& view,
+               const Mat4f& projection);
+    void bind();
+
+    // slice = log(view depth) * scale + bias, view depth instead of its log for orthographic projections
+    [[nodiscard]] float depth_scale() const { return depth_scale_; }
+    [[nodiscard]] float depth_bias() const { return depth_bias_; }
+    [[nodiscard]] bool linear_depth() const { return !perspective_; }
+    [[nodiscard]] std::size_t light_count() const { return lights_.size(); }
+    [[nodiscard]] std::size_t index_count() const { return light_indices_.size(); }
+
+  private:
+    // std430 layouts of LocalLight and ShadowView in lit_common.glsl
+    struct GpuLight {
+        Vec4f position_range;
+        Vec4f color_intensity;
+        // xyz spot direction, w 0 for point and 1 for spot lights
+        Vec4f direction_type;
+        // cos inner, cos outer, first shadow view or -1, shadow far plane of point lights
+        Vec4f params;
+    };
+    struct GpuShadowView {
+        Mat4f view_projection;
+        Vec4f rect;
+    };
+
+    void update_grid(const Mat4f& projection);
+    [[nodiscard]] int depth_slice(float depth) const;
+    void add_light(const GpuLight& light, const BoundingSphere& world_sphere, const Mat4f& view,
+                   const Mat4f& projection);
+
+    WorkerPool* pool_{nullptr};
+
+    Mat4f grid_projection_;
+    bool perspective_{true};
+    float near_{0.1f};
+    float far_{100.0f};
+    float depth_scale_{1.0f};
+    float depth_bias_{0.0f};
+    // view space bounds of every cluster, x fastest then y then z
+    std::vector<AABB> cluster_bounds_;
+
+    std::vector<GpuLight> lights_;
+    std::vector<GpuShadowView> shadow_views_;
+    // view space sphere and inclusive cluster range of every light that reaches the view
+    struct LightRange {
+        BoundingSphere sphere;
+        int min[3];
+        int max[3];
+        std::uint32_t index;
+    };
+    std::vector<LightRange> ranges_;
+    std::vector<std::vector<std::uint32_t>> slice_indices_;
+    std::vector<std::vector<std::uint32_t>> slice_counts_;
+    // offset and count into light_indices_ per cluster
+    std::vector<std::uint32_t> clusters_;
+    std::vector<std::uint32_t> light_indices_;
+
+    SSBOData light_buffer_;
+    SSBOData shadow_view_buffer_;
+    SSBOData cluster_buffer_;
+    SSBOData light_index_buffer_;
+};
@@ -2,18 +2,99 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
 #include <string>
 
 #include "../../logging/logging.h"
 #include "../../core/config.h"
 #include "../../math/mat.h"
 #include "../../rendering/RenderBatchBuilder.h"
+#include "../../rendering/VertexPool.h"
+#include "../../rendering/culling/FrustumCuller.h"
+#include "../../rendering/culling/GpuCuller.h"
+#include "../../rendering/culling/HiZBuffer.h"
+#include "../../rendering/lighting/LightClusters.h"
+#include "../../rendering/visibility/VisibilityGeometry.h"
 
-LitRenderer::LitRenderer() : shader_(std::make_unique<LitShader>()) {}
+namespace {
+constexpr float kTimingSmoothing = 0.1f;
+// Auto starts with the pre-pass from this many opaque instances on, until both variants were measured
+constexpr std::size_t kPrepassMinInstances = 512;
+// Auto draws the variant it did not pick for kProbeFrames out of every kProbeInterval frames
+constexpr std::uint64_t kProbeInterval = 240;
+constexpr std::uint64_t kProbeFrames = 4;
+// the measured times have to differ by this fraction before Auto switches
+constexpr float kPrepassHysteresis = 0.05f;
+}
+
+LitRenderer::LitRenderer()
+    : shader_(std::make_unique<LitShader>()), prepass_shader_(std::make_unique<DepthPrepassShader>()),
+      gbuffer_shader_(std::make_unique<GBufferShader>()), visibility_shader_(std::make_unique<VisibilityShader>()) {}
+
+LitRenderer::~LitRenderer() {
+    for (auto& timing : timings_) {
+        if (timing.queries[0] != 0) {
+            glDeleteQueries(3, timing.queries);
+        }
+    }
+}
 
-LitRenderer::~LitRenderer() = default;
+bool LitRenderer::init(const std::filesystem::path& shader_dir) {
+    return shader_->init(shader_dir) && prepass_shader_->init(shader_dir) && gbuffer_shader_->init(shader_dir) &&
+           visibility_shader_->init(shader_dir);
+}
 
-bool LitRenderer::init(const std::filesystem::path& shader_dir) { return shader_->init(shader_dir); }
+bool LitRenderer::use_depth_prepass(std::size_t opaque_instances) {
+    // the visibility output writes two integers per pixel, there is no fragment cost to save
+    if (output_ == LitOutput::Visibility || prepass_mode_ == DepthPrepassMode::Off) {
+        return false;
+    }
+    if (prepass_mode_ == DepthPrepassMode::On) {
+        return true;
+    }
+
+    bool probe = auto_frames_++ % kProbeInterval < kProbeFrames;
+    if (!probe) {
+        float with = prepass_stats_.with_prepass_ms;
+        float without = prepass_stats_.without_prepass_ms;
+        if (with > 0.0f && without > 0.0f) {
+            float margin = prepass_choice_ ? 1.0f + kPrepassHysteresis : 1.0f - kPrepassHysteresis;
+            prepass_choice_ = with < without * margin;
+        } else {
+            prepass_choice_ = opaque_instances >= kPrepassMinInstances;
+        }
+    }
+    return probe ? !prepass_choice_ : prepass_choice_;
+}
+
+void LitRenderer::read_back_timings() {
+    for (auto& timing : timings_) {
+        if (!timing.pending) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(timing.queries[2], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 stamps[3] = {0, 0, 0};
+        for (int i = 0; i < 3; ++i) {
+            glGetQueryObjectui64v(timing.queries[i], GL_QUERY_RESULT, &stamps[i]);
+        }
+        timing.pending = false;
+
+        auto smooth = [](float& average, float sample) {
+            average = average == 0.0f ? sample : average + (sample - average) * kTimingSmoothing;
+        };
+        float total_ms = static_cast<float>(stamps[2] - stamps[0]) * 1e-6f;
+        if (timing.prepass) {
+            smooth(prepass_stats_.prepass_ms, static_cast<float>(stamps[1] - stamps[0]) * 1e-6f);
+            smooth(prepass_stats_.with_prepass_ms, total_ms);
+        } else {
+            smooth(prepass_stats_.without_prepass_ms, total_ms);
+        }
+    }
+}
 
 void LitRenderer::set_render_target(const FBOData::SPtr& target, int width, int height) {
     target_fbo_ = target;
@@ -23,9 +104,7 @@ void LitRenderer::set_render_target(const FBOData::SPtr& target, int width, int
 
 void LitRenderer::render(const RenderableList& renderables, InstanceBuffer& instance_buffer, const Mat4f& view_matrix,
                          const Mat4f& projection_matrix, const Vec3f& camera_position,
-                         const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
-                         const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
-                         const std::vector<std::pair<PointLight*, Transformation*>>& point_lights) {
+                         const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights) {
     GLint previous_fbo = 0;
     GLint previous_viewport[4] = {0, 0, 0, 0};
     GLint previous_draw_buffer = GL_BACK;
@@ -38,7 +117,12 @@ void LitRenderer::render(const RenderableList& renderables, InstanceBuffer& inst
         GLuint fbo = static_cast<GLuint>(*target_fbo_);
         glBindFramebuffer(GL_FRAMEBUFFER, fbo);
         glViewport(0, 0, target_width_, target_height_);
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        if (output_ == LitOutput::GBuffer) {
+            GLenum buffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+            glDrawBuffers(3, buffers);
+        } else {
+            glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        }
         glReadBuffer(GL_COLOR_ATTACHMENT0);
     }
 
@@ -46,101 +130,232 @@ void LitRenderer::render(const RenderableList& renderables, InstanceBuffer& inst
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
 
-    shader_->start();
-    shader_->set_camera_matrices(view_matrix, projection_matrix);
-    shader_->set_camera_position(camera_position);
-    shader_->set_debug_mode(0); // visualize per-fragment normals for debugging
-
-    shader_->set_directional_lights(directional_lights);
-    shader_->set_spot_lights(spot_lights);
-    shader_->set_point_lights(point_lights);
     logging::log(0, logging::DEBUG,
-                 "LitRenderer: rendering " + std::to_string(directional_lights.size()) + " directional, " +
-                     std::to_string(spot_lights.size()) + " spot and " + std::to_string(point_lights.size()) +
-                     " point lights");
-
-    int next_texture_unit = 1;
-    for (int i = 0; i < static_cast<int>(directional_lights.size()) && i < MAX_DIRECTIONAL_LIGHTS; ++i) {
-        auto* light = directional_lights[i].first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
-            logging::log(0, logging::DEBUG,
-                         "LitRenderer: skipping shadow map bind for light index " + std::to_string(i));
-            continue;
-        }
-        GLuint depth_id = static_cast<GLuint>(*light->shadow_map->depth_texture());
-        shader_->bind_directional_shadow_map(i, depth_id, next_texture_unit);
-        next_texture_unit++;
+                 "LitRenderer: building batches from " + std::to_string(renderables.size()) + " renderables and " +
+                     std::to_string(instance_buffer.total_instances()) + " instances in SSBO");
+
+    // with both stages active the GPU culler reads the CPU culled lists as its candidate instances
+    bool cpu_culling = frustum_culler_ && visible_instances_;
+    auto batches = build_mesh_batches(renderables, instance_buffer,
+                                      [](const RenderableInstance& instance) { return !instance.transparent; },
+                                      cpu_culling ? visible_instances_ : nullptr,
+                                      BatchOrder{BatchPass::Opaque, DepthOrder::FrontToBack, camera_position});
+
+    bool gpu_culling = gpu_culler_ && gpu_culler_->enabled();
+    if (cpu_culling) {
+        frustum_culler_->upload(batches, gpu_culling ? GpuCuller::kCandidateInstanceBinding
+                                                     : GpuCuller::kVisibleInstanceBinding);
+    }
+    bool occlusion = gpu_culling && gpu_culler_->occlusion_enabled() && hiz_buffer_ && hiz_buffer_->ready() &&
+                     occlusion_depth_ && target_fbo_;
+    Mat4f view_projection = projection_matrix.matmul(view_matrix);
+    float lod_scale = projection_matrix(1, 1) * 0.5f * static_cast<float>(target_height_);
+    // the culler needs the pooled ranges to build its commands
+    VertexPool* vertex_pool = vertex_pool_;
+    if (vertex_pool) {
+        vertex_pool->sync(batches);
+    }
+    if (gpu_culling) {
+        gpu_culler_->cull(batches, instance_buffer, view_projection, lod_scale,
+                          occlusion ? OcclusionPhase::Early : OcclusionPhase::None, nullptr, vertex_pool);
     }
-    glActiveTexture(GL_TEXTURE0);
 
-    for (int i = 0; i < static_cast<int>(spot_lights.size()) && i < MAX_SPOT_LIGHTS; ++i) {
-        auto* light = spot_lights[i].first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
-            continue;
-        }
-        GLuint depth_id = static_cast<GLuint>(*light->shadow_map->depth_texture());
-        shader_->bind_spot_shadow_map(i, depth_id, next_texture_unit);
-        next_texture_unit++;
+    bool visibility_output = output_ == LitOutput::Visibility && visibility_geometry_;
+    if (visibility_output) {
+        visibility_geometry_->sync(batches);
     }
 
-    for (int i = 0; i < static_cast<int>(point_lights.size()) && i < MAX_POINT_LIGHTS; ++i) {
-        auto* light = point_lights[i].first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
-            continue;
+    std::size_t opaque_instances = 0;
+    for (const auto& batch : batches) {
+        for (const auto& draw : batch.draws) {
+            opaque_instances += static_cast<std::size_t>(std::max(draw.instance_count, 0));
         }
-        GLuint depth_id = static_cast<GLuint>(*light->shadow_map->depth_texture());
-        shader_->bind_point_shadow_map(i, depth_id, next_texture_unit);
-        next_texture_unit++;
+    }
+    read_back_timings();
+    const bool prepass = use_depth_prepass(opaque_instances);
+    prepass_stats_.active = prepass;
+    if (prepass) {
+        prepass_shader_->start();
+        prepass_shader_->set_camera_matrices(view_matrix, projection_matrix);
+        prepass_shader_->set_instance_remap(gpu_culling || cpu_culling);
+        prepass_shader_->set_vertex_pulling(vertex_pool != nullptr);
     }
 
-    int rendered_entities = 0;
-    instance_buffer.bind(0);
-    logging::log(0, logging::DEBUG,
-                 "LitRenderer: building batches from " + std::to_string(renderables.size()) + " renderables and " +
-                     std::to_string(instance_buffer.total_instances()) + " instances in SSBO");
-
-    auto batches = build_mesh_batches(renderables, instance_buffer,
-                                      [](const RenderableInstance& instance) { return !instance.transparent; });
-
-    if (batches.empty()) {
-        logging::log(0, logging::DEBUG, "LitRenderer: no drawable batches this frame");
+    LitShader* shader = shader_.get();
+    if (output_ == LitOutput::GBuffer) {
+        shader = gbuffer_shader_.get();
+    } else if (visibility_output) {
+        shader = visibility_shader_.get();
     }
+    shader->start();
+    shader->set_camera_matrices(view_matrix, projection_matrix);
+    shader->set_camera_position(camera_position);
+    shader->set_debug_mode(0); // visualize per-fragment normals for debugging
+    shader->set_instance_remap(gpu_culling || cpu_culling);
+    shader->set_vertex_pulling(vertex_pool != nullptr);
 
-    for (const auto& batch : batches) {
-        if (!batch.mesh) {
-            continue;
+    // G-buffer and visibility passes only store surface data, lights are applied when they are resolved
+    if (output_ == LitOutput::Shaded) {
+        shader->set_directional_lights(directional_lights);
+        if (light_clusters_) {
+            light_clusters_->bind();
         }
+        shader->set_light_clusters(light_clusters_, target_width_, target_height_);
+        logging::log(0, logging::DEBUG,
+                     "LitRenderer: rendering " + std::to_string(directional_lights.size()) + " directional and " +
+                         std::to_string(light_clusters_ ? light_clusters_->light_count() : 0) + " clustered lights");
 
-        if (batch.double_sided) {
-            glDisable(GL_CULL_FACE);
-        } else {
-            glEnable(GL_CULL_FACE);
-            glCullFace(GL_BACK);
+        if (shadow_atlas_ && shadow_atlas_->texture()) {
+            shader->bind_shadow_atlas(static_cast<GLuint>(*shadow_atlas_->texture()), 1, shadow_atlas_->filter());
         }
+    }
+    glActiveTexture(GL_TEXTURE0);
 
-        for (const auto& draw : batch.draws) {
-            if (draw.instance_count <= 0) {
+    int rendered_entities = 0;
+    auto draw_batches = [&](bool depth_only) {
+        // the pre-pass reads the same float positions as the colour pass so GL_EQUAL matches exactly
+        MeshStream stream = depth_only ? MeshStream::Position : MeshStream::Full;
+        glEnable(GL_CULL_FACE);
+        bool culling = true;
+        for (std::size_t batch_index = 0; batch_index < batches.size(); ++batch_index) {
+            const auto& batch = batches[batch_index];
+            if (!batch.mesh) {
                 continue;
             }
-            const auto total_instances = instance_buffer.total_instances();
-            if (static_cast<std::size_t>(draw.base_instance) + draw.instance_count > total_instances) {
-                logging::log(0, logging::ERROR,
-                             "LitRenderer: draw range exceeds SSBO (base=" + std::to_string(draw.base_instance) +
-                                 ", count=" + std::to_string(draw.instance_count) +
-                                 ", total=" + std::to_string(total_instances) + ")");
+
+            if (visibility_output && !depth_only) {
+                auto triangle_base = visibility_geometry_->triangle_base(batch.mesh);
+                if (triangle_base == VisibilityGeometry::kInvalidBase) {
+                    continue;
+                }
+                visibility_shader_->set_triangle_base(triangle_base);
+            }
+
+            const VertexPool::Range* range = nullptr;
+            if (vertex_pool) {
+                range = vertex_pool->find(batch.mesh);
+                if (!range) {
+                    continue;
+                }
+            }
+
+            apply_cull_mode(batch, culling);
+
+            if (gpu_culling) {
+                gpu_culler_->draw(batch_index, batch, stream);
                 continue;
             }
-            batch.mesh->draw_instanced(draw.instance_count, draw.base_instance);
-            rendered_entities += draw.instance_count;
+
+            for (const auto& draw : batch.draws) {
+                if (draw.instance_count <= 0) {
+                    continue;
+                }
+                const auto total_instances = instance_buffer.total_instances();
+                if (static_cast<std::size_t>(draw.base_instance) + draw.instance_count > total_instances) {
+                    logging::log(0, logging::ERROR,
+                                 "LitRenderer: draw range exceeds SSBO (base=" + std::to_string(draw.base_instance) +
+                                     ", count=" + std::to_string(draw.instance_count) +
+                                     ", total=" + std::to_string(total_instances) + ")");
+                    continue;
+                }
+                if (range) {
+                    vertex_pool->draw_instanced(*range, draw.instance_count, draw.base_instance);
+                } else {
+                    batch.mesh->draw_instanced(draw.instance_count, draw.base_instance, stream);
+                }
+                if (!depth_only) {
+                    rendered_entities += draw.instance_count;
+                }
+            }
+        }
+    };
+
+    TimingQuery* timing = nullptr;
+    auto timestamp = [&](int index) {
+        if (timing) {
+            glQueryCounter(timing->queries[index], GL_TIMESTAMP);
+        }
+    };
+    // with the pre-pass, depth is complete before shading and every covered pixel is shaded exactly once
+    auto draw_phase = [&](bool first) {
+        if (prepass) {
+            prepass_shader_->start();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+            draw_batches(true);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_EQUAL);
+            shader->start();
+        }
+        if (first) {
+            timestamp(1);
+        }
+        draw_batches(false);
+    };
+
+    instance_buffer.bind(0);
+    if (vertex_pool) {
+        // every batch draws with this one VAO bound, the shaders fetch vertices by gl_VertexID
+        vertex_pool->bind();
+    }
+    if (gpu_culling) {
+        gpu_culler_->begin_draw();
+    }
+
+    if (batches.empty()) {
+        logging::log(0, logging::DEBUG, "LitRenderer: no drawable batches this frame");
+    }
+
+    auto& slot = timings_[timing_index_];
+    if (slot.queries[0] == 0) {
+        glGenQueries(3, slot.queries);
+    }
+    // every query is still in flight, this frame is not measured
+    if (!slot.pending) {
+        timing = &slot;
+    }
+    timestamp(0);
+
+    draw_phase(true);
+
+    if (occlusion) {
+        // depth now holds everything visible last frame; test the rest against it and draw what got disoccluded
+        gpu_culler_->end_draw();
+        hiz_buffer_->build(*occlusion_depth_, target_width_, target_height_);
+        gpu_culler_->cull(batches, instance_buffer, view_projection, lod_scale, OcclusionPhase::Late, hiz_buffer_,
+                          vertex_pool);
+        shader->start();
+        instance_buffer.bind(0);
+        if (vertex_pool) {
+            vertex_pool->bind();
         }
+        gpu_culler_->begin_draw();
+        draw_phase(false);
     }
 
-    shader_->stop();
+    if (gpu_culling) {
+        gpu_culler_->end_draw();
+    }
+    if (vertex_pool) {
+        vertex_pool->unbind();
+    }
+    timestamp(2);
+    if (timing) {
+        timing->pending = true;
+        timing->prepass = prepass;
+        timing_index_ = (timing_index_ + 1) % kTimingQueryCount;
+    }
+    shader->stop();
     glDisable(GL_CULL_FACE);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
 
     logging::log(0, logging::DEBUG,
-                 "LitRenderer: rendered " + std::to_string(rendered_entities) + " instances across " +
-                     std::to_string(batches.size()) + " batches.");
+                 "LitRenderer: rendered " + (gpu_culling ? std::string("gpu culled") : std::to_string(rendered_entities)) +
+                     " instances across " + std::to_string(batches.size()) + " batches" +
+                     (prepass ? std::string(" after a depth pre-pass.") : std::string(".")));
 
     if (target_fbo_) {
         glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
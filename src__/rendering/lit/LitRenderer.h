@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <filesystem>
 #include <utility>
 #include <vector>
@@ -10,12 +12,46 @@
 
 #include "../../rendering/RenderScene.h"
 #include "../../rendering/InstanceBuffer.h"
+#include "../../rendering/culling/VisibleInstances.h"
 #include "../../lighting/directional_light.h"
-#include "../../lighting/point_light.h"
-#include "../../lighting/spot_light.h"
 #include "../../math/transformation.h"
 #include "../../gldata/fbo_data.h"
+#include "../../shader/deferred/GBufferShader.h"
+#include "../../shader/lit/DepthPrepassShader.h"
 #include "../../shader/lit/LitShader.h"
+#include "../../shader/visibility/VisibilityShader.h"
+
+class GpuCuller;
+class LightClusters;
+class FrustumCuller;
+class HiZBuffer;
+class VisibilityGeometry;
+class VertexPool;
+
+// what the opaque pass writes into its render target
+enum class LitOutput {
+    // shaded color, the forward path
+    Shaded,
+    // material attributes for DeferredRenderer
+    GBuffer,
+    // instance slot and triangle id for VisibilityRenderer
+    Visibility,
+};
+
+// depth only pass over the opaque batches before they are shaded with GL_EQUAL, so every pixel runs the expensive
+// fragment shader once. Auto starts from the instance count and then keeps whichever variant the GPU timers measured
+// as faster, probing the other one for a few frames now and then.
+enum class DepthPrepassMode { Off, On, Auto };
+
+// exponential averages of the GPU time of the opaque pass, zero until measured
+struct DepthPrepassStats {
+    // the last frame drew the pre-pass
+    bool active{false};
+    // depth only part of frames with the pre-pass (the early phase with occlusion culling)
+    float prepass_ms{0.0f};
+    float with_prepass_ms{0.0f};
+    float without_prepass_ms{0.0f};
+};
 
 class LitRenderer {
   public:
@@ -25,16 +61,65 @@ class LitRenderer {
     bool init(const std::filesystem::path& shader_dir);
 
     void set_render_target(const FBOData::SPtr& target, int width, int height);
+    void set_gpu_culler(GpuCuller* culler) { gpu_culler_ = culler; }
+    void set_frustum_culler(FrustumCuller* culler) { frustum_culler_ = culler; }
+    // CPU culled lists of the renderables about to be drawn, nullptr draws every instance
+    void set_visible_instances(const VisibleInstanceLists* visible) { visible_instances_ = visible; }
+    void set_shadow_atlas(const ShadowAtlas* atlas) { shadow_atlas_ = atlas; }
+    // spot and point lights, built for the same view before render
+    void set_light_clusters(LightClusters* clusters) { light_clusters_ = clusters; }
+    // enables two phase occlusion culling against a Hi-Z pyramid of the render target's depth attachment
+    void set_occlusion(HiZBuffer* hiz, const TextureData* depth) {
+        hiz_buffer_ = hiz;
+        occlusion_depth_ = depth;
+    }
+    void set_output(LitOutput output) { output_ = output; }
+    // mesh pool the visibility output assigns global triangle ids from
+    void set_visibility_geometry(VisibilityGeometry* geometry) { visibility_geometry_ = geometry; }
+    // pulls the vertices of every opaque mesh from the pool with one VAO bound, nullptr draws the mesh VAOs
+    void set_vertex_pool(VertexPool* pool) { vertex_pool_ = pool; }
+    void set_depth_prepass(DepthPrepassMode mode) { prepass_mode_ = mode; }
+    const DepthPrepassStats& depth_prepass_stats() const { return prepass_stats_; }
 
     void render(const RenderableList& renderables, InstanceBuffer& instance_buffer, const Mat4f& view_matrix,
                 const Mat4f& projection_matrix, const Vec3f& camera_position,
-                const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
-                const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
-                const std::vector<std::pair<PointLight*, Transformation*>>& point_lights);
+                const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights);
 
   private:
+    struct TimingQuery {
+        // timestamps at the start, after the (first) pre-pass and at the end of the opaque pass
+        GLuint queries[3]{0, 0, 0};
+        bool pending{false};
+        bool prepass{false};
+    };
+
+    bool use_depth_prepass(std::size_t opaque_instances);
+    void read_back_timings();
+
     std::unique_ptr<LitShader> shader_;
+    std::unique_ptr<DepthPrepassShader> prepass_shader_;
+    std::unique_ptr<GBufferShader> gbuffer_shader_;
+    std::unique_ptr<VisibilityShader> visibility_shader_;
     FBOData::SPtr target_fbo_;
+    GpuCuller* gpu_culler_{nullptr};
+    FrustumCuller* frustum_culler_{nullptr};
+    const VisibleInstanceLists* visible_instances_{nullptr};
+    const ShadowAtlas* shadow_atlas_{nullptr};
+    LightClusters* light_clusters_{nullptr};
+    VisibilityGeometry* visibility_geometry_{nullptr};
+    VertexPool* vertex_pool_{nullptr};
+    HiZBuffer* hiz_buffer_{nullptr};
+    const TextureData* occlusion_depth_{nullptr};
     int target_width_ {0};
     int target_height_ {0};
+    LitOutput output_{LitOutput::Shaded};
+
+    DepthPrepassMode prepass_mode_{DepthPrepassMode::Off};
+    DepthPrepassStats prepass_stats_;
+    // what Auto settled on outside of probe frames
+    bool prepass_choice_{false};
+    std::uint64_t auto_frames_{0};
+    static constexpr int kTimingQueryCount = 4;
+    std::array<TimingQuery, kTimingQueryCount> timings_{};
+    int timing_index_{0};
 };
@@ -5,6 +5,9 @@
 #include "../../logging/logging.h"
 #include "../../core/config.h"
 #include "../../rendering/RenderBatchBuilder.h"
+#include "../../rendering/culling/FrustumCuller.h"
+#include "../../rendering/culling/GpuCuller.h"
+#include "../../rendering/lighting/LightClusters.h"
 
 TransparentRenderer::TransparentRenderer()
     : shader_(std::make_unique<LitTransparentShader>()) {}
@@ -26,9 +29,7 @@ void TransparentRenderer::render(const RenderableList& renderables,
                                  const Mat4f& view_matrix,
                                  const Mat4f& projection_matrix,
                                  const Vec3f& camera_position,
-                                 const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
-                                 const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
-                                 const std::vector<std::pair<PointLight*, Transformation*>>& point_lights) {
+                                 const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights) {
     GLint previous_fbo = 0;
     GLint previous_viewport[4] = {0, 0, 0, 0};
     GLint previous_draw_buffer = GL_BACK;
@@ -52,61 +53,41 @@ void TransparentRenderer::render(const RenderableList& renderables,
     shader_->set_camera_position(camera_position);
     shader_->set_debug_mode(0);
     shader_->set_directional_lights(directional_lights);
-    shader_->set_spot_lights(spot_lights);
-    shader_->set_point_lights(point_lights);
-
-    int next_texture_unit = 1;
-    for (int i = 0; i < static_cast<int>(directional_lights.size()) && i < MAX_DIRECTIONAL_LIGHTS; ++i) {
-        auto* light = directional_lights[i].first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
-            continue;
-        }
-        GLuint depth_id = static_cast<GLuint>(*light->shadow_map->depth_texture());
-        shader_->bind_directional_shadow_map(i, depth_id, next_texture_unit);
-        next_texture_unit++;
+    if (light_clusters_) {
+        light_clusters_->bind();
     }
-    glActiveTexture(GL_TEXTURE0);
+    shader_->set_light_clusters(light_clusters_, target_width_, target_height_);
 
-    for (int i = 0; i < static_cast<int>(spot_lights.size()) && i < MAX_SPOT_LIGHTS; ++i) {
-        auto* light = spot_lights[i].first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
-            continue;
-        }
-        GLuint depth_id = static_cast<GLuint>(*light->shadow_map->depth_texture());
-        shader_->bind_spot_shadow_map(i, depth_id, next_texture_unit);
-        next_texture_unit++;
-    }
-
-    for (int i = 0; i < static_cast<int>(point_lights.size()) && i < MAX_POINT_LIGHTS; ++i) {
-        auto* light = point_lights[i].first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
-            continue;
-        }
-        GLuint depth_id = static_cast<GLuint>(*light->shadow_map->depth_texture());
-        shader_->bind_point_shadow_map(i, depth_id, next_texture_unit);
-        next_texture_unit++;
+    if (shadow_atlas_ && shadow_atlas_->texture()) {
+        shader_->bind_shadow_atlas(static_cast<GLuint>(*shadow_atlas_->texture()), 1, shadow_atlas_->filter());
     }
+    glActiveTexture(GL_TEXTURE0);
 
     instance_buffer.bind(0);
 
+    bool cpu_culling = frustum_culler_ && visible_instances_;
     auto batches = build_mesh_batches(renderables,
                                       instance_buffer,
                                       [](const RenderableInstance& instance) {
                                           return instance.transparent;
-                                      });
+                                      },
+                                      cpu_culling ? visible_instances_ : nullptr,
+                                      BatchOrder{BatchPass::Transparent, DepthOrder::BackToFront, camera_position});
+    if (cpu_culling) {
+        frustum_culler_->upload(batches, GpuCuller::kVisibleInstanceBinding);
+    }
+    shader_->set_instance_remap(cpu_culling);
 
     int rendered_instances = 0;
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    bool culling = true;
     for (const auto& batch : batches) {
         if (!batch.mesh) {
             continue;
         }
 
-        if (batch.double_sided) {
-            glDisable(GL_CULL_FACE);
-        } else {
-            glEnable(GL_CULL_FACE);
-            glCullFace(GL_BACK);
-        }
+        apply_cull_mode(batch, culling);
 
         for (const auto& draw : batch.draws) {
             if (draw.instance_count <= 0) {
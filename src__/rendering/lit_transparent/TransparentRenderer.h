@@ -9,12 +9,14 @@
 #include "../../gldata/fbo_data.h"
 #include "../../rendering/RenderScene.h"
 #include "../../rendering/InstanceBuffer.h"
+#include "../../rendering/culling/VisibleInstances.h"
 #include "../../lighting/directional_light.h"
-#include "../../lighting/spot_light.h"
-#include "../../lighting/point_light.h"
 #include "../../math/transformation.h"
 #include "../../shader/lit/LitTransparentShader.h"
 
+class FrustumCuller;
+class LightClusters;
+
 class TransparentRenderer {
 public:
     TransparentRenderer();
@@ -23,19 +25,26 @@ public:
     bool init(const std::filesystem::path& shader_dir);
 
     void set_render_target(const FBOData::SPtr& target, int width, int height);
+    void set_frustum_culler(FrustumCuller* culler) { frustum_culler_ = culler; }
+    // CPU culled lists of the renderables about to be drawn, nullptr draws every instance
+    void set_visible_instances(const VisibleInstanceLists* visible) { visible_instances_ = visible; }
+    void set_shadow_atlas(const ShadowAtlas* atlas) { shadow_atlas_ = atlas; }
+    void set_light_clusters(LightClusters* clusters) { light_clusters_ = clusters; }
 
     void render(const RenderableList& renderables,
                 InstanceBuffer& instance_buffer,
                 const Mat4f& view_matrix,
                 const Mat4f& projection_matrix,
                 const Vec3f& camera_position,
-                const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
-                const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
-                const std::vector<std::pair<PointLight*, Transformation*>>& point_lights);
+                const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights);
 
 private:
     std::unique_ptr<LitTransparentShader> shader_;
     FBOData::SPtr target_fbo_;
+    FrustumCuller* frustum_culler_{nullptr};
+    const VisibleInstanceLists* visible_instances_{nullptr};
+    const ShadowAtlas* shadow_atlas_{nullptr};
+    LightClusters* light_clusters_{nullptr};
     int target_width_ {0};
     int target_height_ {0};
 };
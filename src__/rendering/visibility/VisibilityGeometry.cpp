@@ -0,0 +1,109 @@
+#include "VisibilityGeometry.h"
+
+#include <string>
+
+#include "../../logging/logging.h"
+
+VisibilityGeometry::VisibilityGeometry() = default;
+
+VisibilityGeometry::~VisibilityGeometry() = default;
+
+void VisibilityGeometry::sync(const std::vector<MeshBatch>& batches) {
+    ++stamp_;
+    bool stale = false;
+    for (const auto& batch : batches) {
+        if (!batch.mesh) {
+            continue;
+        }
+        auto it = entries_.find(batch.mesh);
+        if (it == entries_.end()) {
+            dirty_ |= append(batch.mesh);
+            continue;
+        }
+        // a reloaded or different mesh at the same address invalidates its triangle range
+        stale |= it->second.generation != batch.mesh->gpu_generation();
+        it->second.used_stamp = stamp_;
+    }
+    // same grace period as the VertexPool, briefly culled meshes keep their triangles
+    for (const auto& [mesh, entry] : entries_) {
+        stale |= stamp_ - entry.used_stamp >= kEvictSyncs;
+    }
+    if (stale) {
+        rebuild(batches);
+    }
+    if (!dirty_) {
+        return;
+    }
+    vertex_buffer_.update_data(static_cast<GLsizeiptr>(vertices_.size() * sizeof(GpuVertex)), vertices_.data());
+    triangle_buffer_.update_data(static_cast<GLsizeiptr>(triangles_.size() * sizeof(GpuTriangle)), triangles_.data());
+    dirty_ = false;
+    logging::log(0, logging::DEBUG,
+                 "VisibilityGeometry: pooled " + std::to_string(entries_.size()) + " meshes, " +
+                     std::to_string(vertices_.size()) + " vertices and " + std::to_string(triangles_.size()) +
+                     " triangles");
+}
+
+void VisibilityGeometry::bind() {
+    vertex_buffer_.bind(kVertexBinding);
+    triangle_buffer_.bind(kTriangleBinding);
+}
+
+std::uint32_t VisibilityGeometry::triangle_base(const MeshData* mesh) const {
+    auto it = entries_.find(mesh);
+    return it != entries_.end() ? it->second.first_triangle : kInvalidBase;
+}
+
+bool VisibilityGeometry::append(const MeshData* mesh) {
+    const auto& geometry = mesh->geometry();
+    std::size_t vertex_count = mesh->vertex_count();
+    if (vertex_count == 0 || geometry.indices.size() < 3 || geometry.normals.size() < vertex_count * 3) {
+        logging::log(0, logging::WARNING,
+                     "VisibilityGeometry: no geometry in RAM for " + mesh->get_path() + ", mesh is not resolved");
+        return false;
+    }
+
+    Entry entry;
+    entry.first_triangle = static_cast<std::uint32_t>(triangles_.size());
+    entry.generation = mesh->gpu_generation();
+    entry.used_stamp = stamp_;
+
+    auto first_vertex = static_cast<std::uint32_t>(vertices_.size());
+    bool has_uvs = geometry.texcoords.size() >= vertex_count * 2;
+    vertices_.reserve(vertices_.size() + vertex_count);
+    for (std::size_t i = 0; i < vertex_count; ++i) {
+        GpuVertex vertex;
+        vertex.position_u = Vec4f{geometry.positions[i * 3 + 0], geometry.positions[i * 3 + 1],
+                                  geometry.positions[i * 3 + 2], has_uvs ? geometry.texcoords[i * 2 + 0] : 0.0f};
+        vertex.normal_v = Vec4f{geometry.normals[i * 3 + 0], geometry.normals[i * 3 + 1], geometry.normals[i * 3 + 2],
+                                has_uvs ? geometry.texcoords[i * 2 + 1] : 0.0f};
+        vertices_.push_back(vertex);
+    }
+
+    triangles_.reserve(triangles_.size() + geometry.indices.size() / 3);
+    for (std::size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+        GpuTriangle triangle;
+        for (int corner = 0; corner < 3; ++corner) {
+            triangle.vertices[corner] = first_vertex + geometry.indices[i + corner];
+        }
+        // the forward path reads the flat material of the provoking, i.e. last, vertex
+        auto last = geometry.indices[i + 2];
+        triangle.material =
+            last < geometry.material_slots.size() ? mesh->gpu_material_id(geometry.material_slots[last]) : -1;
+        triangles_.push_back(triangle);
+    }
+
+    entries_.emplace(mesh, entry);
+    return true;
+}
+
+void VisibilityGeometry::rebuild(const std::vector<MeshBatch>& batches) {
+    entries_.clear();
+    vertices_.clear();
+    triangles_.clear();
+    for (const auto& batch : batches) {
+        if (batch.mesh && entries_.find(batch.mesh) == entries_.end()) {
+            append(batch.mesh);
+        }
+    }
+    dirty_ = true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../RenderBatchBuilder.h"
+#include "../../gldata/ssbo_data.h"
+#include "../../math/mat.h"
+
+// Shared vertex and triangle pool the visibility buffer resolve reconstructs surfaces from. Every mesh drawn into the
+// visibility buffer is appended once; its triangles get a global id range so a pixel only needs the instance slot and
+// the global triangle id to find its vertices, attributes and material.
+class VisibilityGeometry {
+  public:
+    static constexpr GLuint kVertexBinding = 13;
+    static constexpr GLuint kTriangleBinding = 14;
+    static constexpr std::uint32_t kInvalidBase = 0xffffffffu;
+
+    VisibilityGeometry();
+    ~VisibilityGeometry();
+
+    // syncs a mesh may be absent from the batches before its triangles are dropped
+    static constexpr std::uint64_t kEvictSyncs = 240;
+
+    // appends meshes of the batches that are not pooled yet and uploads the pool if it changed; a reloaded mesh or
+    // one unused for kEvictSyncs syncs rebuilds the pool from the batches
+    void sync(const std::vector<MeshBatch>& batches);
+    void bind();
+
+    // global id of the mesh's first triangle, kInvalidBase when its geometry is not available
+    [[nodiscard]] std::uint32_t triangle_base(const MeshData* mesh) const;
+    [[nodiscard]] std::size_t triangle_count() const { return triangles_.size(); }
+
+  private:
+    // std430 layouts of VisibilityVertex and the triangle ivec4 in visibility_resolve.frag
+    struct GpuVertex {
+        // xyz object space position, w texcoord u
+        Vec4f position_u;
+        // xyz object space normal, w texcoord v
+        Vec4f normal_v;
+    };
+    struct GpuTriangle {
+        std::uint32_t vertices[3];
+        std::int32_t material;
+    };
+    struct Entry {
+        std::uint32_t first_triangle{0};
+        // MeshData::gpu_generation when pooled, the key address alone may belong to a newer mesh
+        std::uint64_t generation{0};
+        std::uint64_t used_stamp{0};
+    };
+
+    bool append(const MeshData* mesh);
+    void rebuild(const std::vector<MeshBatch>& batches);
+
+    std::unordered_map<const MeshData*, Entry> entries_;
+    std::vector<GpuVertex> vertices_;
+    std::vector<GpuTriangle> triangles_;
+    std::uint64_t stamp_{0};
+    bool dirty_{false};
+
+    SSBOData vertex_buffer_;
+    SSBOData triangle_buffer_;
+};
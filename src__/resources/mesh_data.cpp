@@ -4,6 +4,8 @@
 
 #include "../logging/logging.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <filesystem>
 #include <fstream>
@@ -17,6 +19,9 @@ using namespace logging;
 MeshData::MeshData(std::string path) : ResourceData(std::move(path)) { set_label("Mesh"); }
 
 namespace {
+std::atomic<bool> g_quantize_shadow_positions{false};
+std::atomic<std::uint64_t> g_gpu_generations{0};
+
 struct Float3 {
     float x{0.0f};
     float y{0.0f};
@@ -268,6 +273,19 @@ bool MeshData::load_to_ram() {
         geometry_.normals[i * 3 + 2] = n.z;
     }
 
+    bounds_ = AABB{};
+    for (std::size_t i = 0; i < vertex_count(); ++i) {
+        bounds_.expand(Vec3f{geometry_.positions[i * 3 + 0], geometry_.positions[i * 3 + 1], geometry_.positions[i * 3 + 2]});
+    }
+    bounding_sphere_.center = bounds_.center();
+    float radius_sq = 0.0f;
+    for (std::size_t i = 0; i < vertex_count(); ++i) {
+        Vec3f offset = Vec3f{geometry_.positions[i * 3 + 0], geometry_.positions[i * 3 + 1], geometry_.positions[i * 3 + 2]}
+                     - bounding_sphere_.center;
+        radius_sq = std::max(radius_sq, offset.dot(offset));
+    }
+    bounding_sphere_.radius = std::sqrt(radius_sq);
+
     has_transparent_materials_ = false;
     has_opaque_materials_ = false;
     for (const auto& slot : material_slots_) {
@@ -303,6 +321,7 @@ bool MeshData::load_to_gpu() {
         return false;
     }
 
+    gpu_generation_ = ++g_gpu_generations;
     gpu_.vao = std::make_unique<VAOData>();
     gpu_.vao->bind();
 
@@ -323,18 +342,17 @@ bool MeshData::load_to_gpu() {
     }
 
     if (!geometry_.material_slots.empty()) {
-        std::vector<int> slot_to_gpu(material_slots_.size(), -1);
+        slot_gpu_materials_.assign(material_slots_.size(), -1);
         for (std::size_t i = 0; i < material_slots_.size(); ++i) {
             if (material_slots_[i]) {
-                slot_to_gpu[i] = material_slots_[i]->gpu_material_index();
+                slot_gpu_materials_[i] = material_slots_[i]->gpu_material_index();
             }
         }
 
         std::vector<int> vertex_material_ids;
         vertex_material_ids.reserve(geometry_.material_slots.size());
         for (int slot : geometry_.material_slots) {
-            int gpu_index = (slot >= 0 && static_cast<std::size_t>(slot) < slot_to_gpu.size()) ? slot_to_gpu[slot] : -1;
-            vertex_material_ids.push_back(gpu_index);
+            vertex_material_ids.push_back(gpu_material_id(slot));
         }
 
         glEnableVertexAttribArray(3);
@@ -346,11 +364,55 @@ bool MeshData::load_to_gpu() {
     gpu_.index_vbo->store_indices(indices32);
 
     gpu_.vao->unbind();
+
+    // depth only passes fetch 12 bytes per vertex instead of the whole interleaving of streams
+    gpu_.position_vao = std::make_unique<VAOData>();
+    gpu_.position_vao->bind();
+    glEnableVertexAttribArray(0);
+    gpu_.position_vbo->attach(0, 3);
+    gpu_.index_vbo->attach_indices();
+    gpu_.position_vao->unbind();
+
+    shadow_position_scale_ = Vec3f{1.0f, 1.0f, 1.0f};
+    shadow_position_offset_ = Vec3f{0.0f, 0.0f, 0.0f};
+    gpu_.shadow_vao = std::make_unique<VAOData>();
+    gpu_.shadow_vao->bind();
+    glEnableVertexAttribArray(0);
+    if (quantize_shadow_positions() && bounds_.valid()) {
+        // shadow maps tolerate the error, 16 bits over the bounds are well below a shadow texel
+        Vec3f center = bounds_.center();
+        Vec3f extents = bounds_.extents();
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extents[axis] <= 0.0f) {
+                extents[axis] = 1.0f;
+            }
+        }
+        std::vector<int16_t> quantized(vertex_count() * 4, 0);
+        for (std::size_t v = 0; v < vertex_count(); ++v) {
+            for (int axis = 0; axis < 3; ++axis) {
+                float unit = (geometry_.positions[v * 3 + axis] - center[axis]) / extents[axis];
+                quantized[v * 4 + axis] = static_cast<int16_t>(std::lround(std::clamp(unit, -1.0f, 1.0f) * 32767.0f));
+            }
+        }
+        gpu_.shadow_position_vbo = std::make_unique<VBOData>();
+        gpu_.shadow_position_vbo->store_normalized(0, 3, 4, quantized);
+        shadow_position_scale_ = extents;
+        shadow_position_offset_ = center;
+    } else {
+        gpu_.position_vbo->attach(0, 3);
+    }
+    gpu_.index_vbo->attach_indices();
+    gpu_.shadow_vao->unbind();
+
     log(1, INFO, "Uploaded mesh to GPU: " + get_path());
     return true;
 }
 
 void MeshData::unload_from_gpu() {
+    slot_gpu_materials_.clear();
+    gpu_.shadow_vao.reset();
+    gpu_.position_vao.reset();
+    gpu_.shadow_position_vbo.reset();
     gpu_.index_vbo.reset();
     gpu_.material_vbo.reset();
     gpu_.uv_vbo.reset();
@@ -375,7 +437,23 @@ void MeshData::draw() const {
     gpu_.vao->unbind();
 }
 
-void MeshData::draw_instanced(GLsizei instance_count, GLuint base_instance) const {
+void MeshData::set_quantize_shadow_positions(bool quantize) { g_quantize_shadow_positions.store(quantize); }
+
+bool MeshData::quantize_shadow_positions() { return g_quantize_shadow_positions.load(); }
+
+VAOData* MeshData::stream_vao(MeshStream stream) const {
+    switch (stream) {
+    case MeshStream::Position:
+        return gpu_.position_vao ? gpu_.position_vao.get() : gpu_.vao.get();
+    case MeshStream::Shadow:
+        return gpu_.shadow_vao ? gpu_.shadow_vao.get() : gpu_.vao.get();
+    case MeshStream::Full:
+    default:
+        return gpu_.vao.get();
+    }
+}
+
+void MeshData::draw_instanced(GLsizei instance_count, GLuint base_instance, MeshStream stream) const {
     if (instance_count <= 0) {
         return;
     }
@@ -387,8 +465,20 @@ void MeshData::draw_instanced(GLsizei instance_count, GLuint base_instance) cons
         logging::log(0, logging::WARNING, "MeshData::draw_instanced skipped: no indices for " + get_path());
         return;
     }
-    gpu_.vao->bind();
+    VAOData* vao = stream_vao(stream);
+    vao->bind();
     glDrawElementsInstancedBaseInstance(GL_TRIANGLES, static_cast<GLsizei>(index_count()), GL_UNSIGNED_INT, nullptr,
                                         instance_count, base_instance);
-    gpu_.vao->unbind();
+    vao->unbind();
+}
+
+void MeshData::draw_indirect(GLintptr command_offset, MeshStream stream) const {
+    if (!gpu_.vao) {
+        logging::log(0, logging::WARNING, "MeshData::draw_indirect skipped: GPU buffers missing for " + get_path());
+        return;
+    }
+    VAOData* vao = stream_vao(stream);
+    vao->bind();
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(command_offset));
+    vao->unbind();
 }
@@ -4,6 +4,7 @@
 
 #include "../gldata/vao_data.h"
 #include "../gldata/vbo_data.h"
+#include "../math/bounds.h"
 #include "../math/mat.h"
 #include "material_data.h"
 
@@ -27,8 +28,16 @@ struct MeshGpuBuffers {
     VBOData::UPtr uv_vbo;
     VBOData::UPtr material_vbo;
     VBOData::UPtr index_vbo;
+    // attribute 0 only, sharing position_vbo, for depth passes that must match the full VAO exactly
+    VAOData::UPtr position_vao;
+    // attribute 0 only, from shadow_position_vbo when shadow positions are quantized, else from position_vbo
+    VAOData::UPtr shadow_vao;
+    VBOData::UPtr shadow_position_vbo;
 };
 
+// vertex streams a mesh can be drawn with; Position and Shadow only feed attribute 0
+enum class MeshStream { Full, Position, Shadow };
+
 struct MeshData : public ResourceData {
     explicit MeshData(std::string path);
 
@@ -42,16 +51,46 @@ struct MeshData : public ResourceData {
     std::size_t vertex_count() const { return geometry_.positions.size() / 3; }
     std::size_t index_count() const { return geometry_.indices.size(); }
 
+    // object space bounds, kept when the geometry is released from RAM so culling keeps working
+    const AABB& bounds() const { return bounds_; }
+    const BoundingSphere& bounding_sphere() const { return bounding_sphere_; }
+
     void draw() const;
-    void draw_instanced(GLsizei instance_count, GLuint base_instance = 0) const;
+    void draw_instanced(GLsizei instance_count, GLuint base_instance = 0, MeshStream stream = MeshStream::Full) const;
+    // expects a GL_DRAW_INDIRECT_BUFFER to be bound; offset is in bytes
+    void draw_indirect(GLintptr command_offset, MeshStream stream = MeshStream::Full) const;
+
+    // stores shadow positions of meshes uploaded afterwards as 16 bit normalized values over their bounds
+    static void set_quantize_shadow_positions(bool quantize);
+    static bool quantize_shadow_positions();
+    // object space position of the shadow stream = attribute * scale + offset, identity for float positions
+    const Vec3f& shadow_position_scale() const { return shadow_position_scale_; }
+    const Vec3f& shadow_position_offset() const { return shadow_position_offset_; }
+
+    // GPU material index of a material slot as uploaded with the vertices, -1 for none
+    int gpu_material_id(int slot) const {
+        return slot >= 0 && static_cast<std::size_t>(slot) < slot_gpu_materials_.size() ? slot_gpu_materials_[slot] : -1;
+    }
 
     bool has_transparent_materials() const { return has_transparent_materials_; }
     bool has_opaque_materials() const { return has_opaque_materials_; }
 
+    // unique across all meshes and renewed by every upload, caches keyed by address compare it to spot reloads
+    // and meshes that reuse the address of a released one
+    std::uint64_t gpu_generation() const { return gpu_generation_; }
+
   private:
+    VAOData* stream_vao(MeshStream stream) const;
+
     MeshGeometry geometry_;
     MeshGpuBuffers gpu_;
+    AABB bounds_;
+    BoundingSphere bounding_sphere_;
+    Vec3f shadow_position_scale_{1.0f, 1.0f, 1.0f};
+    Vec3f shadow_position_offset_{0.0f, 0.0f, 0.0f};
     std::vector<std::shared_ptr<MaterialData>> material_slots_;
+    std::vector<int> slot_gpu_materials_;
     bool has_transparent_materials_{false};
     bool has_opaque_materials_{false};
+    std::uint64_t gpu_generation_{0};
 };
@@ -21,12 +21,14 @@ ShaderProgram::~ShaderProgram() {
     glDetachShader(program_id, geometry_shader_id);
     glDetachShader(program_id, tess_control_shader_id);
     glDetachShader(program_id, tess_eval_shader_id);
+    glDetachShader(program_id, compute_shader_id);
 
     glDeleteShader(vertex_shader_id);
     glDeleteShader(fragment_shader_id);
     glDeleteShader(geometry_shader_id);
     glDeleteShader(tess_control_shader_id);
     glDeleteShader(tess_eval_shader_id);
+    glDeleteShader(compute_shader_id);
 
     glDeleteProgram(program_id);
 }
@@ -56,11 +58,39 @@ ShaderProgram& ShaderProgram::tess_eval_file(const string& file) {
     return *this;
 }
 
+ShaderProgram& ShaderProgram::compute_file(const string& file) {
+    compute_file_ = file;
+    return *this;
+}
+
 ShaderProgram& ShaderProgram::compile() {
     if (created)
         return *this;
     created = true;
 
+    // compute programs consist of a single stage and cannot be mixed with the graphics stages
+    if (!compute_file_.empty()) {
+        compute_shader_id = load_shader(compute_file_, GL_COMPUTE_SHADER);
+        program_id = glCreateProgram();
+        if (compute_shader_id == 0) {
+            printf("%-13s %-100s %-20s\n", "Linking", "", "Status = NO COMPUTE STAGE");
+            fflush(stdout);
+            return *this;
+        }
+        glAttachShader(program_id, compute_shader_id);
+        glLinkProgram(program_id);
+        if (!check_link_status()) {
+            return *this;
+        }
+        glValidateProgram(program_id);
+
+        get_all_uniform_locations();
+
+        printf("%-13s %-100s %-20s\n", "Linking", "", warnings ? "Status = WARNINGS" : "Status = SUCCESSFUL");
+        fflush(stdout);
+        return *this;
+    }
+
     vertex_shader_id = load_shader(vertex_file_, GL_VERTEX_SHADER);
     fragment_shader_id = load_shader(fragment_file_, GL_FRAGMENT_SHADER);
     geometry_shader_id = geometry_file_.empty() ? 0 : load_shader(geometry_file_, GL_GEOMETRY_SHADER);
@@ -79,6 +109,9 @@ ShaderProgram& ShaderProgram::compile() {
 
     bind_attributes();
     glLinkProgram(program_id);
+    if (!check_link_status()) {
+        return *this;
+    }
     glValidateProgram(program_id);
 
     get_all_uniform_locations();
@@ -94,6 +127,24 @@ ShaderProgram& ShaderProgram::compile() {
 
 bool ShaderProgram::is_created() const { return created; }
 
+bool ShaderProgram::check_link_status() {
+    GLint result = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &result);
+    linked = result == GL_TRUE;
+    if (!linked) {
+        printf("%-13s %-100s %-20s\n", "Linking", "", "Status = FAILED");
+        GLint log_len = 0;
+        glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &log_len);
+        auto* log = new char[log_len + 1];
+        log[0] = '\0';
+        glGetProgramInfoLog(program_id, log_len, nullptr, log);
+        cerr << log << endl;
+        delete[] log;
+        fflush(stdout);
+    }
+    return linked;
+}
+
 void ShaderProgram::start() {
     if (created)
         glUseProgram(program_id);
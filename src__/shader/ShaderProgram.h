@@ -10,6 +10,7 @@
 class ShaderProgram {
   private:
     bool created = false;
+    bool linked = false;
     bool warnings = false;
 
     std::string vertex_file_;
@@ -17,6 +18,7 @@ class ShaderProgram {
     std::string geometry_file_;
     std::string tess_control_file_;
     std::string tess_eval_file_;
+    std::string compute_file_;
 
     GLuint program_id = 0;
     GLuint vertex_shader_id = 0;
@@ -24,6 +26,7 @@ class ShaderProgram {
     GLuint geometry_shader_id = 0;
     GLuint tess_control_shader_id = 0;
     GLuint tess_eval_shader_id = 0;
+    GLuint compute_shader_id = 0;
 
   public:
     ShaderProgram() = default;
@@ -34,11 +37,14 @@ class ShaderProgram {
     ShaderProgram& geometry_file(const std::string& file);
     ShaderProgram& tess_control_file(const std::string& file);
     ShaderProgram& tess_eval_file(const std::string& file);
+    ShaderProgram& compute_file(const std::string& file);
     ShaderProgram& compile();
 
     void start();
     void stop();
     bool is_created() const;
+    // false when a stage failed to compile or the program failed to link
+    bool is_linked() const { return linked; }
     GLuint program_id_handle() const { return program_id; }
 
   protected:
@@ -48,6 +54,7 @@ class ShaderProgram {
 
     int get_uniform_location(const std::string& uniform_name);
     int load_shader(const std::string& file, GLenum type);
+    bool check_link_status();
     std::string preprocess_shader(const std::string& file_path, std::unordered_set<std::string>& visited);
 
   public:
@@ -0,0 +1,99 @@
+#include "CullingShader.h"
+
+#include <string>
+
+#include <glad/glad.h>
+
+CullingShader::CullingShader()
+    : range_count_location_(-1)
+    , total_instances_location_(-1)
+    , lod_scale_location_(-1)
+    , min_pixel_radius_location_(-1)
+    , occlusion_phase_location_(-1)
+    , candidate_remap_location_(-1)
+    , view_projection_location_(-1)
+    , hiz_location_(-1)
+    , hiz_size_location_(-1)
+    , hiz_levels_location_(-1) {
+    frustum_plane_locations_.fill(-1);
+}
+
+bool CullingShader::init(const std::filesystem::path& shader_dir) {
+    compute_file((shader_dir / "culling" / "frustum_cull.comp").string());
+    compile();
+    if (!is_linked()) {
+        return false;
+    }
+    get_all_uniform_locations();
+    return true;
+}
+
+void CullingShader::get_all_uniform_locations() {
+    for (int i = 0; i < 6; ++i) {
+        frustum_plane_locations_[i] = get_uniform_location("u_frustum_planes[" + std::to_string(i) + "]");
+    }
+    range_count_location_ = get_uniform_location("u_range_count");
+    total_instances_location_ = get_uniform_location("u_total_instances");
+    lod_scale_location_ = get_uniform_location("u_lod_scale");
+    min_pixel_radius_location_ = get_uniform_location("u_min_pixel_radius");
+    occlusion_phase_location_ = get_uniform_location("u_occlusion_phase");
+    candidate_remap_location_ = get_uniform_location("u_candidate_remap");
+    view_projection_location_ = get_uniform_location("u_view_projection");
+    hiz_location_ = get_uniform_location("u_hiz");
+    hiz_size_location_ = get_uniform_location("u_hiz_size");
+    hiz_levels_location_ = get_uniform_location("u_hiz_levels");
+}
+
+void CullingShader::set_frustum(const Frustum& frustum) {
+    for (int i = 0; i < 6; ++i) {
+        if (frustum_plane_locations_[i] >= 0) {
+            const auto& plane = frustum.planes[i];
+            glUniform4f(frustum_plane_locations_[i], plane[0], plane[1], plane[2], plane[3]);
+        }
+    }
+}
+
+void CullingShader::set_range_count(GLuint range_count, GLuint total_instances) {
+    if (range_count_location_ >= 0) {
+        glUniform1ui(range_count_location_, range_count);
+    }
+    if (total_instances_location_ >= 0) {
+        glUniform1ui(total_instances_location_, total_instances);
+    }
+}
+
+void CullingShader::set_lod_params(float lod_scale, float min_pixel_radius) {
+    if (lod_scale_location_ >= 0) {
+        glUniform1f(lod_scale_location_, lod_scale);
+    }
+    if (min_pixel_radius_location_ >= 0) {
+        glUniform1f(min_pixel_radius_location_, min_pixel_radius);
+    }
+}
+
+void CullingShader::set_occlusion_phase(int phase) {
+    if (occlusion_phase_location_ >= 0) {
+        glUniform1i(occlusion_phase_location_, phase);
+    }
+}
+
+void CullingShader::set_candidate_remap(bool enabled) {
+    if (candidate_remap_location_ >= 0) {
+        glUniform1i(candidate_remap_location_, enabled ? 1 : 0);
+    }
+}
+
+void CullingShader::set_hiz(const Mat4f& view_projection, int width, int height, int levels, int texture_unit) {
+    if (view_projection_location_ >= 0) {
+        load_matrix(view_projection_location_, const_cast<Mat4f&>(view_projection));
+    }
+    if (hiz_location_ >= 0) {
+        glUniform1i(hiz_location_, texture_unit);
+    }
+    if (hiz_size_location_ >= 0) {
+        glUniform2f(hiz_size_location_, static_cast<float>(width), static_cast<float>(height));
+    }
+    if (hiz_levels_location_ >= 0) {
+        glUniform1i(hiz_levels_location_, levels);
+    }
+}
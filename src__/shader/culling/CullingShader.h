@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../ShaderProgram.h"
+
+#include <array>
+#include <filesystem>
+
+#include "../../math/bounds.h"
+
+class CullingShader : public ShaderProgram {
+  public:
+    CullingShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_frustum(const Frustum& frustum);
+    void set_range_count(GLuint range_count, GLuint total_instances);
+    void set_lod_params(float lod_scale, float min_pixel_radius);
+    void set_occlusion_phase(int phase);
+    void set_candidate_remap(bool enabled);
+    void set_hiz(const Mat4f& view_projection, int width, int height, int levels, int texture_unit);
+
+  protected:
+    void get_all_uniform_locations() override;
+
+  private:
+    std::array<GLint, 6> frustum_plane_locations_;
+    GLint range_count_location_;
+    GLint total_instances_location_;
+    GLint lod_scale_location_;
+    GLint min_pixel_radius_location_;
+    GLint occlusion_phase_location_;
+    GLint candidate_remap_location_;
+    GLint view_projection_location_;
+    GLint hiz_location_;
+    GLint hiz_size_location_;
+    GLint hiz_levels_location_;
+};
@@ -0,0 +1,41 @@
+#include "HiZShader.h"
+
+#include <glad/glad.h>
+
+HiZShader::HiZShader()
+    : source_location_(-1)
+    , source_level_location_(-1)
+    , source_size_location_(-1)
+    , copy_depth_location_(-1) {}
+
+bool HiZShader::init(const std::filesystem::path& shader_dir) {
+    compute_file((shader_dir / "culling" / "hiz_build.comp").string());
+    compile();
+    if (!is_linked()) {
+        return false;
+    }
+    get_all_uniform_locations();
+    return true;
+}
+
+void HiZShader::get_all_uniform_locations() {
+    source_location_ = get_uniform_location("u_source");
+    source_level_location_ = get_uniform_location("u_source_level");
+    source_size_location_ = get_uniform_location("u_source_size");
+    copy_depth_location_ = get_uniform_location("u_copy_depth");
+}
+
+void HiZShader::set_source(int level, int width, int height, bool copy_depth) {
+    if (source_location_ >= 0) {
+        glUniform1i(source_location_, 0);
+    }
+    if (source_level_location_ >= 0) {
+        glUniform1i(source_level_location_, level);
+    }
+    if (source_size_location_ >= 0) {
+        glUniform2i(source_size_location_, width, height);
+    }
+    if (copy_depth_location_ >= 0) {
+        glUniform1i(copy_depth_location_, copy_depth ? 1 : 0);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../ShaderProgram.h"
+
+#include <filesystem>
+
+class HiZShader : public ShaderProgram {
+  public:
+    HiZShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_source(int level, int width, int height, bool copy_depth);
+
+  protected:
+    void get_all_uniform_locations() override;
+
+  private:
+    GLint source_location_;
+    GLint source_level_location_;
+    GLint source_size_location_;
+    GLint copy_depth_location_;
+};
@@ -0,0 +1,45 @@
+#include "DeferredLightingShader.h"
+
+DeferredLightingShader::DeferredLightingShader()
+    : inverse_view_projection_location_(-1)
+    , base_metallic_location_(-1)
+    , normal_roughness_location_(-1)
+    , emission_location_(-1)
+    , depth_location_(-1) {}
+
+bool DeferredLightingShader::init(const std::filesystem::path& shader_dir) {
+    vertex_file((shader_dir / "deferred" / "deferred_lighting.vert").string());
+    fragment_file((shader_dir / "deferred" / "deferred_lighting.frag").string());
+    compile();
+    get_all_uniform_locations();
+    return true;
+}
+
+void DeferredLightingShader::get_all_uniform_locations() {
+    LitShader::get_all_uniform_locations();
+    inverse_view_projection_location_ = get_uniform_location("u_inverse_view_projection");
+    base_metallic_location_ = get_uniform_location("u_gbuffer_base_metallic");
+    normal_roughness_location_ = get_uniform_location("u_gbuffer_normal_roughness");
+    emission_location_ = get_uniform_location("u_gbuffer_emission");
+    depth_location_ = get_uniform_location("u_gbuffer_depth");
+}
+
+void DeferredLightingShader::set_inverse_view_projection(const Mat4f& inverse_view_projection) {
+    load_matrix(inverse_view_projection_location_, const_cast<Mat4f&>(inverse_view_projection));
+}
+
+void DeferredLightingShader::set_gbuffer_textures(int base_metallic_unit, int normal_roughness_unit, int emission_unit,
+                                                  int depth_unit) {
+    if (base_metallic_location_ >= 0) {
+        glUniform1i(base_metallic_location_, base_metallic_unit);
+    }
+    if (normal_roughness_location_ >= 0) {
+        glUniform1i(normal_roughness_location_, normal_roughness_unit);
+    }
+    if (emission_location_ >= 0) {
+        glUniform1i(emission_location_, emission_unit);
+    }
+    if (depth_location_ >= 0) {
+        glUniform1i(depth_location_, depth_unit);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "../lit/LitShader.h"
+
+// fullscreen pass that shades the G-buffer with the same lighting code as the forward lit shader
+class DeferredLightingShader : public LitShader {
+public:
+    DeferredLightingShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_inverse_view_projection(const Mat4f& inverse_view_projection);
+    void set_gbuffer_textures(int base_metallic_unit, int normal_roughness_unit, int emission_unit, int depth_unit);
+
+protected:
+    void get_all_uniform_locations() override;
+
+private:
+    GLint inverse_view_projection_location_;
+    GLint base_metallic_location_;
+    GLint normal_roughness_location_;
+    GLint emission_location_;
+    GLint depth_location_;
+};
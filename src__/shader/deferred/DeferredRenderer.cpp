@@ -0,0 +1,109 @@
+#include "DeferredRenderer.h"
+
+#include <string>
+
+#include "../../logging/logging.h"
+#include "../../rendering/lighting/LightClusters.h"
+
+namespace {
+constexpr int kShadowAtlasUnit = 1;
+constexpr int kBaseMetallicUnit = 2;
+constexpr int kNormalRoughnessUnit = 3;
+constexpr int kEmissionUnit = 4;
+constexpr int kDepthUnit = 5;
+
+void bind_texture(int unit, const TextureData* texture) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture ? static_cast<GLuint>(*texture) : 0);
+}
+}
+
+DeferredRenderer::DeferredRenderer() = default;
+
+DeferredRenderer::~DeferredRenderer() {
+    if (fullscreen_vao_ != 0) {
+        glDeleteVertexArrays(1, &fullscreen_vao_);
+    }
+}
+
+bool DeferredRenderer::init(const std::filesystem::path& shader_dir) {
+    if (!lighting_shader_.init(shader_dir)) {
+        logging::log(0, logging::ERROR, "DeferredRenderer: failed to initialize lighting shader");
+        return false;
+    }
+    lighting_shader_.start();
+    lighting_shader_.set_gbuffer_textures(kBaseMetallicUnit, kNormalRoughnessUnit, kEmissionUnit, kDepthUnit);
+    lighting_shader_.stop();
+    glGenVertexArrays(1, &fullscreen_vao_);
+    return true;
+}
+
+void DeferredRenderer::prepare_gbuffer(const FBOData::SPtr& gbuffer_fbo) {
+    if (!gbuffer_fbo) {
+        return;
+    }
+    GLuint fbo = static_cast<GLuint>(*gbuffer_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    GLenum buffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, buffers);
+    const float clear_zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 3; ++i) {
+        glClearBufferfv(GL_COLOR, i, clear_zero);
+    }
+    glDepthMask(GL_TRUE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDrawBuffer(GL_BACK);
+    glReadBuffer(GL_BACK);
+}
+
+void DeferredRenderer::resolve(const FBOData::SPtr& target, const GBuffer& gbuffer, int width, int height,
+                               const Mat4f& view_matrix, const Mat4f& projection_matrix,
+                               const Vec3f& camera_position,
+                               const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights) {
+    if (!target) {
+        return;
+    }
+    GLuint fbo = static_cast<GLuint>(*target);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    Mat4f inverse_view_projection = projection_matrix.matmul(view_matrix).inverse();
+
+    lighting_shader_.start();
+    lighting_shader_.set_camera_matrices(view_matrix, projection_matrix);
+    lighting_shader_.set_camera_position(camera_position);
+    lighting_shader_.set_inverse_view_projection(inverse_view_projection);
+    lighting_shader_.set_debug_mode(0);
+    lighting_shader_.set_directional_lights(directional_lights);
+    if (light_clusters_) {
+        light_clusters_->bind();
+    }
+    lighting_shader_.set_light_clusters(light_clusters_, width, height);
+    if (shadow_atlas_ && shadow_atlas_->texture()) {
+        lighting_shader_.bind_shadow_atlas(static_cast<GLuint>(*shadow_atlas_->texture()), kShadowAtlasUnit,
+                                           shadow_atlas_->filter());
+    }
+    bind_texture(kBaseMetallicUnit, gbuffer.base_metallic);
+    bind_texture(kNormalRoughnessUnit, gbuffer.normal_roughness);
+    bind_texture(kEmissionUnit, gbuffer.emission);
+    bind_texture(kDepthUnit, gbuffer.depth);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(fullscreen_vao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    lighting_shader_.stop();
+
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDrawBuffer(GL_BACK);
+    glReadBuffer(GL_BACK);
+
+    logging::log(0, logging::DEBUG,
+                 "DeferredRenderer: resolved G-buffer with " +
+                     std::to_string(light_clusters_ ? light_clusters_->light_count() : 0) + " clustered lights");
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "DeferredLightingShader.h"
+#include "../../gldata/fbo_data.h"
+#include "../../gldata/texture_data.h"
+#include "../../lighting/shadow_atlas.h"
+
+class LightClusters;
+class Transformation;
+
+// Deferred alternative to the forward lit pass. Opaque geometry writes its material attributes into the G-buffer,
+// a fullscreen pass then shades every covered pixel once. The local light lists come from the same froxel clusters
+// the forward path uses, so the lighting pass only loops over the lights of its cluster.
+class DeferredRenderer {
+public:
+    // G-buffer textures, owned by the frame graph
+    struct GBuffer {
+        const TextureData* base_metallic{nullptr};
+        const TextureData* normal_roughness{nullptr};
+        const TextureData* emission{nullptr};
+        const TextureData* depth{nullptr};
+    };
+
+    DeferredRenderer();
+    ~DeferredRenderer();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_shadow_atlas(const ShadowAtlas* atlas) { shadow_atlas_ = atlas; }
+    void set_light_clusters(LightClusters* clusters) { light_clusters_ = clusters; }
+
+    // clears the three color targets and depth of a G-buffer framebuffer
+    void prepare_gbuffer(const FBOData::SPtr& gbuffer_fbo);
+    // shades every covered G-buffer pixel into the color attachment of target
+    void resolve(const FBOData::SPtr& target, const GBuffer& gbuffer, int width, int height,
+                 const Mat4f& view_matrix, const Mat4f& projection_matrix, const Vec3f& camera_position,
+                 const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights);
+
+private:
+    DeferredLightingShader lighting_shader_;
+    const ShadowAtlas* shadow_atlas_{nullptr};
+    LightClusters* light_clusters_{nullptr};
+    GLuint fullscreen_vao_{0};
+};
@@ -0,0 +1,11 @@
+#include "GBufferShader.h"
+
+GBufferShader::GBufferShader() = default;
+
+bool GBufferShader::init(const std::filesystem::path& shader_dir) {
+    vertex_file((shader_dir / "lit" / "lit.vert").string());
+    fragment_file((shader_dir / "deferred" / "gbuffer.frag").string());
+    compile();
+    get_all_uniform_locations();
+    return true;
+}
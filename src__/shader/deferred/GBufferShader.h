@@ -0,0 +1,11 @@
+#pragma once
+
+#include "../lit/LitShader.h"
+
+// writes material attributes of opaque geometry into the G-buffer instead of shading it
+class GBufferShader : public LitShader {
+public:
+    GBufferShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+};
@@ -0,0 +1,52 @@
+#version 450 core
+#extension GL_ARB_bindless_texture : require
+#extension GL_ARB_gpu_shader_int64 : require
+
+#include "../lit/lit_common.glsl"
+#include "gbuffer_common.glsl"
+
+layout(location = 0) out vec4 frag_color;
+
+in vec2 v_uv;
+
+uniform sampler2D u_gbuffer_base_metallic;
+uniform sampler2D u_gbuffer_normal_roughness;
+uniform sampler2D u_gbuffer_emission;
+uniform sampler2D u_gbuffer_depth;
+uniform mat4 u_inverse_view_projection;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(u_gbuffer_depth, texel, 0).r;
+    // nothing was drawn here, keep the clear color
+    if (depth >= 1.0) {
+        discard;
+    }
+
+    vec4 clip = vec4(v_uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = u_inverse_view_projection * clip;
+    vec3 world_pos = world.xyz / world.w;
+
+    vec4 base_metallic = texelFetch(u_gbuffer_base_metallic, texel, 0);
+    vec4 normal_roughness = texelFetch(u_gbuffer_normal_roughness, texel, 0);
+
+    MaterialSample _sample;
+    _sample.base_color = base_metallic.rgb;
+    _sample.metallic = base_metallic.a;
+    _sample.roughness = normal_roughness.z;
+    _sample.emission = texelFetch(u_gbuffer_emission, texel, 0).rgb;
+    _sample.transmission = normal_roughness.w;
+
+    vec3 N = decode_normal(normal_roughness.xy);
+    vec3 V = normalize(u_camera_pos - world_pos);
+    if (length(V) < 1e-5) {
+        V = vec3(0.0, 0.0, 1.0);
+    }
+
+    if (u_debug_mode == 1) {
+        frag_color = vec4(N * 0.5 + 0.5, 1.0);
+        return;
+    }
+
+    frag_color = vec4(evaluate_lit_color(_sample, N, V, world_pos), 1.0);
+}
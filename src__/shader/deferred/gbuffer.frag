@@ -0,0 +1,36 @@
+#version 450 core
+#extension GL_ARB_bindless_texture : require
+#extension GL_ARB_gpu_shader_int64 : require
+
+#include "../lit/lit_common.glsl"
+#include "gbuffer_common.glsl"
+
+// rgb base color, a metallic
+layout(location = 0) out vec4 out_base_metallic;
+// xy octahedral normal, z roughness, w transmission
+layout(location = 1) out vec4 out_normal_roughness;
+layout(location = 2) out vec3 out_emission;
+
+in VS_OUT {
+    vec3 world_pos;
+    vec3 normal;
+    vec2 uv;
+} fs_in;
+flat in int v_material_id;
+
+void main() {
+    MaterialSample _sample = sample_material(v_material_id, fs_in.uv);
+
+    // same checker override as lit.frag so both paths produce the same image
+    const float tile_size = 0.05;
+    vec2 grid = floor(fs_in.uv / tile_size);
+    float checker = mod(grid.x + grid.y, 2.0);
+    vec3 checker_color_light = vec3(0.92, 0.92, 0.92);
+    vec3 checker_color_dark = vec3(0.12, 0.12, 0.12);
+    _sample.base_color = mix(checker_color_dark, checker_color_light, checker);
+
+    vec3 N = normalize(fs_in.normal);
+    out_base_metallic = vec4(_sample.base_color, _sample.metallic);
+    out_normal_roughness = vec4(encode_normal(N), _sample.roughness, _sample.transmission);
+    out_emission = _sample.emission;
+}
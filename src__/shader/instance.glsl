@@ -0,0 +1,77 @@
+#ifndef INSTANCE_GLSL
+#define INSTANCE_GLSL
+
+// matches InstanceFormat
+#define INSTANCE_FORMAT_MATRIX 0u
+#define INSTANCE_FORMAT_AFFINE 1u
+#define INSTANCE_FORMAT_POSITION_ROTATION_SCALE 2u
+#define INSTANCE_FORMAT_QUANTIZED 3u
+
+// header written by InstanceBuffer, followed by instance_stride words of 16 bytes per instance
+layout(std430, binding = 0) readonly buffer InstanceBuffer {
+    uint instance_format;
+    uint instance_stride;
+    // grid of the quantized positions
+    vec4 instance_origin;
+    vec4 instance_step;
+    uvec4 instance_data[];
+};
+
+mat4 instance_compose(vec3 position, vec4 q, float scale) {
+    vec3 q2 = q.xyz * 2.0;
+    vec3 diagonal = vec3(1.0) - vec3(q.y * q2.y + q.z * q2.z, q.x * q2.x + q.z * q2.z, q.x * q2.x + q.y * q2.y);
+    float xy = q.x * q2.y;
+    float xz = q.x * q2.z;
+    float yz = q.y * q2.z;
+    float wx = q.w * q2.x;
+    float wy = q.w * q2.y;
+    float wz = q.w * q2.z;
+    return mat4(vec4(diagonal.x, xy + wz, xz - wy, 0.0) * scale,
+                vec4(xy - wz, diagonal.y, yz + wx, 0.0) * scale,
+                vec4(xz + wy, yz - wx, diagonal.z, 0.0) * scale,
+                vec4(position, 1.0));
+}
+
+// smallest three encoding: index of the dropped largest component in the top two bits, the others as 10 bit unorm
+vec4 instance_unpack_rotation(uint packed) {
+    const float range = 0.70710678;
+    vec3 small = (vec3(uvec3(packed >> 20u, packed >> 10u, packed) & 1023u) / 1023.0 * 2.0 - 1.0) * range;
+    float largest = sqrt(max(0.0, 1.0 - dot(small, small)));
+    uint index = packed >> 30u;
+    if (index == 0u) {
+        return vec4(largest, small);
+    }
+    if (index == 1u) {
+        return vec4(small.x, largest, small.yz);
+    }
+    if (index == 2u) {
+        return vec4(small.xy, largest, small.z);
+    }
+    return vec4(small, largest);
+}
+
+// model matrix of the instance in the given slot, whatever format the buffer holds
+mat4 instance_model(uint index) {
+    uint base = index * instance_stride;
+    if (instance_format == INSTANCE_FORMAT_MATRIX || instance_format == INSTANCE_FORMAT_AFFINE) {
+        vec4 row0 = uintBitsToFloat(instance_data[base]);
+        vec4 row1 = uintBitsToFloat(instance_data[base + 1u]);
+        vec4 row2 = uintBitsToFloat(instance_data[base + 2u]);
+        vec4 row3 = instance_format == INSTANCE_FORMAT_MATRIX ? uintBitsToFloat(instance_data[base + 3u])
+                                                              : vec4(0.0, 0.0, 0.0, 1.0);
+        return transpose(mat4(row0, row1, row2, row3));
+    }
+    if (instance_format == INSTANCE_FORMAT_POSITION_ROTATION_SCALE) {
+        vec4 position_scale = uintBitsToFloat(instance_data[base]);
+        vec4 rotation = uintBitsToFloat(instance_data[base + 1u]);
+        return instance_compose(position_scale.xyz, rotation, position_scale.w);
+    }
+    // 21 bits per position axis over two words, rotation in the third, half float scale in the fourth
+    uvec4 words = instance_data[base];
+    uvec3 cell = uvec3(words.x & 0x1FFFFFu, (words.x >> 21u) | ((words.y & 0x3FFu) << 11u),
+                       (words.y >> 10u) & 0x1FFFFFu);
+    vec3 position = instance_origin.xyz + instance_step.xyz * vec3(cell);
+    return instance_compose(position, instance_unpack_rotation(words.z), unpackHalf2x16(words.w).x);
+}
+
+#endif
@@ -0,0 +1,38 @@
+#include "DepthPrepassShader.h"
+
+#include <glad/glad.h>
+
+DepthPrepassShader::DepthPrepassShader()
+    : view_location_(-1), projection_location_(-1), instance_remap_location_(-1), vertex_pulling_location_(-1) {}
+
+bool DepthPrepassShader::init(const std::filesystem::path& shader_dir) {
+    vertex_file((shader_dir / "lit" / "depth_prepass.vert").string());
+    fragment_file((shader_dir / "lit" / "depth_prepass.frag").string());
+    compile();
+    get_all_uniform_locations();
+    return true;
+}
+
+void DepthPrepassShader::get_all_uniform_locations() {
+    view_location_ = get_uniform_location("u_view");
+    projection_location_ = get_uniform_location("u_projection");
+    instance_remap_location_ = get_uniform_location("u_instance_remap");
+    vertex_pulling_location_ = get_uniform_location("u_vertex_pulling");
+}
+
+void DepthPrepassShader::set_camera_matrices(const Mat4f& view, const Mat4f& projection) {
+    load_matrix(view_location_, const_cast<Mat4f&>(view));
+    load_matrix(projection_location_, const_cast<Mat4f&>(projection));
+}
+
+void DepthPrepassShader::set_instance_remap(bool enabled) {
+    if (instance_remap_location_ >= 0) {
+        glUniform1i(instance_remap_location_, enabled ? 1 : 0);
+    }
+}
+
+void DepthPrepassShader::set_vertex_pulling(bool enabled) {
+    if (vertex_pulling_location_ >= 0) {
+        glUniform1i(vertex_pulling_location_, enabled ? 1 : 0);
+    }
+}
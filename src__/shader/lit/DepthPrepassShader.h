@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../ShaderProgram.h"
+
+#include <filesystem>
+
+#include "../../math/mat.h"
+
+// position only depth pass in front of the opaque lit pass, shares the vertex transform of lit.vert
+class DepthPrepassShader : public ShaderProgram {
+  public:
+    DepthPrepassShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_camera_matrices(const Mat4f& view, const Mat4f& projection);
+    void set_instance_remap(bool enabled);
+    void set_vertex_pulling(bool enabled);
+
+  protected:
+    void get_all_uniform_locations() override;
+
+  private:
+    GLint view_location_;
+    GLint projection_location_;
+    GLint instance_remap_location_;
+    GLint vertex_pulling_location_;
+};
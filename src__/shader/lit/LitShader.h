@@ -7,10 +7,9 @@
 
 #include "../../core/config.h"
 #include "../../lighting/directional_light.h"
-#include "../../lighting/point_light.h"
-#include "../../lighting/spot_light.h"
 #include "../../math/mat.h"
 
+class LightClusters;
 class Transformation;
 
 class LitShader : public ShaderProgram {
@@ -22,13 +21,15 @@ class LitShader : public ShaderProgram {
     void set_camera_matrices(const Mat4f& view, const Mat4f& projection);
     void set_camera_position(const Vec3f& position);
     void set_debug_mode(int mode);
+    void set_instance_remap(bool enabled);
+    // fetch vertices from the VertexPool by gl_VertexID instead of the vertex attributes
+    void set_vertex_pulling(bool enabled);
 
     void set_directional_lights(const std::vector<std::pair<DirectionalLight*, Transformation*>>& lights);
-    void set_spot_lights(const std::vector<std::pair<SpotLight*, Transformation*>>& lights);
-    void set_point_lights(const std::vector<std::pair<PointLight*, Transformation*>>& lights);
-    void bind_directional_shadow_map(int index, GLuint texture_id, int texture_unit);
-    void bind_spot_shadow_map(int index, GLuint texture_id, int texture_unit);
-    void bind_point_shadow_map(int index, GLuint texture_id, int texture_unit);
+    // cluster lookup of the local lights bound by LightClusters::bind, nullptr disables spot and point lights
+    void set_light_clusters(const LightClusters* clusters, int width, int height);
+    // binds the atlas as a depth compare texture and selects how many taps each lookup takes
+    void bind_shadow_atlas(GLuint texture_id, int texture_unit, ShadowFilter filter);
 
   protected:
     void get_all_uniform_locations() override;
@@ -38,46 +39,26 @@ class LitShader : public ShaderProgram {
     GLint projection_location_;
     GLint camera_pos_location_;
     GLint debug_mode_location_;
+    GLint instance_remap_location_;
+    GLint vertex_pulling_location_;
 
     GLint directional_light_count_location_;
-    GLint spot_light_count_location_;
-    GLint point_light_count_location_;
+    GLint shadow_atlas_location_;
+    GLint shadow_filter_location_;
+    GLint cluster_grid_location_;
+    GLint cluster_params_location_;
+    GLint cluster_linear_depth_location_;
 
     struct DirectionalLightUniforms {
         GLint color;
         GLint intensity;
         GLint direction;
         GLint casts_shadows;
-        GLint view_projection;
-        GLint shadow_sampler;
+        GLint cascade_count;
+        GLint cascade_splits;
+        GLint cascade_view_projection[MAX_SHADOW_CASCADES];
+        GLint cascade_rects;
     };
 
     std::vector<DirectionalLightUniforms> directional_light_uniforms_;
-
-    struct SpotLightUniforms {
-        GLint color;
-        GLint intensity;
-        GLint position;
-        GLint direction;
-        GLint range;
-        GLint cos_inner;
-        GLint cos_outer;
-        GLint casts_shadows;
-        GLint view_projection;
-        GLint shadow_sampler;
-    };
-
-    std::vector<SpotLightUniforms> spot_light_uniforms_;
-
-    struct PointLightUniforms {
-        GLint color;
-        GLint intensity;
-        GLint position;
-        GLint radius;
-        GLint casts_shadows;
-        GLint shadow_far;
-        GLint shadow_sampler;
-    };
-
-    std::vector<PointLightUniforms> point_light_uniforms_;
 };
@@ -0,0 +1,5 @@
+#version 460 core
+
+// depth only, color writes are masked while the pre-pass runs
+void main() {
+}
@@ -5,10 +5,16 @@ layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_texcoord;
 layout(location = 3) in int  in_material_id;
 
-layout(std430, row_major, binding = 0) readonly buffer InstanceBuffer {
-    mat4 instance_matrices[];
+#include "../instance.glsl"
+#include "../vertex_pull.glsl"
+
+// written by the GPU culling pre-pass, maps a drawn instance to its slot in InstanceBuffer
+layout(std430, binding = 1) readonly buffer VisibleInstanceBuffer {
+    uint visible_instances[];
 };
 
+uniform int u_instance_remap;
+
 uniform mat4 u_view;
 uniform mat4 u_projection;
 
@@ -19,13 +25,30 @@ out VS_OUT {
 } vs_out;
 flat out int v_material_id;
 
+// must match the depth pre-pass exactly, the lit pass then tests with GL_EQUAL
+invariant gl_Position;
+
 void main() {
     uint index = gl_BaseInstance + gl_InstanceID;
-    mat4 model = instance_matrices[index];
-    vec4 world = model * vec4(in_position, 1.0);
+    if (u_instance_remap != 0) {
+        index = visible_instances[index];
+    }
+    vec3 position = in_position;
+    vec3 normal = in_normal;
+    vec2 texcoord = in_texcoord;
+    int material_id = in_material_id;
+    if (u_vertex_pulling != 0) {
+        PulledVertex vertex = pulled_vertex();
+        position = pulled_position(vertex);
+        normal = pulled_normal(vertex);
+        texcoord = pulled_texcoord(vertex);
+        material_id = vertex.material;
+    }
+    mat4 model = instance_model(index);
+    vec4 world = model * vec4(position, 1.0);
     vs_out.world_pos = world.xyz;
-    vs_out.normal = mat3(transpose(inverse(model))) * in_normal;
-    vs_out.uv = in_texcoord;
+    vs_out.normal = mat3(transpose(inverse(model))) * normal;
+    vs_out.uv = texcoord;
     gl_Position = u_projection * u_view * world;
-    v_material_id = in_material_id;
+    v_material_id = material_id;
 }
@@ -4,36 +4,36 @@
 #include "../../material/mat.glsl"
 
 #define MAX_DIRECTIONAL_LIGHTS 4
-#define MAX_SPOT_LIGHTS 4
-#define MAX_POINT_LIGHTS 8
+#define MAX_SHADOW_CASCADES 4
 
 struct DirectionalLight {
     vec3 color;
     float intensity;
     vec3 direction;
     int casts_shadows;
-    mat4 light_view_projection;
+    int cascade_count;
+    // far view distance of each cascade
+    float cascade_splits[MAX_SHADOW_CASCADES];
+    mat4 cascade_view_projection[MAX_SHADOW_CASCADES];
+    // atlas tile per cascade, offset in xy and scale in zw
+    vec4 cascade_rects[MAX_SHADOW_CASCADES];
 };
 
-struct PointLight {
-    vec3 color;
-    float intensity;
-    vec3 position;
-    float radius;
-    int casts_shadows;
-    float shadow_far;
+// spot and point lights, see LightClusters
+struct LocalLight {
+    vec4 position_range;
+    vec4 color_intensity;
+    // xyz spot direction, w 0 for point and 1 for spot lights
+    vec4 direction_type;
+    // cos inner, cos outer, first shadow view or -1, shadow far plane of point lights
+    vec4 params;
 };
 
-struct SpotLight {
-    vec3 color;
-    float intensity;
-    vec3 position;
-    float range;
-    vec3 direction;
-    float cos_inner;
-    float cos_outer;
-    int casts_shadows;
-    mat4 light_view_projection;
+// one spot light map or six point light faces in +X, -X, +Y, -Y, +Z, -Z order
+struct ShadowView {
+    mat4 view_projection;
+    // atlas tile, offset in xy and scale in zw
+    vec4 rect;
 };
 
 struct MaterialSample {
@@ -46,15 +46,35 @@ struct MaterialSample {
 
 uniform DirectionalLight u_directional_lights[MAX_DIRECTIONAL_LIGHTS];
 uniform int u_directional_light_count;
-uniform sampler2D u_directional_shadow_maps[MAX_DIRECTIONAL_LIGHTS];
 
-uniform SpotLight u_spot_lights[MAX_SPOT_LIGHTS];
-uniform int u_spot_light_count;
-uniform sampler2D u_spot_shadow_maps[MAX_SPOT_LIGHTS];
+layout(std430, binding = 9) readonly buffer LocalLightBuffer {
+    LocalLight local_lights[];
+};
+
+layout(std430, row_major, binding = 10) readonly buffer ShadowViewBuffer {
+    ShadowView shadow_views[];
+};
 
-uniform PointLight u_point_lights[MAX_POINT_LIGHTS];
-uniform int u_point_light_count;
-uniform samplerCube u_point_shadow_maps[MAX_POINT_LIGHTS];
+// offset and count into cluster_light_indices per cluster, x fastest then y then depth slice
+layout(std430, binding = 11) readonly buffer ClusterBuffer {
+    uvec2 clusters[];
+};
+
+layout(std430, binding = 12) readonly buffer ClusterLightIndexBuffer {
+    uint cluster_light_indices[];
+};
+
+// zero when no clusters are bound
+uniform ivec3 u_cluster_grid;
+// xy clusters per pixel, z and w scale and bias from log(view depth), or view depth if linear, to the slice
+uniform vec4 u_cluster_params;
+uniform int u_cluster_linear_depth;
+
+// every shadow map lives in one tile of this atlas, lookups compare in hardware
+uniform sampler2DShadow u_shadow_atlas;
+// taps per lookup: 0 one, 1 a 2x2 grid, 2 a 3x3 grid, 3 a rotated Poisson disk (ShadowFilter)
+uniform int u_shadow_filter;
+uniform mat4 u_view;
 uniform vec3 u_camera_pos;
 uniform int u_debug_mode;
 
@@ -71,18 +91,19 @@ bool fetch_material_data(int material_id, out GPU_Material mat) {
     return true;
 }
 
-vec3 sample_color_component(const GPU_ColorComponent comp, vec2 uv) {
+// explicit uv gradients, passes that reconstruct uvs per pixel have no usable screen space derivatives
+vec3 sample_color_component(const GPU_ColorComponent comp, vec2 uv, vec2 uv_dx, vec2 uv_dy) {
     if (comp.enabled) {
         sampler2D tex = sampler2D(comp.texture_handle);
-        return texture(tex, uv).rgb;
+        return textureGrad(tex, uv, uv_dx, uv_dy).rgb;
     }
     return comp.color;
 }
 
-float sample_scalar_component(const GPU_ScalarComponent comp, vec2 uv) {
+float sample_scalar_component(const GPU_ScalarComponent comp, vec2 uv, vec2 uv_dx, vec2 uv_dy) {
     if (comp.enabled) {
         sampler2D tex = sampler2D(comp.texture_handle);
-        return texture(tex, uv).r;
+        return textureGrad(tex, uv, uv_dx, uv_dy).r;
     }
     return comp.value;
 }
@@ -114,84 +135,165 @@ vec3 fresnel_schlick(float cos_theta, vec3 F0) {
     return F0 + (1.0 - F0) * pow(1.0 - cos_theta, 5.0);
 }
 
+const vec2 kPoissonDisk[12] = vec2[](
+    vec2(-0.326, -0.406), vec2(-0.840, -0.074), vec2(-0.696, 0.457), vec2(-0.203, 0.621),
+    vec2(0.962, -0.195), vec2(0.473, -0.480), vec2(0.519, 0.767), vec2(0.185, -0.893),
+    vec2(0.507, 0.064), vec2(0.896, 0.412), vec2(-0.322, -0.933), vec2(-0.792, -0.598));
+
+// every tap filters 2x2 texels; clamping keeps them inside the tile so they never read a neighbouring shadow map
+float atlas_tap(vec2 tap, vec2 tile_min, vec2 tile_max, float reference) {
+    return texture(u_shadow_atlas, vec3(clamp(tap, tile_min, tile_max), reference));
+}
+
+float atlas_pcf(vec4 rect, vec2 uv, float current_depth, float bias) {
+    vec2 texel_size = 1.0 / vec2(textureSize(u_shadow_atlas, 0));
+    vec2 tile_min = rect.xy + 0.5 * texel_size;
+    vec2 tile_max = rect.xy + rect.zw - 0.5 * texel_size;
+    vec2 center = rect.xy + clamp(uv, 0.0, 1.0) * rect.zw;
+    float reference = current_depth - bias;
+
+    if (u_shadow_filter <= 0) {
+        return atlas_tap(center, tile_min, tile_max, reference);
+    }
+    float visibility = 0.0;
+    if (u_shadow_filter == 1) {
+        for (int x = 0; x < 2; ++x) {
+            for (int y = 0; y < 2; ++y) {
+                vec2 offset = vec2(float(x) - 0.5, float(y) - 0.5) * texel_size;
+                visibility += atlas_tap(center + offset, tile_min, tile_max, reference);
+            }
+        }
+        return visibility * 0.25;
+    }
+    if (u_shadow_filter == 2) {
+        for (int x = -1; x <= 1; ++x) {
+            for (int y = -1; y <= 1; ++y) {
+                visibility += atlas_tap(center + vec2(x, y) * texel_size, tile_min, tile_max, reference);
+            }
+        }
+        return visibility / 9.0;
+    }
+    // rotating the disk per pixel trades the banding of a fixed pattern for noise
+    float angle = 2.0 * PI * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    for (int i = 0; i < 12; ++i) {
+        vec2 offset = rotation * kPoissonDisk[i] * 1.5 * texel_size;
+        visibility += atlas_tap(center + offset, tile_min, tile_max, reference);
+    }
+    return visibility / 12.0;
+}
+
+// cascade covering the view depth of world_pos, -1 beyond the last cascade
+int select_cascade(int light_index, vec3 world_pos) {
+    float view_depth = -(u_view * vec4(world_pos, 1.0)).z;
+    int count = clamp(u_directional_lights[light_index].cascade_count, 1, MAX_SHADOW_CASCADES);
+    for (int cascade = 0; cascade < count; ++cascade) {
+        if (view_depth <= u_directional_lights[light_index].cascade_splits[cascade]) {
+            return cascade;
+        }
+    }
+    return -1;
+}
+
 float directional_shadow(int light_index, vec3 world_pos, vec3 N, vec3 L) {
     if (u_directional_lights[light_index].casts_shadows == 0) {
         return 1.0;
     }
-    vec4 light_space = u_directional_lights[light_index].light_view_projection * vec4(world_pos, 1.0);
+    int cascade = select_cascade(light_index, world_pos);
+    if (cascade < 0) {
+        return 1.0;
+    }
+    vec4 light_space = u_directional_lights[light_index].cascade_view_projection[cascade] * vec4(world_pos, 1.0);
     vec3 proj = light_space.xyz / light_space.w;
     proj = proj * 0.5 + 0.5;
     if (proj.z > 1.0 || proj.z < 0.0) {
         return 1.0;
     }
 
-    vec2 uv = proj.xy;
-    float current_depth = proj.z;
-    float bias = max(0.0005 * (1.0 - dot(N, L)), 0.00005);
-    float visibility = 0.0;
-    vec2 texel_size = 1.0 / textureSize(u_directional_shadow_maps[light_index], 0);
-    for (int x = -1; x <= 1; ++x) {
-        for (int y = -1; y <= 1; ++y) {
-            vec2 offset = vec2(x, y) * texel_size;
-            float depth_sample = texture(u_directional_shadow_maps[light_index], uv + offset).r;
-            visibility += current_depth - bias <= depth_sample ? 1.0 : 0.0;
-        }
-    }
-    visibility /= 9.0;
-    return visibility;
+    // outer cascades cover more world space per texel
+    float bias = max(0.0005 * (1.0 - dot(N, L)), 0.00005) * float(cascade + 1);
+    return atlas_pcf(u_directional_lights[light_index].cascade_rects[cascade], proj.xy, proj.z, bias);
 }
 
-float spot_shadow(int light_index, vec3 world_pos, vec3 N, vec3 L) {
-    if (u_spot_lights[light_index].casts_shadows == 0) {
-        return 1.0;
-    }
-    vec4 light_space = u_spot_lights[light_index].light_view_projection * vec4(world_pos, 1.0);
+float spot_shadow(int view, vec3 world_pos, vec3 N, vec3 L) {
+    vec4 light_space = shadow_views[view].view_projection * vec4(world_pos, 1.0);
     vec3 proj = light_space.xyz / light_space.w;
     proj = proj * 0.5 + 0.5;
     if (proj.z > 1.0 || proj.z < 0.0) {
         return 1.0;
     }
 
-    vec2 uv = proj.xy;
-    float current_depth = proj.z;
     float bias = max(0.001 * (1.0 - dot(N, L)), 0.0001);
-    float visibility = 0.0;
-    vec2 texel_size = 1.0 / textureSize(u_spot_shadow_maps[light_index], 0);
-    for (int x = -1; x <= 1; ++x) {
-        for (int y = -1; y <= 1; ++y) {
-            vec2 offset = vec2(x, y) * texel_size;
-            float depth_sample = texture(u_spot_shadow_maps[light_index], uv + offset).r;
-            visibility += current_depth - bias <= depth_sample ? 1.0 : 0.0;
-        }
-    }
-    visibility /= 9.0;
-    return visibility;
+    return atlas_pcf(shadow_views[view].rect, proj.xy, proj.z, bias);
 }
 
-float point_shadow(int light_index, float distance_to_light, vec3 direction_to_fragment, vec3 N, vec3 L) {
-    if (u_point_lights[light_index].casts_shadows == 0) {
-        return 1.0;
+// cube face a direction from the light falls into, in +X, -X, +Y, -Y, +Z, -Z order
+int cube_face(vec3 dir) {
+    vec3 a = abs(dir);
+    if (a.x >= a.y && a.x >= a.z) {
+        return dir.x >= 0.0 ? 0 : 1;
     }
-    float far_plane = u_point_lights[light_index].shadow_far;
+    if (a.y >= a.z) {
+        return dir.y >= 0.0 ? 2 : 3;
+    }
+    return dir.z >= 0.0 ? 4 : 5;
+}
+
+float point_shadow(int first_view, float far_plane, vec3 world_pos, float distance_to_light,
+                   vec3 direction_to_fragment, vec3 N, vec3 L) {
     float bias = 0.003 * (1.0 - dot(N, L));
-    vec3 dir = normalize(direction_to_fragment);
-    float closest_depth = texture(u_point_shadow_maps[light_index], dir).r * far_plane;
-    return distance_to_light - bias <= closest_depth ? 1.0 : 0.0;
+    int view = first_view + cube_face(direction_to_fragment);
+    vec4 light_space = shadow_views[view].view_projection * vec4(world_pos, 1.0);
+    vec2 uv = light_space.xy / light_space.w * 0.5 + 0.5;
+    // the face stores linear distance / far_plane
+    return atlas_pcf(shadow_views[view].rect, uv, distance_to_light / far_plane, bias / far_plane);
 }
 
-MaterialSample sample_material(int material_id, vec2 uv) {
+uint cluster_index(vec3 world_pos) {
+    float depth = max(-(u_view * vec4(world_pos, 1.0)).z, 1e-4);
+    float coordinate = u_cluster_linear_depth != 0 ? depth : log(depth);
+    int slice = clamp(int(floor(coordinate * u_cluster_params.z + u_cluster_params.w)), 0, u_cluster_grid.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy * u_cluster_params.xy), ivec2(0), u_cluster_grid.xy - 1);
+    return uint(tile.x + u_cluster_grid.x * (tile.y + u_cluster_grid.y * slice));
+}
+
+MaterialSample sample_material_grad(int material_id, vec2 uv, vec2 uv_dx, vec2 uv_dy) {
     GPU_Material mat;
     bool has_material = fetch_material_data(material_id, mat);
 
     MaterialSample _sample;
-    _sample.base_color = has_material ? sample_color_component(mat.base_color, uv) : kDefaultBaseColor;
-    _sample.metallic = has_material ? clamp(sample_scalar_component(mat.metallic, uv), 0.0, 1.0) : kDefaultMetallic;
-    _sample.roughness = has_material ? clamp(sample_scalar_component(mat.roughness, uv), 0.04, 1.0) : kDefaultRoughness;
-    _sample.emission = has_material ? sample_color_component(mat.emission, uv) : vec3(0.0);
-    _sample.transmission = has_material ? clamp(sample_scalar_component(mat.transmission, uv), 0.0, 1.0) : 0.0;
+    _sample.base_color = has_material ? sample_color_component(mat.base_color, uv, uv_dx, uv_dy) : kDefaultBaseColor;
+    _sample.metallic =
+        has_material ? clamp(sample_scalar_component(mat.metallic, uv, uv_dx, uv_dy), 0.0, 1.0) : kDefaultMetallic;
+    _sample.roughness =
+        has_material ? clamp(sample_scalar_component(mat.roughness, uv, uv_dx, uv_dy), 0.04, 1.0) : kDefaultRoughness;
+    _sample.emission = has_material ? sample_color_component(mat.emission, uv, uv_dx, uv_dy) : vec3(0.0);
+    _sample.transmission =
+        has_material ? clamp(sample_scalar_component(mat.transmission, uv, uv_dx, uv_dy), 0.0, 1.0) : 0.0;
     return _sample;
 }
 
+MaterialSample sample_material(int material_id, vec2 uv) {
+    return sample_material_grad(material_id, uv, dFdx(uv), dFdy(uv));
+}
+
+// diffuse and specular response of the surface to light arriving from L
+vec3 surface_response(MaterialSample _sample, vec3 F0, vec3 N, vec3 V, vec3 L, float NdotL) {
+    vec3 H = normalize(V + L);
+    float NDF = distribution_ggx(N, H, _sample.roughness);
+    float G = geometry_smith(N, V, L, _sample.roughness);
+    vec3 F = fresnel_schlick(max(dot(H, V), 0.0), F0);
+
+    vec3 numerator = NDF * G * F;
+    float denominator = 4.0 * max(dot(N, V), 0.0) * NdotL + 0.001;
+    vec3 specular = numerator / denominator;
+
+    vec3 kS = F;
+    vec3 kD = (1.0 - kS) * (1.0 - _sample.metallic);
+    vec3 diffuse = kD * _sample.base_color / PI;
+    return diffuse + specular;
+}
+
 vec3 evaluate_lit_color(MaterialSample _sample, vec3 N, vec3 V, vec3 world_pos) {
     vec3 F0 = mix(vec3(0.04), _sample.base_color, _sample.metallic);
     vec3 ambient = _sample.base_color * 0.03;
@@ -204,93 +306,51 @@ vec3 evaluate_lit_color(MaterialSample _sample, vec3 N, vec3 V, vec3 world_pos)
             continue;
         }
 
-        vec3 H = normalize(V + L);
-        float NDF = distribution_ggx(N, H, _sample.roughness);
-        float G = geometry_smith(N, V, L, _sample.roughness);
-        vec3 F = fresnel_schlick(max(dot(H, V), 0.0), F0);
-
-        vec3 numerator = NDF * G * F;
-        float denominator = 4.0 * max(dot(N, V), 0.0) * NdotL + 0.001;
-        vec3 specular = numerator / denominator;
-
-        vec3 kS = F;
-        vec3 kD = (1.0 - kS) * (1.0 - _sample.metallic);
-        vec3 diffuse = kD * _sample.base_color / PI;
-
         float shadow = directional_shadow(i, world_pos, N, L);
         vec3 radiance = u_directional_lights[i].color * u_directional_lights[i].intensity;
-        color += (diffuse + specular) * radiance * NdotL * shadow;
+        color += surface_response(_sample, F0, N, V, L, NdotL) * radiance * NdotL * shadow;
     }
 
-    for (int i = 0; i < u_spot_light_count && i < MAX_SPOT_LIGHTS; ++i) {
-        vec3 to_light = u_spot_lights[i].position - world_pos;
+    // only the spot and point lights whose bounds touch this fragment's cluster
+    uvec2 cluster = u_cluster_grid.x > 0 ? clusters[cluster_index(world_pos)] : uvec2(0u);
+    for (uint i = 0u; i < cluster.y; ++i) {
+        LocalLight light = local_lights[cluster_light_indices[cluster.x + i]];
+        vec3 to_light = light.position_range.xyz - world_pos;
         float distance = length(to_light);
-        if (distance <= 1e-4 || distance > u_spot_lights[i].range) {
+        float range = light.position_range.w;
+        if (distance <= 1e-4 || distance > range) {
             continue;
         }
         vec3 L = to_light / distance;
-        vec3 light_dir = normalize(u_spot_lights[i].direction);
-        float theta = dot(light_dir, -L);
-        float epsilon = max(u_spot_lights[i].cos_inner - u_spot_lights[i].cos_outer, 0.0001);
-        float intensity = clamp((theta - u_spot_lights[i].cos_outer) / epsilon, 0.0, 1.0);
-        if (intensity <= 0.0) {
-            continue;
-        }
-
-        float attenuation = intensity * (1.0 - clamp(distance / u_spot_lights[i].range, 0.0, 1.0));
         float NdotL = max(dot(N, L), 0.0);
         if (NdotL <= 0.0) {
             continue;
         }
 
-        vec3 H = normalize(V + L);
-        float NDF = distribution_ggx(N, H, _sample.roughness);
-        float G = geometry_smith(N, V, L, _sample.roughness);
-        vec3 F = fresnel_schlick(max(dot(H, V), 0.0), F0);
-
-        vec3 numerator = NDF * G * F;
-        float denominator = 4.0 * max(dot(N, V), 0.0) * NdotL + 0.001;
-        vec3 specular = numerator / denominator;
-
-        vec3 kS = F;
-        vec3 kD = (1.0 - kS) * (1.0 - _sample.metallic);
-        vec3 diffuse = kD * _sample.base_color / PI;
-
-        float shadow = spot_shadow(i, world_pos, N, L);
-        vec3 radiance = u_spot_lights[i].color * u_spot_lights[i].intensity;
-        color += (diffuse + specular) * radiance * NdotL * attenuation * shadow;
-    }
-
-    for (int i = 0; i < u_point_light_count && i < MAX_POINT_LIGHTS; ++i) {
-        vec3 to_light = u_point_lights[i].position - world_pos;
-        float distance = length(to_light);
-        if (distance <= 1e-4 || distance > u_point_lights[i].radius) {
-            continue;
+        int shadow_view = int(light.params.z);
+        float attenuation;
+        float shadow = 1.0;
+        if (light.direction_type.w > 0.5) {
+            float theta = dot(normalize(light.direction_type.xyz), -L);
+            float epsilon = max(light.params.x - light.params.y, 0.0001);
+            float intensity = clamp((theta - light.params.y) / epsilon, 0.0, 1.0);
+            if (intensity <= 0.0) {
+                continue;
+            }
+            attenuation = intensity * (1.0 - clamp(distance / range, 0.0, 1.0));
+            if (shadow_view >= 0) {
+                shadow = spot_shadow(shadow_view, world_pos, N, L);
+            }
+        } else {
+            attenuation = 1.0 - clamp(distance / range, 0.0, 1.0);
+            attenuation *= attenuation;
+            if (shadow_view >= 0) {
+                shadow = point_shadow(shadow_view, light.params.w, world_pos, distance, -to_light, N, L);
+            }
         }
-        vec3 L = to_light / distance;
-        float attenuation = 1.0 - clamp(distance / u_point_lights[i].radius, 0.0, 1.0);
-        attenuation *= attenuation;
-        float NdotL = max(dot(N, L), 0.0);
-        if (NdotL <= 0.0) {
-            continue;
-        }
-
-        vec3 H = normalize(V + L);
-        float NDF = distribution_ggx(N, H, _sample.roughness);
-        float G = geometry_smith(N, V, L, _sample.roughness);
-        vec3 F = fresnel_schlick(max(dot(H, V), 0.0), F0);
-
-        vec3 numerator = NDF * G * F;
-        float denominator = 4.0 * max(dot(N, V), 0.0) * NdotL + 0.001;
-        vec3 specular = numerator / denominator;
-
-        vec3 kS = F;
-        vec3 kD = (1.0 - kS) * (1.0 - _sample.metallic);
-        vec3 diffuse = kD * _sample.base_color / PI;
 
-        vec3 radiance = u_point_lights[i].color * u_point_lights[i].intensity * attenuation;
-        float shadow = point_shadow(i, distance, world_pos - u_point_lights[i].position, N, L);
-        color += (diffuse + specular) * radiance * NdotL * shadow;
+        vec3 radiance = light.color_intensity.rgb * light.color_intensity.a;
+        color += surface_response(_sample, F0, N, V, L, NdotL) * radiance * NdotL * attenuation * shadow;
     }
 
     color += _sample.emission;
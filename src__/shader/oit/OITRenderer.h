@@ -9,38 +9,22 @@
 #include "../../gldata/fbo_data.h"
 #include "../../gldata/texture_data.h"
 
+// weighted blended order independent transparency; the opaque and accumulation targets are frame graph textures
 class OITRenderer {
 public:
     OITRenderer();
     ~OITRenderer();
 
-    bool initialize(const std::filesystem::path& shader_dir, int width, int height);
-    void resize(int width, int height);
+    bool initialize(const std::filesystem::path& shader_dir);
 
-    void prepare_opaque_target();
-    void prepare_transparent_target();
-    void resolve_opaque_to_backbuffer(int width, int height);
-    void composite(int width, int height);
-
-    const FBOData::SPtr& opaque_fbo() const { return main_fbo_; }
-    const FBOData::SPtr& transparent_fbo() const { return oit_fbo_; }
-    const TextureData::SPtr& opaque_color_texture() const { return main_color_tex_; }
-    const TextureData::SPtr& transparent_accum_texture() const { return oit_accum_tex_; }
-    const TextureData::SPtr& transparent_reveal_texture() const { return oit_reveal_tex_; }
+    void prepare_opaque_target(const FBOData::SPtr& target, int width, int height);
+    void prepare_transparent_target(const FBOData::SPtr& target, int width, int height);
+    void resolve_opaque_to_backbuffer(const FBOData::SPtr& opaque, int source_width, int source_height, int width,
+                                      int height);
+    void composite(const TextureData* accum, const TextureData* reveal, const TextureData* opaque, int width,
+                   int height);
 
 private:
-    bool create_targets(int width, int height);
-    void destroy_targets();
-
     OITCompositeShader composite_shader_;
-
-    FBOData::SPtr main_fbo_;
-    FBOData::SPtr oit_fbo_;
-    TextureData::SPtr main_color_tex_;
-    TextureData::SPtr depth_tex_;
-    TextureData::SPtr oit_accum_tex_;
-    TextureData::SPtr oit_reveal_tex_;
-
-    int width_ {0};
-    int height_ {0};
+    GLuint fullscreen_vao_ {0};
 };
@@ -0,0 +1,35 @@
+#include "CubeShadowShader.h"
+
+#include <string>
+
+#include <glad/glad.h>
+
+CubeShadowShader::CubeShadowShader() : face_matrices_location_{-1, -1, -1, -1, -1, -1}, face_mask_location_(-1) {}
+
+bool CubeShadowShader::init(const std::filesystem::path& shader_dir) {
+    vertex_file((shader_dir / "shadow" / "shadow_depth.vert").string());
+    geometry_file((shader_dir / "shadow" / "shadow_cube.geom").string());
+    fragment_file((shader_dir / "shadow" / "shadow_depth.frag").string());
+    compile();
+    get_all_uniform_locations();
+    return true;
+}
+
+void CubeShadowShader::get_all_uniform_locations() {
+    ShadowShader::get_all_uniform_locations();
+    for (int face = 0; face < 6; ++face) {
+        face_matrices_location_[face] = get_uniform_location("u_face_matrices[" + std::to_string(face) + "]");
+    }
+    face_mask_location_ = get_uniform_location("u_face_mask");
+}
+
+void CubeShadowShader::set_face_matrices(const Mat4f (&matrices)[6], unsigned face_mask) {
+    for (int face = 0; face < 6; ++face) {
+        if (face_matrices_location_[face] >= 0) {
+            load_matrix(face_matrices_location_[face], const_cast<Mat4f&>(matrices[face]));
+        }
+    }
+    if (face_mask_location_ >= 0) {
+        glUniform1i(face_mask_location_, static_cast<GLint>(face_mask));
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ShadowShader.h"
+
+// Renders all six faces of a point light in one pass, the geometry stage selects the viewport of each face's atlas
+// tile through gl_ViewportIndex. u_light_vp is left at identity so the vertex stage passes world positions through.
+class CubeShadowShader : public ShadowShader {
+  public:
+    CubeShadowShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_face_matrices(const Mat4f (&matrices)[6], unsigned face_mask);
+
+  protected:
+    void get_all_uniform_locations() override;
+
+  private:
+    GLint face_matrices_location_[6];
+    GLint face_mask_location_;
+};
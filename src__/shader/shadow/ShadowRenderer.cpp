@@ -1,15 +1,43 @@
 #include "ShadowRenderer.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+
 #include <glad/glad.h>
 
 #include "../../logging/logging.h"
 #include "../../math/mat.h"
+#include "../../rendering/culling/GpuCuller.h"
+
+namespace {
+bool is_shadow_caster(const RenderableInstance& renderable) { return renderable.casts_shadows; }
+
+// conservative test of the bounding sphere of a box against a cone clipped at range
+bool cone_overlaps(const AABB& box, const Vec3f& apex, const Vec3f& axis, float range, float cos_angle,
+                   float sin_angle) {
+    Vec3f center = box.center();
+    float radius = box.extents().length();
+    Vec3f to_center = center - apex;
+    float distance_sq = to_center.dot(to_center);
+    if (distance_sq > (range + radius) * (range + radius)) {
+        return false;
+    }
+    float along = to_center.dot(axis);
+    float across = std::sqrt(std::max(distance_sq - along * along, 0.0f));
+    // distance to the cone surface, measured perpendicular to it
+    return across * cos_angle - along * sin_angle <= radius;
+}
+} // namespace
 
-ShadowRenderer::ShadowRenderer() : shader_(std::make_unique<ShadowShader>()) {}
+ShadowRenderer::ShadowRenderer()
+    : shader_(std::make_unique<ShadowShader>()), cube_shader_(std::make_unique<CubeShadowShader>()) {}
 
 ShadowRenderer::~ShadowRenderer() = default;
 
-bool ShadowRenderer::init(const std::filesystem::path& shader_dir) { return shader_->init(shader_dir); }
+bool ShadowRenderer::init(const std::filesystem::path& shader_dir) {
+    return shader_->init(shader_dir) && cube_shader_->init(shader_dir);
+}
 
 void ShadowRenderer::render(const RenderableList& renderables, InstanceBuffer& instance_buffer,
                             const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
@@ -18,22 +46,12 @@ void ShadowRenderer::render(const RenderableList& renderables, InstanceBuffer& i
     if (directional_lights.empty() && spot_lights.empty() && point_lights.empty()) {
         return;
     }
-
-    auto batches = build_mesh_batches(renderables, instance_buffer, [](const RenderableInstance& renderable) {
-        if (!renderable.model || !renderable.shadow) {
-            return false;
-        }
-        if (!renderable.model->casts_shadows) {
-            return false;
-        }
-        return renderable.shadow->casts_shadows;
-    });
-
-    if (batches.empty()) {
-        logging::log(0, logging::DEBUG, "ShadowRenderer: no batches to draw");
+    if (!atlas_ || !atlas_->fbo() || !atlas_->texture()) {
         return;
     }
 
+    auto batches = build_mesh_batches(renderables, instance_buffer, is_shadow_caster, nullptr,
+                                      BatchOrder{BatchPass::Shadow, DepthOrder::None, Vec3f{0.0f, 0.0f, 0.0f}});
     logging::log(0, logging::DEBUG,
                  "ShadowRenderer: prepared " + std::to_string(batches.size()) + " batches over " +
                      std::to_string(instance_buffer.total_instances()) + " instances");
@@ -41,158 +59,308 @@ void ShadowRenderer::render(const RenderableList& renderables, InstanceBuffer& i
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
+    glDepthMask(GL_TRUE);
+
+    // static casters are only redrawn into the tiles they changed, without a scene index everything is dynamic
+    bool cached = static_changes_ && atlas_->static_fbo() && atlas_->static_texture();
+    if (cached) {
+        atlas_->static_fbo()->bind();
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        draw_lights(renderables, instance_buffer, batches, directional_lights, spot_lights, point_lights,
+                    CasterSet::Static);
+        atlas_->static_fbo()->unbind();
+    }
+
+    atlas_->fbo()->bind();
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    // tiles that are not scheduled this frame keep their depth, so only scheduled ones are reset
+    reset_scheduled_tiles(directional_lights, spot_lights, point_lights, cached);
+    draw_lights(renderables, instance_buffer, batches, directional_lights, spot_lights, point_lights,
+                cached ? CasterSet::Dynamic : CasterSet::All);
+    shader_->stop();
+    atlas_->fbo()->unbind();
+
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+}
+
+bool ShadowRenderer::static_tile_stale(const ShadowAtlasRect& rect, const Mat4f& view_projection,
+                                       const Frustum& frustum) const {
+    if (!rect.static_valid || rect.static_view_projection != view_projection) {
+        return true;
+    }
+    for (const auto& box : *static_changes_) {
+        if (frustum.intersects(box)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShadowRenderer::begin_tile(ShadowAtlasRect& rect, const Mat4f& view_projection, const Frustum& frustum,
+                                bool static_pass) {
+    if (!static_pass) {
+        if (!rect.scheduled) {
+            return false;
+        }
+        rect.rendered = true;
+        rect.view_projection = view_projection;
+        return true;
+    }
+    if (!static_tile_stale(rect, view_projection, frustum)) {
+        return false;
+    }
+    // static changes are only reported once, a deferred tile rebakes when it is scheduled again
+    if (!rect.scheduled) {
+        rect.static_valid = false;
+        return false;
+    }
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(rect.x, rect.y, rect.size, rect.size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+    rect.static_valid = true;
+    rect.static_view_projection = view_projection;
+    return true;
+}
+
+void ShadowRenderer::draw_lights(const RenderableList& renderables, InstanceBuffer& instance_buffer,
+                                 const std::vector<MeshBatch>& batches,
+                                 const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+                                 const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                                 const std::vector<std::pair<PointLight*, Transformation*>>& point_lights,
+                                 CasterSet set) {
+    bool static_pass = set == CasterSet::Static;
 
-    shader_->start();
-    instance_buffer.bind(0);
     for (const auto& entry : directional_lights) {
         auto* light = entry.first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
+        if (!light || !light->casts_shadows || light->current_shadow_resolution <= 0) {
             continue;
         }
 
-        light->shadow_map->bind();
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        glViewport(0, 0, light->shadow_resolution, light->shadow_resolution);
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        shader_->set_point_shadow_params(false, Vec3f{0.0f, 0.0f, 0.0f}, 1.0f);
-        shader_->set_light_vp(light->light_view_projection);
-
-        for (const auto& batch : batches) {
-            if (!batch.mesh) {
+        for (int cascade = 0; cascade < light->active_cascades(); ++cascade) {
+            const Mat4f& cascade_vp = light->cascade_view_projection[cascade];
+            auto& rect = light->shadow_rects[cascade];
+            Frustum frustum(cascade_vp);
+            if (!begin_tile(rect, cascade_vp, frustum, static_pass)) {
                 continue;
             }
-            if (batch.double_sided) {
-                glDisable(GL_CULL_FACE);
-            } else {
-                glEnable(GL_CULL_FACE);
-                glCullFace(GL_BACK);
-            }
-            for (const auto& draw : batch.draws) {
-                if (draw.instance_count <= 0) {
-                    continue;
-                }
-                const auto total_instances = instance_buffer.total_instances();
-                if (static_cast<std::size_t>(draw.base_instance) + draw.instance_count > total_instances) {
-                    logging::log(
-                        0, logging::ERROR,
-                        "ShadowRenderer: directional draw exceeds SSBO (base=" + std::to_string(draw.base_instance) +
-                            ", count=" + std::to_string(draw.instance_count) +
-                            ", total=" + std::to_string(total_instances) + ")");
-                    continue;
-                }
-                batch.mesh->draw_instanced(draw.instance_count, draw.base_instance);
+            const auto& casters = select_casters(renderables, instance_buffer, batches, set,
+                                                 [&](const AABB* bounds) { return !bounds || frustum.intersects(*bounds); });
+            if (casters.empty()) {
+                continue;
             }
-        }
 
-        light->shadow_map->unbind();
+            glViewport(rect.x, rect.y, rect.size, rect.size);
+            shader_->start();
+            shader_->set_point_shadow_params(false, Vec3f{0.0f, 0.0f, 0.0f}, 1.0f);
+            draw_batches(casters, instance_buffer, *shader_, cascade_vp, cascade_vp, "directional");
+        }
     }
 
     for (const auto& entry : spot_lights) {
         auto* light = entry.first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
+        if (!light || !light->casts_shadows || light->current_shadow_resolution <= 0) {
             continue;
         }
 
-        light->shadow_map->bind();
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        glViewport(0, 0, light->shadow_resolution, light->shadow_resolution);
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        shader_->set_point_shadow_params(false, Vec3f{0.0f, 0.0f, 0.0f}, 1.0f);
-        shader_->set_light_vp(light->light_view_projection);
-
-        for (const auto& batch : batches) {
-            if (!batch.mesh) {
-                continue;
-            }
-            if (batch.double_sided) {
-                glDisable(GL_CULL_FACE);
-            } else {
-                glEnable(GL_CULL_FACE);
-                glCullFace(GL_BACK);
-            }
-            for (const auto& draw : batch.draws) {
-                if (draw.instance_count <= 0) {
-                    continue;
-                }
-                const auto total_instances = instance_buffer.total_instances();
-                if (static_cast<std::size_t>(draw.base_instance) + draw.instance_count > total_instances) {
-                    logging::log(0, logging::ERROR,
-                                 "ShadowRenderer: spot draw exceeds SSBO (base=" + std::to_string(draw.base_instance) +
-                                     ", count=" + std::to_string(draw.instance_count) +
-                                     ", total=" + std::to_string(total_instances) + ")");
-                    continue;
-                }
-                batch.mesh->draw_instanced(draw.instance_count, draw.base_instance);
-            }
+        auto& rect = light->shadow_rect;
+        if (!begin_tile(rect, light->light_view_projection, Frustum(light->light_view_projection), static_pass)) {
+            continue;
+        }
+        // the cone covers the whole perspective frustum, so its half angle follows the wider spot angle
+        Vec3f apex = light->position(entry.second);
+        Vec3f axis = light->direction(entry.second);
+        constexpr float kPi = 3.14159265359f;
+        float half_angle = std::max(light->outer_angle_deg, light->inner_angle_deg) * kPi / 180.0f;
+        float cos_angle = std::cos(half_angle);
+        float sin_angle = std::sin(half_angle);
+        const auto& casters = select_casters(renderables, instance_buffer, batches, set, [&](const AABB* bounds) {
+            return !bounds || cone_overlaps(*bounds, apex, axis, light->range, cos_angle, sin_angle);
+        });
+        if (casters.empty()) {
+            continue;
         }
 
-        light->shadow_map->unbind();
+        glViewport(rect.x, rect.y, rect.size, rect.size);
+        shader_->start();
+        shader_->set_point_shadow_params(false, Vec3f{0.0f, 0.0f, 0.0f}, 1.0f);
+        draw_batches(casters, instance_buffer, *shader_, light->light_view_projection, light->light_view_projection,
+                     "spot");
     }
 
     for (const auto& entry : point_lights) {
         auto* light = entry.first;
-        if (!light || !light->casts_shadows || !light->shadow_map || !light->shadow_map->depth_texture()) {
+        if (!light || !light->casts_shadows || light->current_shadow_resolution <= 0) {
             continue;
         }
 
-        auto* depth_texture = light->shadow_map->depth_texture();
-        GLuint texture_id = static_cast<GLuint>(*depth_texture);
-
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
         Vec3f light_pos = light->position(entry.second);
         float far_plane = light->shadow_far > light->shadow_near ? light->shadow_far : light->radius;
         if (far_plane <= 0.0f) {
             far_plane = 1.0f;
         }
-        shader_->set_point_shadow_params(true, light_pos, far_plane);
 
+        std::array<Frustum, 6> faces;
         for (int face = 0; face < 6; ++face) {
-            light->shadow_map->bind();
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
-                                   texture_id, 0);
-            glViewport(0, 0, light->shadow_resolution, light->shadow_resolution);
-            glClear(GL_DEPTH_BUFFER_BIT);
+            faces[face].set(light->shadow_matrices[face]);
+        }
 
-            Mat4f light_vp = light->shadow_matrices[face];
-            shader_->set_light_vp(light_vp);
+        // the static pass only redraws the faces whose cache is stale
+        unsigned target_mask = 0u;
+        for (int face = 0; face < 6; ++face) {
+            if (begin_tile(light->shadow_rects[face], light->shadow_matrices[face], faces[face], static_pass)) {
+                target_mask |= 1u << face;
+            }
+        }
+        if (target_mask == 0) {
+            continue;
+        }
 
-            for (const auto& batch : batches) {
-                if (!batch.mesh) {
-                    continue;
-                }
-                if (batch.double_sided) {
-                    glDisable(GL_CULL_FACE);
-                } else {
-                    glEnable(GL_CULL_FACE);
-                    glCullFace(GL_BACK);
-                }
-                for (const auto& draw : batch.draws) {
-                    if (draw.instance_count <= 0) {
-                        continue;
-                    }
-                    const auto total_instances = instance_buffer.total_instances();
-                    if (static_cast<std::size_t>(draw.base_instance) + draw.instance_count > total_instances) {
-                        logging::log(
-                            0, logging::ERROR,
-                            "ShadowRenderer: point draw exceeds SSBO (base=" + std::to_string(draw.base_instance) +
-                                ", count=" + std::to_string(draw.instance_count) +
-                                ", total=" + std::to_string(total_instances) + ")");
-                        continue;
-                    }
-                    batch.mesh->draw_instanced(draw.instance_count, draw.base_instance);
+        // casters outside the light range are dropped, the others mark the faces they touch
+        unsigned face_mask = static_changes_ ? 0u : 0x3Fu;
+        const auto& casters = select_casters(renderables, instance_buffer, batches, set, [&](const AABB* bounds) {
+            if (!bounds) {
+                face_mask = 0x3Fu;
+                return true;
+            }
+            if (!bounds->overlaps(light_pos, far_plane)) {
+                return false;
+            }
+            for (int face = 0; face < 6; ++face) {
+                if (faces[face].intersects(*bounds)) {
+                    face_mask |= 1u << face;
                 }
             }
+            return true;
+        });
+        face_mask &= target_mask;
+        if (face_mask == 0 || casters.empty()) {
+            continue;
+        }
 
-            light->shadow_map->unbind();
+        // all six faces in one pass, the geometry stage routes each face to its tile through gl_ViewportIndex
+        for (int face = 0; face < 6; ++face) {
+            const auto& rect = light->shadow_rects[face];
+            glViewportIndexedf(face, static_cast<float>(rect.x), static_cast<float>(rect.y),
+                               static_cast<float>(rect.size), static_cast<float>(rect.size));
         }
+        cube_shader_->start();
+        cube_shader_->set_point_shadow_params(true, light_pos, far_plane);
+        cube_shader_->set_face_matrices(light->shadow_matrices, face_mask);
+        draw_batches(casters, instance_buffer, *cube_shader_, Mat4f::eye(), light->range_view_projection, "point");
     }
-    shader_->stop();
+}
 
-    glCullFace(GL_BACK);
-    glDisable(GL_CULL_FACE);
+void ShadowRenderer::reset_scheduled_tiles(
+    const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+    const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+    const std::vector<std::pair<PointLight*, Transformation*>>& point_lights, bool copy_static) {
+    auto target = static_cast<GLuint>(*atlas_->texture());
+    auto source = copy_static ? static_cast<GLuint>(*atlas_->static_texture()) : 0u;
+    glEnable(GL_SCISSOR_TEST);
+    auto copy = [&](const ShadowAtlasRect& rect) {
+        if (!rect.valid() || !rect.scheduled) {
+            return;
+        }
+        if (copy_static) {
+            glCopyImageSubData(source, GL_TEXTURE_2D, 0, rect.x, rect.y, 0, target, GL_TEXTURE_2D, 0, rect.x, rect.y,
+                               0, rect.size, rect.size, 1);
+        } else {
+            glScissor(rect.x, rect.y, rect.size, rect.size);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+    };
+
+    for (const auto& entry : directional_lights) {
+        if (entry.first && entry.first->casts_shadows && entry.first->current_shadow_resolution > 0) {
+            for (int cascade = 0; cascade < entry.first->active_cascades(); ++cascade) {
+                copy(entry.first->shadow_rects[cascade]);
+            }
+        }
+    }
+    for (const auto& entry : spot_lights) {
+        if (entry.first && entry.first->casts_shadows && entry.first->current_shadow_resolution > 0) {
+            copy(entry.first->shadow_rect);
+        }
+    }
+    for (const auto& entry : point_lights) {
+        if (entry.first && entry.first->casts_shadows && entry.first->current_shadow_resolution > 0) {
+            for (const auto& rect : entry.first->shadow_rects) {
+                copy(rect);
+            }
+        }
+    }
+    glDisable(GL_SCISSOR_TEST);
+}
+
+template<typename BoundsTest>
+const std::vector<MeshBatch>& ShadowRenderer::select_casters(const RenderableList& renderables,
+                                                             InstanceBuffer& instance_buffer,
+                                                             const std::vector<MeshBatch>& batches,
+                                                             CasterSet set, BoundsTest&& in_range) {
+    if (!static_changes_) {
+        return batches;
+    }
+    culled_batches_ = build_mesh_batches(renderables, instance_buffer, [&](const RenderableInstance& renderable) {
+        if (!is_shadow_caster(renderable)) {
+            return false;
+        }
+        if (set != CasterSet::All && renderable.is_static != (set == CasterSet::Static)) {
+            return false;
+        }
+        return in_range(renderable.indexed ? &renderable.bounds : nullptr);
+    }, nullptr, BatchOrder{BatchPass::Shadow, DepthOrder::None, Vec3f{0.0f, 0.0f, 0.0f}});
+    return culled_batches_;
+}
+
+void ShadowRenderer::draw_batches(const std::vector<MeshBatch>& batches, InstanceBuffer& instance_buffer,
+                                  ShadowShader& shader, const Mat4f& light_vp, const Mat4f& cull_vp,
+                                  const char* label) {
+    bool gpu_culling = gpu_culler_ && gpu_culler_->enabled();
+    if (gpu_culling) {
+        // the compute pass switches programs, so the shadow shader is re-bound afterwards
+        gpu_culler_->cull(batches, instance_buffer, cull_vp);
+        shader.start();
+        gpu_culler_->begin_draw();
+    }
+
+    shader.set_instance_remap(gpu_culling);
+    shader.set_light_vp(light_vp);
+    instance_buffer.bind(0);
+
+    glEnable(GL_CULL_FACE);
+    bool culling = true;
+    for (std::size_t i = 0; i < batches.size(); ++i) {
+        const auto& batch = batches[i];
+        if (!batch.mesh) {
+            continue;
+        }
+        apply_cull_mode(batch, culling);
+        shader.set_position_dequantization(batch.mesh->shadow_position_scale(), batch.mesh->shadow_position_offset());
+        if (gpu_culling) {
+            gpu_culler_->draw(i, batch, MeshStream::Shadow);
+            continue;
+        }
+        for (const auto& draw : batch.draws) {
+            if (draw.instance_count <= 0) {
+                continue;
+            }
+            const auto total_instances = instance_buffer.total_instances();
+            if (static_cast<std::size_t>(draw.base_instance) + draw.instance_count > total_instances) {
+                logging::log(0, logging::ERROR,
+                             std::string("ShadowRenderer: ") + label + " draw exceeds SSBO (base=" +
+                                 std::to_string(draw.base_instance) + ", count=" + std::to_string(draw.instance_count) +
+                                 ", total=" + std::to_string(total_instances) + ")");
+                continue;
+            }
+            batch.mesh->draw_instanced(draw.instance_count, draw.base_instance, MeshStream::Shadow);
+        }
+    }
+
+    if (gpu_culling) {
+        gpu_culler_->end_draw();
+    }
 }
@@ -8,11 +8,16 @@
 #include "../../rendering/InstanceBuffer.h"
 #include "../../rendering/RenderBatchBuilder.h"
 #include "../../lighting/directional_light.h"
+#include "../../lighting/shadow_atlas.h"
 #include "../../lighting/spot_light.h"
 #include "../../lighting/point_light.h"
+#include "../../math/bounds.h"
 #include "../../math/transformation.h"
+#include "CubeShadowShader.h"
 #include "ShadowShader.h"
 
+class GpuCuller;
+
 class ShadowRenderer {
   public:
     ShadowRenderer();
@@ -20,11 +25,52 @@ class ShadowRenderer {
 
     bool init(const std::filesystem::path& shader_dir);
 
+    void set_gpu_culler(GpuCuller* culler) { gpu_culler_ = culler; }
+    // world boxes whose static content changed since the previous frame (SceneIndex::static_changes), enables the
+    // static caster cache and per cascade caster culling against the indexed bounds captured in the renderables
+    void set_static_changes(const std::vector<AABB>* changes) { static_changes_ = changes; }
+    // target of every shadow map, tiles must be allocated before render
+    void set_shadow_atlas(ShadowAtlas* atlas) { atlas_ = atlas; }
+
     void render(const RenderableList& renderables, InstanceBuffer& instance_buffer,
                 const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
                 const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
                 const std::vector<std::pair<PointLight*, Transformation*>>& point_lights);
 
   private:
+    // static casters are cached in the static atlas, dynamic ones are drawn every frame on top of the copied cache
+    enum class CasterSet { All, Static, Dynamic };
+
+    void draw_lights(const RenderableList& renderables, InstanceBuffer& instance_buffer,
+                     const std::vector<MeshBatch>& batches,
+                     const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+                     const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                     const std::vector<std::pair<PointLight*, Transformation*>>& point_lights, CasterSet set);
+    // copies the cached static depth into, or clears, every tile scheduled for this frame
+    void reset_scheduled_tiles(const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights,
+                               const std::vector<std::pair<SpotLight*, Transformation*>>& spot_lights,
+                               const std::vector<std::pair<PointLight*, Transformation*>>& point_lights,
+                               bool copy_static);
+    // the cached tile misses, was rendered from another view or a static change lies inside its frustum
+    [[nodiscard]] bool static_tile_stale(const ShadowAtlasRect& rect, const Mat4f& view_projection,
+                                         const Frustum& frustum) const;
+    // whether the tile is drawn in this pass: scheduled tiles in the final pass (recording the view projection the
+    // lit shaders sample with), scheduled stale tiles in the static pass after clearing their cached depth
+    bool begin_tile(ShadowAtlasRect& rect, const Mat4f& view_projection, const Frustum& frustum, bool static_pass);
+    // batches of the casters in set whose indexed bounds pass in_range(const AABB*), which gets nullptr for casters
+    // missing from the index (those are dynamic); all batches without static changes
+    template<typename BoundsTest>
+    const std::vector<MeshBatch>& select_casters(const RenderableList& renderables, InstanceBuffer& instance_buffer,
+                                                 const std::vector<MeshBatch>& batches, CasterSet set,
+                                                 BoundsTest&& in_range);
+    // cull_vp is the view projection the GPU culler tests instances against
+    void draw_batches(const std::vector<MeshBatch>& batches, InstanceBuffer& instance_buffer, ShadowShader& shader,
+                      const Mat4f& light_vp, const Mat4f& cull_vp, const char* label);
+
     std::unique_ptr<ShadowShader> shader_;
+    std::unique_ptr<CubeShadowShader> cube_shader_;
+    GpuCuller* gpu_culler_{nullptr};
+    const std::vector<AABB>* static_changes_{nullptr};
+    ShadowAtlas* atlas_{nullptr};
+    std::vector<MeshBatch> culled_batches_;
 };
@@ -3,7 +3,8 @@
 #include <glad/glad.h>
 
 ShadowShader::ShadowShader()
-    : light_vp_location_(-1), light_pos_location_(-1), far_plane_location_(-1), is_point_light_location_(-1) {}
+    : light_vp_location_(-1), light_pos_location_(-1), far_plane_location_(-1), is_point_light_location_(-1),
+      instance_remap_location_(-1), position_scale_location_(-1), position_offset_location_(-1) {}
 
 bool ShadowShader::init(const std::filesystem::path& shader_dir) {
     vertex_file((shader_dir / "shadow" / "shadow_depth.vert").string());
@@ -18,6 +19,9 @@ void ShadowShader::get_all_uniform_locations() {
     light_pos_location_ = get_uniform_location("u_light_pos");
     far_plane_location_ = get_uniform_location("u_far_plane");
     is_point_light_location_ = get_uniform_location("u_is_point_light");
+    instance_remap_location_ = get_uniform_location("u_instance_remap");
+    position_scale_location_ = get_uniform_location("u_position_scale");
+    position_offset_location_ = get_uniform_location("u_position_offset");
 }
 
 void ShadowShader::set_light_vp(const Mat4f& vp) { load_matrix(light_vp_location_, const_cast<Mat4f&>(vp)); }
@@ -33,3 +37,18 @@ void ShadowShader::set_point_shadow_params(bool enabled, const Vec3f& light_pos,
         glUniform1f(far_plane_location_, far_plane);
     }
 }
+
+void ShadowShader::set_instance_remap(bool enabled) {
+    if (instance_remap_location_ >= 0) {
+        glUniform1i(instance_remap_location_, enabled ? 1 : 0);
+    }
+}
+
+void ShadowShader::set_position_dequantization(const Vec3f& scale, const Vec3f& offset) {
+    if (position_scale_location_ >= 0) {
+        glUniform3f(position_scale_location_, scale[0], scale[1], scale[2]);
+    }
+    if (position_offset_location_ >= 0) {
+        glUniform3f(position_offset_location_, offset[0], offset[1], offset[2]);
+    }
+}
@@ -14,6 +14,9 @@ class ShadowShader : public ShaderProgram {
 
     void set_light_vp(const Mat4f& vp);
     void set_point_shadow_params(bool enabled, const Vec3f& light_pos, float far_plane);
+    void set_instance_remap(bool enabled);
+    // per mesh, see MeshData::shadow_position_scale
+    void set_position_dequantization(const Vec3f& scale, const Vec3f& offset);
 
   protected:
     void get_all_uniform_locations() override;
@@ -23,4 +26,7 @@ class ShadowShader : public ShaderProgram {
     GLint light_pos_location_;
     GLint far_plane_location_;
     GLint is_point_light_location_;
+    GLint instance_remap_location_;
+    GLint position_scale_location_;
+    GLint position_offset_location_;
 };
@@ -2,20 +2,33 @@
 
 layout(location = 0) in vec3 in_position;
 
-layout(std430, row_major, binding = 0) readonly buffer InstanceBuffer {
-    mat4 instance_matrices[];
+#include "../instance.glsl"
+
+// written by the GPU culling pre-pass, maps a drawn instance to its slot in InstanceBuffer
+layout(std430, binding = 1) readonly buffer VisibleInstanceBuffer {
+    uint visible_instances[];
 };
 
+uniform int u_instance_remap;
+
 uniform mat4 u_light_vp;
 
+// undoes the 16 bit normalization of quantized shadow positions, identity for float positions
+uniform vec3 u_position_scale;
+uniform vec3 u_position_offset;
+
 out VS_OUT {
     vec3 world_pos;
 } vs_out;
 
 void main() {
     uint index = gl_BaseInstance + gl_InstanceID;
-    mat4 model = instance_matrices[index];
-    vec4 world_position = model * vec4(in_position, 1.0);
+    if (u_instance_remap != 0) {
+        index = visible_instances[index];
+    }
+    mat4 model = instance_model(index);
+    vec3 position = in_position * u_position_scale + u_position_offset;
+    vec4 world_position = model * vec4(position, 1.0);
     vs_out.world_pos = world_position.xyz;
     gl_Position = u_light_vp * world_position;
 }
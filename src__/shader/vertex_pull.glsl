@@ -0,0 +1,36 @@
+#ifndef VERTEX_PULL_GLSL
+#define VERTEX_PULL_GLSL
+
+// one vertex of the VertexPool, tightly packed scalars so std430 matches the 36 byte C++ struct
+struct PulledVertex {
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+    int material;
+};
+
+layout(std430, binding = 15) readonly buffer VertexPoolBuffer {
+    PulledVertex pulled_vertices[];
+};
+
+// set when the draw comes from the VertexPool, the vertex attributes are unbound then
+uniform int u_vertex_pulling;
+
+// gl_VertexID already includes the base vertex of the pooled mesh
+PulledVertex pulled_vertex() {
+    return pulled_vertices[gl_VertexID];
+}
+
+vec3 pulled_position(PulledVertex vertex) {
+    return vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+}
+
+vec3 pulled_normal(PulledVertex vertex) {
+    return vec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+}
+
+vec2 pulled_texcoord(PulledVertex vertex) {
+    return vec2(vertex.texcoord[0], vertex.texcoord[1]);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "VisibilityRenderer.h"
+
+#include <string>
+
+#include "../../logging/logging.h"
+#include "../../rendering/lighting/LightClusters.h"
+
+namespace {
+constexpr int kShadowAtlasUnit = 1;
+constexpr int kVisibilityUnit = 2;
+}
+
+VisibilityRenderer::VisibilityRenderer() = default;
+
+VisibilityRenderer::~VisibilityRenderer() {
+    if (fullscreen_vao_ != 0) {
+        glDeleteVertexArrays(1, &fullscreen_vao_);
+    }
+}
+
+bool VisibilityRenderer::init(const std::filesystem::path& shader_dir) {
+    if (!resolve_shader_.init(shader_dir)) {
+        logging::log(0, logging::ERROR, "VisibilityRenderer: failed to initialize resolve shader");
+        return false;
+    }
+    resolve_shader_.start();
+    resolve_shader_.set_visibility_texture(kVisibilityUnit);
+    resolve_shader_.stop();
+    glGenVertexArrays(1, &fullscreen_vao_);
+    return true;
+}
+
+void VisibilityRenderer::prepare_visibility(const FBOData::SPtr& visibility_fbo) {
+    if (!visibility_fbo) {
+        return;
+    }
+    GLuint fbo = static_cast<GLuint>(*visibility_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    const GLuint clear_empty[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, clear_empty);
+    glDepthMask(GL_TRUE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDrawBuffer(GL_BACK);
+    glReadBuffer(GL_BACK);
+}
+
+void VisibilityRenderer::resolve(const FBOData::SPtr& target, const TextureData* visibility, int width, int height,
+                                 InstanceBuffer& instance_buffer, const Mat4f& view_matrix,
+                                 const Mat4f& projection_matrix, const Vec3f& camera_position,
+                                 const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights) {
+    if (!target || !visibility || geometry_.triangle_count() == 0) {
+        return;
+    }
+    GLuint fbo = static_cast<GLuint>(*target);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    Mat4f view_projection = projection_matrix.matmul(view_matrix);
+
+    resolve_shader_.start();
+    resolve_shader_.set_camera_matrices(view_matrix, projection_matrix);
+    resolve_shader_.set_camera_position(camera_position);
+    resolve_shader_.set_view_projection(view_projection);
+    resolve_shader_.set_viewport_size(width, height);
+    resolve_shader_.set_debug_mode(0);
+    resolve_shader_.set_directional_lights(directional_lights);
+    if (light_clusters_) {
+        light_clusters_->bind();
+    }
+    resolve_shader_.set_light_clusters(light_clusters_, width, height);
+    if (shadow_atlas_ && shadow_atlas_->texture()) {
+        resolve_shader_.bind_shadow_atlas(static_cast<GLuint>(*shadow_atlas_->texture()), kShadowAtlasUnit,
+                                          shadow_atlas_->filter());
+    }
+    glActiveTexture(GL_TEXTURE0 + kVisibilityUnit);
+    glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(*visibility));
+    glActiveTexture(GL_TEXTURE0);
+
+    instance_buffer.bind(0);
+    geometry_.bind();
+
+    glBindVertexArray(fullscreen_vao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    resolve_shader_.stop();
+
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDrawBuffer(GL_BACK);
+    glReadBuffer(GL_BACK);
+
+    logging::log(0, logging::DEBUG,
+                 "VisibilityRenderer: resolved " + std::to_string(geometry_.triangle_count()) +
+                     " pooled triangles with " +
+                     std::to_string(light_clusters_ ? light_clusters_->light_count() : 0) + " clustered lights");
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "VisibilityResolveShader.h"
+#include "../../gldata/fbo_data.h"
+#include "../../gldata/texture_data.h"
+#include "../../lighting/shadow_atlas.h"
+#include "../../rendering/InstanceBuffer.h"
+#include "../../rendering/visibility/VisibilityGeometry.h"
+
+class LightClusters;
+class Transformation;
+
+// Visibility buffer alternative to the forward lit pass. Opaque geometry only writes instance slot and triangle id,
+// so overdraw costs no material evaluation. The resolve pass rebuilds position, normal, uv and uv gradients of each
+// pixel from the pooled mesh data and shades it once with the clustered lighting of the forward path.
+class VisibilityRenderer {
+public:
+    VisibilityRenderer();
+    ~VisibilityRenderer();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_shadow_atlas(const ShadowAtlas* atlas) { shadow_atlas_ = atlas; }
+    void set_light_clusters(LightClusters* clusters) { light_clusters_ = clusters; }
+
+    // clears ids and depth of a visibility framebuffer, the frame graph owns its RG32UI and depth textures
+    void prepare_visibility(const FBOData::SPtr& visibility_fbo);
+    // shades every covered pixel of the visibility texture into the color attachment of target
+    void resolve(const FBOData::SPtr& target, const TextureData* visibility, int width, int height,
+                 InstanceBuffer& instance_buffer, const Mat4f& view_matrix, const Mat4f& projection_matrix,
+                 const Vec3f& camera_position,
+                 const std::vector<std::pair<DirectionalLight*, Transformation*>>& directional_lights);
+
+    VisibilityGeometry& geometry() { return geometry_; }
+
+private:
+    VisibilityResolveShader resolve_shader_;
+    VisibilityGeometry geometry_;
+    const ShadowAtlas* shadow_atlas_{nullptr};
+    LightClusters* light_clusters_{nullptr};
+
+    GLuint fullscreen_vao_{0};
+};
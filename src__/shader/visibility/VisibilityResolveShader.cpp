@@ -0,0 +1,37 @@
+#include "VisibilityResolveShader.h"
+
+VisibilityResolveShader::VisibilityResolveShader()
+    : view_projection_location_(-1)
+    , viewport_size_location_(-1)
+    , visibility_location_(-1) {}
+
+bool VisibilityResolveShader::init(const std::filesystem::path& shader_dir) {
+    vertex_file((shader_dir / "deferred" / "deferred_lighting.vert").string());
+    fragment_file((shader_dir / "visibility" / "visibility_resolve.frag").string());
+    compile();
+    get_all_uniform_locations();
+    return true;
+}
+
+void VisibilityResolveShader::get_all_uniform_locations() {
+    LitShader::get_all_uniform_locations();
+    view_projection_location_ = get_uniform_location("u_view_projection");
+    viewport_size_location_ = get_uniform_location("u_viewport_size");
+    visibility_location_ = get_uniform_location("u_visibility");
+}
+
+void VisibilityResolveShader::set_view_projection(const Mat4f& view_projection) {
+    load_matrix(view_projection_location_, const_cast<Mat4f&>(view_projection));
+}
+
+void VisibilityResolveShader::set_viewport_size(int width, int height) {
+    if (viewport_size_location_ >= 0) {
+        glUniform2f(viewport_size_location_, static_cast<float>(width), static_cast<float>(height));
+    }
+}
+
+void VisibilityResolveShader::set_visibility_texture(int unit) {
+    if (visibility_location_ >= 0) {
+        glUniform1i(visibility_location_, unit);
+    }
+}
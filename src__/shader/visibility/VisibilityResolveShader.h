@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../lit/LitShader.h"
+
+// fullscreen pass that rebuilds each pixel's surface from the visibility buffer and shades it once
+class VisibilityResolveShader : public LitShader {
+public:
+    VisibilityResolveShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    void set_view_projection(const Mat4f& view_projection);
+    void set_viewport_size(int width, int height);
+    void set_visibility_texture(int unit);
+
+protected:
+    void get_all_uniform_locations() override;
+
+private:
+    GLint view_projection_location_;
+    GLint viewport_size_location_;
+    GLint visibility_location_;
+};
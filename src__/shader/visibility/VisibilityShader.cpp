@@ -0,0 +1,22 @@
+#include "VisibilityShader.h"
+
+VisibilityShader::VisibilityShader() : triangle_base_location_(-1) {}
+
+bool VisibilityShader::init(const std::filesystem::path& shader_dir) {
+    vertex_file((shader_dir / "visibility" / "visibility.vert").string());
+    fragment_file((shader_dir / "visibility" / "visibility.frag").string());
+    compile();
+    get_all_uniform_locations();
+    return true;
+}
+
+void VisibilityShader::get_all_uniform_locations() {
+    LitShader::get_all_uniform_locations();
+    triangle_base_location_ = get_uniform_location("u_triangle_base");
+}
+
+void VisibilityShader::set_triangle_base(std::uint32_t base) {
+    if (triangle_base_location_ >= 0) {
+        glUniform1ui(triangle_base_location_, base);
+    }
+}
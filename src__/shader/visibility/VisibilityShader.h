@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../lit/LitShader.h"
+
+// writes instance slot and global triangle id of opaque geometry into the visibility buffer
+class VisibilityShader : public LitShader {
+public:
+    VisibilityShader();
+
+    bool init(const std::filesystem::path& shader_dir);
+
+    // global id of the first triangle of the mesh drawn next, see VisibilityGeometry
+    void set_triangle_base(std::uint32_t base);
+
+protected:
+    void get_all_uniform_locations() override;
+
+private:
+    GLint triangle_base_location_;
+};
@@ -0,0 +1,12 @@
+#version 460 core
+
+// x instance slot + 1 so zero marks empty pixels, y global triangle id in VisibilityGeometry
+layout(location = 0) out uvec2 out_visibility;
+
+flat in uint v_instance;
+
+uniform uint u_triangle_base;
+
+void main() {
+    out_visibility = uvec2(v_instance + 1u, u_triangle_base + uint(gl_PrimitiveID));
+}
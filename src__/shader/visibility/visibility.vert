@@ -0,0 +1,28 @@
+#version 460 core
+
+layout(location = 0) in vec3 in_position;
+
+#include "../instance.glsl"
+#include "../vertex_pull.glsl"
+
+// written by the GPU culling pre-pass, maps a drawn instance to its slot in InstanceBuffer
+layout(std430, binding = 1) readonly buffer VisibleInstanceBuffer {
+    uint visible_instances[];
+};
+
+uniform int u_instance_remap;
+
+uniform mat4 u_view;
+uniform mat4 u_projection;
+
+flat out uint v_instance;
+
+void main() {
+    uint index = gl_BaseInstance + gl_InstanceID;
+    if (u_instance_remap != 0) {
+        index = visible_instances[index];
+    }
+    v_instance = index;
+    vec3 position = u_vertex_pulling != 0 ? pulled_position(pulled_vertex()) : in_position;
+    gl_Position = u_projection * u_view * instance_model(index) * vec4(position, 1.0);
+}
@@ -0,0 +1,103 @@
+#version 450 core
+#extension GL_ARB_bindless_texture : require
+#extension GL_ARB_gpu_shader_int64 : require
+
+#include "../lit/lit_common.glsl"
+
+layout(location = 0) out vec4 frag_color;
+
+#include "../instance.glsl"
+
+struct VisibilityVertex {
+    // xyz object space position, w texcoord u
+    vec4 position_u;
+    // xyz object space normal, w texcoord v
+    vec4 normal_v;
+};
+
+layout(std430, binding = 13) readonly buffer VisibilityVertexBuffer {
+    VisibilityVertex visibility_vertices[];
+};
+
+// xyz pooled vertex indices, w material id
+layout(std430, binding = 14) readonly buffer VisibilityTriangleBuffer {
+    ivec4 visibility_triangles[];
+};
+
+uniform usampler2D u_visibility;
+uniform mat4 u_view_projection;
+uniform vec2 u_viewport_size;
+
+float cross2(vec2 a, vec2 b) { return a.x * b.y - a.y * b.x; }
+
+// perspective correct barycentrics of the ndc point inside the triangle given by its clip space corners
+vec3 barycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 ndc) {
+    vec2 p0 = c0.xy / c0.w;
+    vec2 p1 = c1.xy / c1.w;
+    vec2 p2 = c2.xy / c2.w;
+    float area = cross2(p1 - p0, p2 - p0);
+    float b1 = cross2(ndc - p0, p2 - p0) / area;
+    float b2 = cross2(p1 - p0, ndc - p0) / area;
+    vec3 b = vec3(1.0 - b1 - b2, b1, b2) / vec3(c0.w, c1.w, c2.w);
+    return b / (b.x + b.y + b.z);
+}
+
+void main() {
+    uvec2 visibility = texelFetch(u_visibility, ivec2(gl_FragCoord.xy), 0).xy;
+    // nothing was drawn here, keep the clear color
+    if (visibility.x == 0u) {
+        discard;
+    }
+
+    mat4 model = instance_model(visibility.x - 1u);
+    ivec4 triangle = visibility_triangles[visibility.y];
+    VisibilityVertex v0 = visibility_vertices[triangle.x];
+    VisibilityVertex v1 = visibility_vertices[triangle.y];
+    VisibilityVertex v2 = visibility_vertices[triangle.z];
+
+    vec3 w0 = (model * vec4(v0.position_u.xyz, 1.0)).xyz;
+    vec3 w1 = (model * vec4(v1.position_u.xyz, 1.0)).xyz;
+    vec3 w2 = (model * vec4(v2.position_u.xyz, 1.0)).xyz;
+    vec4 c0 = u_view_projection * vec4(w0, 1.0);
+    vec4 c1 = u_view_projection * vec4(w1, 1.0);
+    vec4 c2 = u_view_projection * vec4(w2, 1.0);
+
+    // barycentrics one pixel right and up give the uv gradients the rasterizer would have provided
+    vec2 pixel = 2.0 / u_viewport_size;
+    vec2 ndc = gl_FragCoord.xy * pixel - 1.0;
+    vec3 b = barycentrics(c0, c1, c2, ndc);
+    vec3 b_dx = barycentrics(c0, c1, c2, ndc + vec2(pixel.x, 0.0));
+    vec3 b_dy = barycentrics(c0, c1, c2, ndc + vec2(0.0, pixel.y));
+
+    mat3x2 uvs = mat3x2(vec2(v0.position_u.w, v0.normal_v.w), vec2(v1.position_u.w, v1.normal_v.w),
+                        vec2(v2.position_u.w, v2.normal_v.w));
+    vec2 uv = uvs * b;
+    vec2 uv_dx = uvs * b_dx - uv;
+    vec2 uv_dy = uvs * b_dy - uv;
+
+    vec3 world_pos = mat3(w0, w1, w2) * b;
+    vec3 object_normal = mat3(v0.normal_v.xyz, v1.normal_v.xyz, v2.normal_v.xyz) * b;
+    vec3 N = normalize(mat3(transpose(inverse(model))) * object_normal);
+
+    MaterialSample _sample = sample_material_grad(triangle.w, uv, uv_dx, uv_dy);
+
+    // same checker override as lit.frag so both paths produce the same image
+    const float tile_size = 0.05;
+    vec2 grid = floor(uv / tile_size);
+    float checker = mod(grid.x + grid.y, 2.0);
+    vec3 checker_color_light = vec3(0.92, 0.92, 0.92);
+    vec3 checker_color_dark = vec3(0.12, 0.12, 0.12);
+    _sample.base_color = mix(checker_color_dark, checker_color_light, checker);
+
+    vec3 V = normalize(u_camera_pos - world_pos);
+    if (length(V) < 1e-5) {
+        V = vec3(0.0, 0.0, 1.0);
+    }
+
+    if (u_debug_mode == 1) {
+        frag_color = vec4(N * 0.5 + 0.5, 1.0);
+        return;
+    }
+
+    frag_color = vec4(evaluate_lit_color(_sample, N, V, world_pos), 1.0);
+}